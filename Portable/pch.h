@@ -0,0 +1,26 @@
+#pragma once
+
+// Precompiled header of the portable build, in place of the apps' Windows one:
+// the standard headers the shared sources lean on, and the few names they take
+// from the Windows and C++/CX headers.
+
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <DirectXMath.h>
+
+typedef uint32_t uint32;
+
+inline void OutputDebugStringA(const char* message)
+{
+    fputs(message, stderr);
+}
@@ -3,7 +3,9 @@
 
 #include <ppltasks.h>
 
+#include "Common\AllocationTracker.h"
 #include "Common\FramerateController.h"
+#include "LPGL\lpglStatistics.h"
 
 using namespace StereopsisBlockStacking;
 
@@ -111,20 +113,43 @@ void AppView::Run()
 
             CoreWindow::GetForCurrentThread()->Dispatcher->ProcessEvents(CoreProcessEventsOption::ProcessAllIfPresent);
 
-            HolographicFrame^ holographicFrame = m_main->Update();
+            framerateController->BeginPhase(eFPUpdate);
+            HolographicFrame^ holographicFrame;
+            {
+                AllocationPhaseScope updatePhase(eAPUpdate);
+                holographicFrame = m_main->Update();
+            }
+            framerateController->EndPhase(eFPUpdate);
+
+            framerateController->BeginPhase(eFPRender);
+            bool rendered;
+            {
+                AllocationPhaseScope renderPhase(eAPRender);
+                rendered = m_main->Render(holographicFrame);
+            }
+            framerateController->EndPhase(eFPRender);
 
-            if (m_main->Render(holographicFrame))
+            if (rendered)
             {
                 framerateController->Wait();
 
                 m_deviceResources->Present(holographicFrame);
             }
+
+            AllocationTracker::EndFrame();
+
+            // Submission statistics are split by the tier the frame ran at.
+            lpglEndFrame(FrameStatistics::TierFromFramerate(framerateController->GetFPS()));
         }
         else
         {
             CoreWindow::GetForCurrentThread()->Dispatcher->ProcessEvents(CoreProcessEventsOption::ProcessOneAndAllPending);
         }
     }
+
+    framerateController->DumpStatistics();
+    AllocationTracker::DumpCumulative();
+    lpglDumpStatistics();
 }
 
 // Terminate events do not cause Uninitialize to be called. It will be called if your IFrameworkView
@@ -194,13 +194,22 @@ void DX::CameraResources::UpdateViewProjectionBuffer(
         // Update the view matrices. Holographic cameras (such as Microsoft HoloLens) are
         // constantly moving relative to the world. The view matrices need to be updated
         // every frame.
+        XMStoreFloat4x4(
+            &m_viewProjection[0],
+            XMLoadFloat4x4(&viewCoordinateSystemTransform.Left) * XMLoadFloat4x4(&cameraProjectionTransform.Left)
+            );
+        XMStoreFloat4x4(
+            &m_viewProjection[1],
+            XMLoadFloat4x4(&viewCoordinateSystemTransform.Right) * XMLoadFloat4x4(&cameraProjectionTransform.Right)
+            );
+
         XMStoreFloat4x4(
             &viewProjectionConstantBufferData.viewProjection[0],
-            XMMatrixTranspose(XMLoadFloat4x4(&viewCoordinateSystemTransform.Left) * XMLoadFloat4x4(&cameraProjectionTransform.Left))
+            XMMatrixTranspose(XMLoadFloat4x4(&m_viewProjection[0]))
             );
         XMStoreFloat4x4(
             &viewProjectionConstantBufferData.viewProjection[1],
-            XMMatrixTranspose(XMLoadFloat4x4(&viewCoordinateSystemTransform.Right) * XMLoadFloat4x4(&cameraProjectionTransform.Right))
+            XMMatrixTranspose(XMLoadFloat4x4(&m_viewProjection[1]))
             );
     }
 
@@ -47,6 +47,10 @@ namespace DX
         Windows::Foundation::Size GetRenderTargetSize()             const { return m_d3dRenderTargetSize;           }
         bool                    IsRenderingStereoscopic()           const { return m_isStereo;                      }
 
+        // View-projection of one eye from the last UpdateViewProjectionBuffer, not
+        // transposed for the shader.
+        const DirectX::XMFLOAT4X4& GetViewProjection(int view)     const { return m_viewProjection[view];          }
+
         // The holographic camera these resources are for.
         Windows::Graphics::Holographic::HolographicCamera^ GetHolographicCamera() const { return m_holographicCamera; }
 
@@ -59,6 +63,9 @@ namespace DX
         // Device resource to store view and projection matrices.
         Microsoft::WRL::ComPtr<ID3D11Buffer>                m_viewProjectionConstantBuffer;
 
+        // CPU copy of the matrices in the view-projection constant buffer.
+        DirectX::XMFLOAT4X4                                 m_viewProjection[2];
+
         // Direct3D rendering properties.
         DXGI_FORMAT                                         m_dxgiFormat;
         Windows::Foundation::Size                           m_d3dRenderTargetSize;
@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "FrameArena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+FrameArena::FrameArena(size_t capacity)
+{
+    head = AllocateBlock(capacity);
+    this->capacity = capacity;
+}
+
+FrameArena::~FrameArena()
+{
+    FreeBlocks();
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(head + 1);
+    uintptr_t current = (base + head->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+    if (current + size > base + head->capacity) {
+        // Out of room; chain a block big enough for this request and the rest of the frame.
+        size_t blockCapacity = size + alignment > head->capacity ? size + alignment : head->capacity;
+
+        Block* block = AllocateBlock(blockCapacity);
+        block->next = head;
+        head = block;
+        capacity += blockCapacity;
+
+        base = reinterpret_cast<uintptr_t>(head + 1);
+        current = (base + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    size_t newUsed = current + size - base;
+    bytesUsed += newUsed - head->used;
+    head->used = newUsed;
+
+    return reinterpret_cast<void*>(current);
+}
+
+void FrameArena::Reset()
+{
+    heapAllocationsThisFrame = 0;
+
+    if (head->next) {
+        // The last frame overflowed; replace the chain with one block that fits it.
+        FreeBlocks();
+        head = AllocateBlock(capacity);
+    }
+
+    head->used = 0;
+    bytesUsed = 0;
+}
+
+bool FrameArena::Owns(const void* p) const
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(p);
+
+    for (Block* block = head; block; block = block->next) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(block + 1);
+
+        if (address >= base && address < base + block->capacity)
+            return true;
+    }
+
+    return false;
+}
+
+FrameArena::Block* FrameArena::AllocateBlock(size_t blockCapacity)
+{
+    Block* block = static_cast<Block*>(malloc(sizeof(Block) + blockCapacity));
+
+    if (!block)
+        throw std::bad_alloc();
+
+    block->next = nullptr;
+    block->capacity = blockCapacity;
+    block->used = 0;
+
+    heapAllocationCount++;
+    heapAllocationsThisFrame++;
+
+    return block;
+}
+
+void FrameArena::FreeBlocks()
+{
+    while (head) {
+        Block* next = head->next;
+        free(head);
+        head = next;
+    }
+}
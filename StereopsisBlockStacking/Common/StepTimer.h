@@ -15,7 +15,8 @@ namespace DX
             m_framesThisSecond(0),
             m_qpcSecondCounter(0),
             m_isFixedTimeStep(false),
-            m_targetElapsedTicks(TicksPerSecond / 60)
+            m_targetElapsedTicks(TicksPerSecond / 60),
+            m_maxStepsPerTick(0)
         {
             m_qpcFrequency = GetPerformanceFrequency();
 
@@ -44,6 +45,17 @@ namespace DX
         void SetTargetElapsedTicks(uint64 targetElapsed)      { m_targetElapsedTicks = targetElapsed;   }
         void SetTargetElapsedSeconds(double targetElapsed)    { m_targetElapsedTicks = SecondsToTicks(targetElapsed);   }
 
+        // Limit how many catch-up Update calls a single Tick may make in fixed timestep
+        // mode. Time beyond the limit is dropped. Zero means no limit.
+        void SetMaxStepsPerTick(uint32 maxSteps)              { m_maxStepsPerTick = maxSteps;           }
+
+        // Get how far the current time is between the last fixed Update and the next one,
+        // in the range [0, 1). Used to interpolate rendered state between fixed updates.
+        double GetInterpolationFactor() const
+        {
+            return m_isFixedTimeStep ? static_cast<double>(m_leftOverTicks) / m_targetElapsedTicks : 1.0;
+        }
+
         // Integer format represents time using 10,000,000 ticks per second.
         static const uint64 TicksPerSecond = 10'000'000;
 
@@ -129,8 +141,18 @@ namespace DX
 
                 m_leftOverTicks += timeDelta;
 
+                uint32 steps = 0;
+
                 while (m_leftOverTicks >= m_targetElapsedTicks)
                 {
+                    // Drop the backlog rather than falling further behind.
+                    if (m_maxStepsPerTick != 0 && steps == m_maxStepsPerTick)
+                    {
+                        m_leftOverTicks %= m_targetElapsedTicks;
+                        break;
+                    }
+
+                    steps++;
                     m_elapsedTicks   = m_targetElapsedTicks;
                     m_totalTicks    += m_targetElapsedTicks;
                     m_leftOverTicks -= m_targetElapsedTicks;
@@ -185,5 +207,6 @@ namespace DX
         // Members for configuring fixed timestep mode.
         bool   m_isFixedTimeStep;
         uint64 m_targetElapsedTicks;
+        uint32 m_maxStepsPerTick;
     };
 }
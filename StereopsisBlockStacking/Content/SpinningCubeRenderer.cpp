@@ -1,8 +1,10 @@
 #include "pch.h"
 #include "SpinningCubeRenderer.h"
+#include "Common\AllocationTracker.h"
 #include "Common\DirectXHelper.h"
 
 #include "LPGL\lpgl.h"
+#include "LPGL\lpglVertexFormat.h"
 
 using namespace StereopsisBlockStacking;
 using namespace Concurrency;
@@ -10,6 +12,16 @@ using namespace DirectX;
 using namespace Windows::Foundation::Numerics;
 using namespace Windows::UI::Input::Spatial;
 
+// Gives LPGL the world-space box of the next draw, so it is culled when no eye sees it.
+static void SetDrawBounds(const BoundingBox& bounds)
+{
+	XMFLOAT3 min, max;
+	XMStoreFloat3(&min, XMVectorSubtract(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents)));
+	XMStoreFloat3(&max, XMVectorAdd(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents)));
+
+	glDrawBounds(&min.x, &max.x);
+}
+
 // Loads vertex and pixel shaders from files and instantiates the cube geometry.
 SpinningCubeRenderer::SpinningCubeRenderer()
 {
@@ -22,87 +34,236 @@ SpinningCubeRenderer::SpinningCubeRenderer(const XMFLOAT3& color)
     CreateDeviceDependentResources();
 }
 
+// Called once per fixed simulation step, after the step has moved the block.
 void SpinningCubeRenderer::Update(const DX::StepTimer& timer)
+{
+	m_previousPosition = m_lastStepPosition;
+	m_lastStepPosition = m_position;
+}
+
+void SpinningCubeRenderer::Render(float interpolation)
 {
 	if (!m_loadingComplete)
 	{
 		return;
 	}
+
+	XMFLOAT4X4 instanceTransform = GetInstanceTransform(interpolation);
+
+	glBindVertexArray(m_mesh->vertexArray);
+	glColor3f(m_color.x, m_color.y, m_color.z);
+
+	glLoadIdentity();
+	glInstanceTransforms(1, &instanceTransform.m[0][0]);
+
+	BoundingBox bounds;
+	initialBoundingBox.Transform(bounds, XMLoadFloat4x4(&instanceTransform));
+	SetDrawBounds(bounds);
+
+	glDrawElementsInstanced(GL_TRIANGLES, m_mesh->indexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+
+	glBindVertexArray(0);
 }
 
-void SpinningCubeRenderer::Render()
+void SpinningCubeRenderer::RenderBatch(const std::vector<std::unique_ptr<SpinningCubeRenderer>>& renderers, float interpolation)
 {
-	if (!m_loadingComplete)
+	// Larger groups are split over several draws.
+	const GLsizei kMaxInstancesPerDraw = 64;
+	XMFLOAT4X4 instanceTransforms[kMaxInstancesPerDraw];
+
+	for (size_t i = 0; i < renderers.size(); ++i) {
+		const SpinningCubeRenderer& first = *renderers[i];
+
+		if (!first.m_loadingComplete)
+			continue;
+
+		// Only the first block of each group draws it.
+		bool drawnEarlier = false;
+		for (size_t j = 0; j < i && !drawnEarlier; ++j)
+			drawnEarlier = renderers[j]->m_loadingComplete && renderers[j]->CanBatchWith(first);
+
+		if (drawnEarlier)
+			continue;
+
+		glBindVertexArray(first.m_mesh->vertexArray);
+		glColor3f(first.m_color.x, first.m_color.y, first.m_color.z);
+
+		glLoadIdentity();
+
+		GLsizei instanceCount = 0;
+		BoundingBox drawBounds;
+
+		auto drawInstances = [&]() {
+			glInstanceTransforms(instanceCount, &instanceTransforms[0].m[0][0]);
+			SetDrawBounds(drawBounds);
+			glDrawElementsInstanced(GL_TRIANGLES, first.m_mesh->indexCount, GL_UNSIGNED_SHORT, nullptr,
+				LPGL_VIEW_COUNT * instanceCount);
+			instanceCount = 0;
+		};
+
+		for (size_t j = i; j < renderers.size(); ++j) {
+			if (!renderers[j]->m_loadingComplete || !renderers[j]->CanBatchWith(first))
+				continue;
+
+			instanceTransforms[instanceCount] = renderers[j]->GetInstanceTransform(interpolation);
+
+			BoundingBox instanceBounds;
+			renderers[j]->initialBoundingBox.Transform(instanceBounds, XMLoadFloat4x4(&instanceTransforms[instanceCount]));
+
+			if (instanceCount++ == 0)
+				drawBounds = instanceBounds;
+			else
+				BoundingBox::CreateMerged(drawBounds, drawBounds, instanceBounds);
+
+			if (instanceCount == kMaxInstancesPerDraw)
+				drawInstances();
+		}
+
+		if (instanceCount > 0)
+			drawInstances();
+	}
+
+	glBindVertexArray(0);
+}
+
+XMFLOAT4X4 SpinningCubeRenderer::GetInstanceTransform(float interpolation) const
+{
+	float3 position = lerp(m_previousPosition, m_lastStepPosition, interpolation);
+
+	XMFLOAT4X4 instanceTransform;
+	XMStoreFloat4x4(&instanceTransform,
+		XMMatrixMultiply(
+			XMMatrixScaling(m_scale.x, m_scale.y, m_scale.z),
+			XMMatrixTranslation(position.x, position.y, position.z)
+		));
+
+	return instanceTransform;
+}
+
+bool SpinningCubeRenderer::CanBatchWith(const SpinningCubeRenderer& other) const
+{
+	return SharesMeshWith(other) &&
+		m_color.x == other.m_color.x && m_color.y == other.m_color.y && m_color.z == other.m_color.z;
+}
+
+SpinningCubeRenderer::CubeMesh::~CubeMesh()
+{
+	glDeleteVertexArrays(1, &vertexArray);
+
+	const GLuint buffers[] = { vertexBuffer, indexBuffer };
+	glDeleteBuffers(2, buffers);
+}
+
+std::shared_ptr<const SpinningCubeRenderer::CubeMesh> SpinningCubeRenderer::AcquireCubeMesh()
+{
+	// Held while loading, so blocks loading at the same time wait for a single load.
+	static std::mutex mutex;
+	static std::weak_ptr<const CubeMesh> loadedMesh;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<const CubeMesh> sharedMesh = loadedMesh.lock();
+
+	if (sharedMesh)
+		return sharedMesh;
+
+	std::shared_ptr<CubeMesh> mesh = std::make_shared<CubeMesh>();
+
+	// Bindings made on the default context could land in a vertex array the
+	// rendering thread has bound.
+	lpglContext* loadContext = lpglCreateContext();
+	lpglMakeCurrent(loadContext);
+
+	float width = 0.05f;
+	const std::array<XMFLOAT3, 8> cubePositions =
+	{ {
+		XMFLOAT3(-width, -width, -width),
+		XMFLOAT3(-width, -width,  width),
+		XMFLOAT3(-width,  width, -width),
+		XMFLOAT3(-width,  width,  width),
+		XMFLOAT3(width, -width, -width),
+		XMFLOAT3(width, -width,  width),
+		XMFLOAT3(width,  width, -width),
+		XMFLOAT3(width,  width,  width),
+	} };
+
+	DirectX::BoundingBox::CreateFromPoints(
+		mesh->bounds,
+		cubePositions.size(),
+		cubePositions.data(),
+		sizeof(XMFLOAT3));
+
+	// Every vertex of a block has its color, set for each draw, so only positions
+	// are stored, in the smallest format that keeps them within a tenth of a
+	// millimeter.
+	const lpglVertexLayout vertexLayout = lpglChooseVertexLayout(cubePositions[0], cubePositions[7], 1e-4f, true);
+
+	// Vertices are written straight into the buffer's mapped memory.
+	const GLsizei vertexBufferSize = static_cast<GLsizei>(vertexLayout.Stride() * cubePositions.size());
+
+	glGenBuffers(1, &mesh->vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, nullptr, GL_STATIC_DRAW);
+
+	void* cubeVertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBufferSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+	for (size_t i = 0; i < cubePositions.size(); ++i)
 	{
-		return;
+		vertexLayout.Write(cubeVertices, i, cubePositions[i], vertexLayout.color);
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
 
-	glLoadIdentity();
-	glScalef(m_scale.x, m_scale.y, m_scale.z);
-	glTranslatef(m_position.x, m_position.y, m_position.z);
+	constexpr std::array<unsigned short, 36> cubeIndices =
+	{ {
+		2,1,0, // -x
+		2,3,1,
+
+		6,4,5, // +x
+		6,5,7,
+
+		0,1,5, // -y
+		0,5,4,
+
+		2,6,7, // +y
+		2,7,3,
 
-	glDrawElementsInstanced(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_SHORT, nullptr, 2);
+		0,4,6, // -z
+		0,6,2,
+
+		1,3,7, // +z
+		1,7,5,
+	} };
+
+	mesh->indexCount = static_cast<unsigned int>(cubeIndices.size());
+
+	glGenBuffers(1, &mesh->indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		sizeof(unsigned short) * cubeIndices.size(),
+		cubeIndices.data(), GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &mesh->vertexArray);
+	glBindVertexArray(mesh->vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+	vertexLayout.Bind();
+	glBindVertexArray(0);
+
+	lpglMakeCurrent(nullptr);
+	lpglDestroyContext(loadContext);
+
+	loadedMesh = mesh;
+	return mesh;
 }
 
 void SpinningCubeRenderer::CreateDeviceDependentResources()
 {
 	task<void> createCubeTask = create_task([this]()
 	{
-		float width = 0.05f;
-		const std::array<VertexPositionColor, 8> cubeVertices =
-		{ {
-			{ XMFLOAT3(-width, -width, -width), m_color },
-			{ XMFLOAT3(-width, -width,  width), m_color },
-			{ XMFLOAT3(-width,  width, -width), m_color },
-			{ XMFLOAT3(-width,  width,  width), m_color },
-			{ XMFLOAT3(width, -width, -width), m_color },
-			{ XMFLOAT3(width, -width,  width), m_color },
-			{ XMFLOAT3(width,  width, -width), m_color },
-			{ XMFLOAT3(width,  width,  width), m_color },
-		} };
-
-		DirectX::BoundingBox::CreateFromPoints(
-			initialBoundingBox,
-			cubeVertices.size(),
-			reinterpret_cast<const XMFLOAT3*>(cubeVertices.data()),
-			sizeof(XMFLOAT3) * 2);
-
-		glGenBuffers(1, &vertexBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPositionColor) * cubeVertices.size(),
-			cubeVertices.data(), GL_STATIC_DRAW);
-
-		constexpr std::array<unsigned short, 36> cubeIndices =
-		{ {
-			2,1,0, // -x
-			2,3,1,
-
-			6,4,5, // +x
-			6,5,7,
-
-			0,1,5, // -y
-			0,5,4,
-
-			2,6,7, // +y
-			2,7,3,
-
-			0,4,6, // -z
-			0,6,2,
-
-			1,3,7, // +z
-			1,7,5,
-		} };
-
-		m_indexCount = static_cast<unsigned int>(cubeIndices.size());
-
-		glGenBuffers(1, &indexBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			sizeof(unsigned short) * cubeIndices.size(),
-			cubeIndices.data(), GL_STATIC_DRAW);
+		AllocationPhaseScope loadPhase(eAPLoad);
+
+		m_mesh = AcquireCubeMesh();
+		initialBoundingBox = m_mesh->bounds;
 	});
 
 	// Once the cube is loaded, the object is ready to be rendered.
@@ -115,6 +276,9 @@ void SpinningCubeRenderer::CreateDeviceDependentResources()
 void SpinningCubeRenderer::ReleaseDeviceDependentResources()
 {
 	m_loadingComplete = false;
+
+	// The last block to let go deletes the buffers.
+	m_mesh.reset();
 }
 
 DirectX::BoundingBox SpinningCubeRenderer::GetBoundingBox() const
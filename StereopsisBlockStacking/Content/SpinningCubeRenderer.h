@@ -7,6 +7,10 @@
 
 #include <DirectXCollision.h>
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace StereopsisBlockStacking
 {
     // This sample renderer instantiates a basic rendering pipeline.
@@ -19,7 +23,14 @@ namespace StereopsisBlockStacking
         void CreateDeviceDependentResources();
         void ReleaseDeviceDependentResources();
         void Update(const DX::StepTimer& timer);
-        void Render();
+
+        // Renders the block between its last two simulated positions; interpolation
+        // is the fraction of a fixed update elapsed since the last one.
+        void Render(float interpolation = 1.0f);
+
+        // Renders the blocks sharing a mesh and a color with a single
+        // stereo-instanced draw per group.
+        static void RenderBatch(const std::vector<std::unique_ptr<SpinningCubeRenderer>>& renderers, float interpolation = 1.0f);
 
         // Property accessors.
         void SetPosition(Windows::Foundation::Numerics::float3 pos) { m_position = pos;  }
@@ -38,17 +49,49 @@ namespace StereopsisBlockStacking
 		bool isGrabbed = false;
 
     private:
-		DirectX::BoundingBox initialBoundingBox;
+		// Scale and interpolated position, applied per instance.
+		DirectX::XMFLOAT4X4 GetInstanceTransform(float interpolation) const;
+
+		// The cube geometry, loaded once and shared by every block. Holds no
+		// color; m_color is set for each draw. The buffers are deleted with the
+		// last reference.
+		struct CubeMesh
+		{
+			CubeMesh() = default;
+			CubeMesh(const CubeMesh&) = delete;
+			CubeMesh& operator=(const CubeMesh&) = delete;
+			~CubeMesh();
+
+			GLuint vertexBuffer = 0;
+			GLuint indexBuffer = 0;
+
+			// Both buffers and the vertex layout.
+			GLuint vertexArray = 0;
 
-		GLuint vertexBuffer;
-		GLuint indexBuffer;
+			uint32 indexCount = 0;
+
+			// In model space.
+			DirectX::BoundingBox bounds;
+		};
+
+		// Returns the cube mesh, loading it on the calling thread if no block holds it.
+		static std::shared_ptr<const CubeMesh> AcquireCubeMesh();
+
+		bool SharesMeshWith(const SpinningCubeRenderer& other) const { return m_mesh == other.m_mesh; }
+
+		// Blocks drawn together also share the color set for the draw.
+		bool CanBatchWith(const SpinningCubeRenderer& other) const;
+
+		DirectX::BoundingBox initialBoundingBox;
 
         // System resources for cube geometry.
-        uint32                                          m_indexCount = 0;
+        std::shared_ptr<const CubeMesh>                 m_mesh;
 
         // Variables used with the rendering loop.
         bool                                            m_loadingComplete = false;
         Windows::Foundation::Numerics::float3           m_position = { 0.f, 0.f, -2.f };
+        Windows::Foundation::Numerics::float3           m_previousPosition = { 0.f, 0.f, -2.f };
+        Windows::Foundation::Numerics::float3           m_lastStepPosition = { 0.f, 0.f, -2.f };
         Windows::Foundation::Numerics::float3           m_scale = { 1.0f, 1.0f, 1.0f };
 		DirectX::XMFLOAT3			m_color = { 1.0f, 1.0f, 1.0f };
 		bool m_isVisible = true;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "lpglCommand.h"
+
+// Drops draws whose glDrawBounds box no view can see. Each view's frustum is
+// tested as two groups of four planes, one plane per SIMD lane: left, right,
+// bottom and top, then near. The far plane is left out, since holographic
+// projections may put it at infinity. A draw is culled only when it is fully
+// outside some plane of every view, so anything either eye sees is kept.
+class lpglFrustumCuller {
+public:
+	// LPGL_VIEW_COUNT view-projections in the matrix stack's layout.
+	void SetViewProjections(const DirectX::XMFLOAT4X4* viewProjections);
+
+	bool IsVisible(const lpglDrawBounds& bounds) const;
+
+	// Removes the draws of commandBuffer no view sees, keeping the order of
+	// everything else, and counts culled and passed draws. Returns the number
+	// of draws removed.
+	size_t Cull(lpglCommandBuffer& commandBuffer) const;
+
+private:
+	// Four planes a * x + b * y + c * z + d >= 0 in structure of arrays form,
+	// with the absolute normals the box extents are projected on.
+	struct PlaneGroup {
+		DirectX::XMVECTOR a, b, c, d;
+		DirectX::XMVECTOR absA, absB, absC;
+	};
+
+	static const int kPlaneGroups = 2;
+
+	PlaneGroup m_planes[LPGL_VIEW_COUNT][kPlaneGroups];
+};
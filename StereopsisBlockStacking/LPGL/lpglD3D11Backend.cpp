@@ -0,0 +1,784 @@
+#include "pch.h"
+#include "lpglD3D11Backend.h"
+
+#include "lpglVertexFormat.h"
+
+#include "Content\ShaderStructures.h"
+#include "Common\DirectXHelper.h"
+
+#include <ppl.h>
+
+using namespace DirectX;
+using namespace Concurrency;
+
+namespace {
+	const GLenum kPositionTypes[] = { GL_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_SHORT };
+	const GLenum kColorTypes[] = { GL_FLOAT, GL_UNSIGNED_BYTE, GL_NONE };
+
+	// Sixteen-bit positions carry an unused fourth component; the shader reads xyz.
+	const DXGI_FORMAT kPositionFormats[] = { DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R16G16B16A16_UNORM };
+	const DXGI_FORMAT kColorFormats[] = { DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM };
+
+	template <size_t N>
+	int TypeIndex(const GLenum (&types)[N], GLenum type)
+	{
+		for (size_t i = 0; i < N; ++i) {
+			if (types[i] == type)
+				return static_cast<int>(i);
+		}
+
+		return -1;
+	}
+}
+
+lpglD3D11Backend::lpglD3D11Backend(const std::shared_ptr<DX::DeviceResources>& deviceResources) :
+	m_deviceResources(deviceResources)
+{
+	Initialize();
+}
+
+void lpglD3D11Backend::Initialize()
+{
+	const CD3D11_BUFFER_DESC constantBufferDesc(sizeof(ModelConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+	m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&constantBufferDesc,
+		nullptr,
+		&m_modelConstantBuffer
+	);
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	m_deviceResources->GetD3DDevice()->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+
+	m_useModelConstantsRing = options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+
+	if (m_useModelConstantsRing)
+		m_modelConstantsRing.Initialize(m_deviceResources->GetD3DDevice(), kModelConstantsRingSize, D3D11_BIND_CONSTANT_BUFFER);
+
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	m_deviceResources->GetD3DDevice()->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+
+	m_driverCommandLists = threading.DriverCommandLists != FALSE;
+
+	m_usingVprtShaders = m_deviceResources->GetDeviceSupportsVprt();
+
+	std::wstring vertexShaderFileName = m_usingVprtShaders ? L"ms-appx:///VprtVertexShader.cso" : L"ms-appx:///VertexShader.cso";
+
+	task<std::vector<byte>> loadVSTask = DX::ReadDataAsync(vertexShaderFileName);
+	task<std::vector<byte>> loadPSTask = DX::ReadDataAsync(L"ms-appx:///PixelShader.cso");
+
+	task<std::vector<byte>> loadGSTask;
+	if (!m_usingVprtShaders)
+	{
+		loadGSTask = DX::ReadDataAsync(L"ms-appx:///GeometryShader.cso");
+	}
+
+	task<void> createVSTask = loadVSTask.then([this](const std::vector<byte>& fileData)
+	{
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateVertexShader(
+				fileData.data(),
+				fileData.size(),
+				nullptr,
+				&m_vertexShader
+			)
+		);
+
+		// The float layout, which Execute checks for, is created last.
+		for (int positionType = kPositionTypeCount - 1; positionType >= 0; --positionType) {
+			for (int colorType = kColorTypeCount - 1; colorType >= 0; --colorType) {
+				const bool constantColor = kColorTypes[colorType] == GL_NONE;
+				const UINT colorOffset = static_cast<UINT>(lpglPositionSize(kPositionTypes[positionType]));
+
+				// Instance transforms advance once per LPGL_VIEW_COUNT instances, so both
+				// eyes of a stereo-instanced draw share a matrix.
+				const std::array<D3D11_INPUT_ELEMENT_DESC, 6> vertexDesc =
+				{ {
+					{ "POSITION", 0, kPositionFormats[positionType], 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+					{ "COLOR",    0, kColorFormats[colorType], constantColor ? 2u : 0u, constantColor ? 0u : colorOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+					{ "INSTANCE_TRANSFORM", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,  0, D3D11_INPUT_PER_INSTANCE_DATA, LPGL_VIEW_COUNT },
+					{ "INSTANCE_TRANSFORM", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, LPGL_VIEW_COUNT },
+					{ "INSTANCE_TRANSFORM", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, LPGL_VIEW_COUNT },
+					{ "INSTANCE_TRANSFORM", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, LPGL_VIEW_COUNT },
+				} };
+
+				DX::ThrowIfFailed(
+					m_deviceResources->GetD3DDevice()->CreateInputLayout(
+						vertexDesc.data(),
+						static_cast<UINT>(vertexDesc.size()),
+						fileData.data(),
+						static_cast<UINT>(fileData.size()),
+						&m_inputLayouts[positionType][colorType]
+					)
+				);
+			}
+		}
+	});
+
+	task<void> createPSTask = loadPSTask.then([this](const std::vector<byte>& fileData)
+	{
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				fileData.data(),
+				fileData.size(),
+				nullptr,
+				&m_pixelShader
+			)
+		);
+	});
+
+	task<void> createGSTask;
+	if (!m_usingVprtShaders)
+	{
+		createGSTask = loadGSTask.then([this](const std::vector<byte>& fileData)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreateGeometryShader(
+					fileData.data(),
+					fileData.size(),
+					nullptr,
+					&m_geometryShader
+				)
+			);
+		});
+	}
+}
+
+void lpglD3D11Backend::BufferData(GLuint buffer, GLenum target, GLsizei size, const GLvoid* data, GLenum usage)
+{
+	D3D11_BIND_FLAG bindFlag;
+
+	switch (target) {
+	case GL_ARRAY_BUFFER:
+		bindFlag = D3D11_BIND_VERTEX_BUFFER;
+		break;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		bindFlag = D3D11_BIND_INDEX_BUFFER;
+		break;
+	default:
+		return;
+	}
+
+	D3D11_SUBRESOURCE_DATA bufferData = { 0 };
+	bufferData.pSysMem = data;
+	bufferData.SysMemPitch = 0;
+	bufferData.SysMemSlicePitch = 0;
+
+	const bool stream = usage == GL_STREAM_DRAW;
+
+	const CD3D11_BUFFER_DESC bufferDesc(
+		static_cast<UINT>(size),
+		bindFlag,
+		stream ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT,
+		stream ? D3D11_CPU_ACCESS_WRITE : 0);
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> d3dBuffer;
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&bufferDesc,
+			data ? &bufferData : nullptr,
+			&d3dBuffer
+		)
+	);
+
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	Buffer& newBuffer = m_buffers.Insert(buffer);
+	newBuffer.buffer = d3dBuffer;
+	newBuffer.usage = usage;
+	newBuffer.size = size;
+
+	if (stream) {
+		newBuffer.contents.resize(size);
+
+		if (data)
+			memcpy(newBuffer.contents.data(), data, size);
+	}
+
+	RefreshVertexArrays(buffer);
+}
+
+void lpglD3D11Backend::DeleteBuffer(GLuint buffer)
+{
+	// The runtime keeps the buffer alive until the GPU is done with it.
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+	m_buffers.Erase(buffer);
+
+	RefreshVertexArrays(buffer);
+}
+
+void lpglD3D11Backend::VertexArray(GLuint array, const lpglVertexArrayDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	VertexArrayBindings* bindings = m_vertexArrays.Find(array);
+
+	if (!bindings)
+		bindings = &m_vertexArrays.Insert(array);
+
+	bindings->desc = desc;
+	ResolveVertexArray(*bindings);
+}
+
+void lpglD3D11Backend::DeleteVertexArray(GLuint array)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+	m_vertexArrays.Erase(array);
+}
+
+void lpglD3D11Backend::ResolveVertexArray(VertexArrayBindings& bindings) const
+{
+	const Buffer* vertexBuffer = m_buffers.Find(bindings.desc.arrayBuffer);
+	const Buffer* indexBuffer = m_buffers.Find(bindings.desc.elementArrayBuffer);
+
+	bindings.positionType = TypeIndex(kPositionTypes, bindings.desc.positionType);
+	bindings.colorType = TypeIndex(kColorTypes, bindings.desc.colorType);
+	bindings.vertexStride = static_cast<UINT>(lpglVertexStride(bindings.desc.positionType, bindings.desc.colorType));
+	bindings.vertexBuffer = vertexBuffer ? vertexBuffer->buffer.Get() : nullptr;
+	bindings.indexBuffer = indexBuffer ? indexBuffer->buffer.Get() : nullptr;
+}
+
+void lpglD3D11Backend::RefreshVertexArrays(GLuint buffer)
+{
+	m_vertexArrays.ForEach([&](GLuint, VertexArrayBindings& bindings)
+	{
+		if (bindings.desc.arrayBuffer == buffer || bindings.desc.elementArrayBuffer == buffer)
+			ResolveVertexArray(bindings);
+	});
+}
+
+void lpglD3D11Backend::Execute(const lpglCommandBuffer& commandBuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Shaders are still loading; nothing can be drawn yet, but buffer updates
+	// must not be lost.
+	if (!m_inputLayouts[0][0] || !m_vertexShader || !m_pixelShader) {
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+		for (const lpglCommand& command : commandBuffer.commands) {
+			if (command.type == LPGL_COMMAND_BUFFER_SUB_DATA)
+				BufferSubData(context, command.bufferSubData, commandBuffer.payload.data());
+		}
+
+		if (m_uploadRingUsed)
+			m_uploadRing.Fence(context);
+		m_uploadRingUsed = false;
+
+		return;
+	}
+
+	TrimConstantColorBuffers();
+
+	m_immediate.shadow = ShadowState();
+	m_immediate.stateCounters = StateCounters();
+
+	UploadInstanceTransforms(context, m_immediate, commandBuffer.instanceTransforms);
+
+	m_immediate.modelConstantsInRing = m_useModelConstantsRing && UploadModelConstants(context, m_immediate, commandBuffer.transforms);
+
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	for (const lpglCommand& command : commandBuffer.commands) {
+		switch (command.type) {
+		case LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED:
+			DrawElementsInstanced(context, m_immediate, command.drawElements, command.drawElements.transform,
+				commandBuffer.transforms[command.drawElements.transform]);
+			break;
+		case LPGL_COMMAND_BUFFER_SUB_DATA:
+			BufferSubData(context, command.bufferSubData, commandBuffer.payload.data());
+			break;
+		}
+	}
+
+	if (m_immediate.modelConstantsInRing)
+		m_modelConstantsRing.Fence(context);
+
+	if (m_uploadRingUsed)
+		m_uploadRing.Fence(context);
+	m_uploadRingUsed = false;
+
+	m_stateCounters.issued += m_immediate.stateCounters.issued;
+	m_stateCounters.skipped += m_immediate.stateCounters.skipped;
+}
+
+void lpglD3D11Backend::ExecuteCommandLists(const lpglCommandBuffer* const* commandLists, size_t count)
+{
+	// Runs of lists that can be deferred are translated together; the others
+	// replay on the immediate context in between, keeping submission order.
+	size_t first = 0;
+
+	while (first < count) {
+		size_t last = first;
+
+		while (last < count && CanDefer(*commandLists[last]))
+			last++;
+
+		if (last - first > 1) {
+			ExecuteDeferred(commandLists + first, last - first);
+			first = last;
+			continue;
+		}
+
+		Execute(*commandLists[first]);
+		first++;
+	}
+}
+
+bool lpglD3D11Backend::CanDefer(const lpglCommandBuffer& commandBuffer) const
+{
+	if (!m_inputLayouts[0][0] || !m_vertexShader || !m_pixelShader)
+		return false;
+
+	for (const lpglCommand& command : commandBuffer.commands) {
+		if (command.type != LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED)
+			return false;
+	}
+
+	return true;
+}
+
+void lpglD3D11Backend::ExecuteDeferred(const lpglCommandBuffer* const* commandLists, size_t count)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Deferred contexts start from default state; they draw into whatever the
+	// caller bound on the immediate context for this camera.
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTarget;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencil;
+	context->OMGetRenderTargets(1, &renderTarget, &depthStencil);
+
+	D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+	UINT viewportCount = ARRAYSIZE(viewports);
+	context->RSGetViewports(&viewportCount, viewports);
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> viewProjectionConstantBuffer;
+	context->VSGetConstantBuffers(1, 1, &viewProjectionConstantBuffer);
+
+	while (m_deferredContexts.size() < count) {
+		auto deferredContext = std::make_unique<DeferredContext>();
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDeferredContext1(0, &deferredContext->context)
+		);
+
+		m_deferredContexts.push_back(std::move(deferredContext));
+	}
+
+	TrimConstantColorBuffers();
+
+	{
+		// The workers only look buffers up; loader threads wait until they are done.
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+		parallel_for(size_t(0), count, [&](size_t i)
+		{
+			DeferredContext& deferredContext = *m_deferredContexts[i];
+			ID3D11DeviceContext1* deferred = deferredContext.context.Get();
+
+			deferred->OMSetRenderTargets(1, renderTarget.GetAddressOf(), depthStencil.Get());
+			deferred->RSSetViewports(viewportCount, viewports);
+			deferred->VSSetConstantBuffers(1, 1, viewProjectionConstantBuffer.GetAddressOf());
+
+			ReplayDraws(deferred, deferredContext.replay, *commandLists[i]);
+
+			DX::ThrowIfFailed(
+				deferred->FinishCommandList(FALSE, &deferredContext.commandList)
+			);
+		});
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		DeferredContext& deferredContext = *m_deferredContexts[i];
+
+		// Restoring leaves the immediate context as the caller set it up.
+		context->ExecuteCommandList(deferredContext.commandList.Get(), TRUE);
+		deferredContext.commandList.Reset();
+
+		m_stateCounters.issued += deferredContext.replay.stateCounters.issued;
+		m_stateCounters.skipped += deferredContext.replay.stateCounters.skipped;
+	}
+}
+
+void lpglD3D11Backend::ReplayDraws(ID3D11DeviceContext1* context, ReplayState& replay, const lpglCommandBuffer& commandBuffer)
+{
+	replay.shadow = ShadowState();
+	replay.stateCounters = StateCounters();
+
+	UploadInstanceTransforms(context, replay, commandBuffer.instanceTransforms);
+
+	// NO_OVERWRITE maps of the shared ring are not possible from a deferred
+	// context; each draw updates the model constant buffer instead.
+	replay.modelConstantsInRing = false;
+
+	for (const lpglCommand& command : commandBuffer.commands) {
+		if (command.type == LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED)
+			DrawElementsInstanced(context, replay, command.drawElements, command.drawElements.transform,
+				commandBuffer.transforms[command.drawElements.transform]);
+	}
+}
+
+void lpglD3D11Backend::BufferSubData(ID3D11DeviceContext* context, const lpglBufferSubDataCommand& command, const unsigned char* payload)
+{
+	Buffer* buffer = m_buffers.Find(command.buffer);
+
+	if (!buffer || !buffer->buffer || command.offset + command.size > buffer->size)
+		return;
+
+	const unsigned char* data = command.hasData ? payload + command.payloadOffset : nullptr;
+
+	if (buffer->usage == GL_STREAM_DRAW) {
+		if (data)
+			memcpy(buffer->contents.data() + command.offset, data, command.size);
+
+		// Discarding hands back fresh memory, so draws already recorded against
+		// the old contents are unaffected.
+		D3D11_MAPPED_SUBRESOURCE mapped;
+
+		DX::ThrowIfFailed(
+			context->Map(buffer->buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)
+		);
+
+		// Orphaned without data: the contents are undefined, nothing to write.
+		if (data)
+			memcpy(mapped.pData, buffer->contents.data(), buffer->size);
+
+		context->Unmap(buffer->buffer.Get(), 0);
+		return;
+	}
+
+	if (!data)
+		return;
+
+	if (!m_uploadRing.IsInitialized()) {
+		m_uploadRing.Initialize(m_deviceResources->GetD3DDevice(), kUploadRingSize, D3D11_BIND_VERTEX_BUFFER);
+		lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+	}
+
+	size_t offset;
+	void* upload = m_uploadRing.Map(context, command.size, 16, &offset);
+
+	const D3D11_BOX destBox = { static_cast<UINT>(command.offset), 0, 0, static_cast<UINT>(command.offset + command.size), 1, 1 };
+
+	// Larger than the whole ring.
+	if (!upload) {
+		context->UpdateSubresource(
+			buffer->buffer.Get(),
+			0,
+			&destBox,
+			data,
+			0,
+			0
+		);
+		return;
+	}
+
+	memcpy(upload, data, command.size);
+	m_uploadRing.Unmap(context);
+	m_uploadRingUsed = true;
+
+	const D3D11_BOX sourceBox = { static_cast<UINT>(offset), 0, 0, static_cast<UINT>(offset + command.size), 1, 1 };
+
+	context->CopySubresourceRegion(
+		buffer->buffer.Get(),
+		0,
+		destBox.left,
+		0,
+		0,
+		m_uploadRing.GetBuffer(),
+		0,
+		&sourceBox
+	);
+}
+
+bool lpglD3D11Backend::UploadModelConstants(ID3D11DeviceContext* context, ReplayState& replay,
+	const std::vector<XMFLOAT4X4>& transforms)
+{
+	size_t offset;
+	byte* data = static_cast<byte*>(m_modelConstantsRing.Map(context,
+		transforms.size() * kModelConstantsStride, kModelConstantsStride, &offset));
+
+	// More transforms than the whole ring holds.
+	if (!data)
+		return false;
+
+	for (const XMFLOAT4X4& transform : transforms) {
+		ModelConstantBuffer* modelConstantBufferData = reinterpret_cast<ModelConstantBuffer*>(data);
+
+		XMStoreFloat4x4(
+			&modelConstantBufferData->model,
+			XMMatrixTranspose(XMLoadFloat4x4(&transform)));
+
+		data += kModelConstantsStride;
+	}
+
+	m_modelConstantsRing.Unmap(context);
+	replay.modelConstantsOffset = offset;
+
+	lpglCount(LPGL_COUNTER_CONSTANT_BUFFER_UPDATES, transforms.size());
+	lpglCount(LPGL_COUNTER_BYTES_UPLOADED, transforms.size() * sizeof(ModelConstantBuffer));
+
+	return true;
+}
+
+void lpglD3D11Backend::UploadInstanceTransforms(ID3D11DeviceContext* context, ReplayState& replay,
+	const std::vector<XMFLOAT4X4>& instanceTransforms)
+{
+	if (instanceTransforms.size() > replay.instanceBufferCapacity) {
+		size_t capacity = replay.instanceBufferCapacity ? replay.instanceBufferCapacity : 64;
+
+		while (capacity < instanceTransforms.size())
+			capacity *= 2;
+
+		const CD3D11_BUFFER_DESC bufferDesc(
+			static_cast<UINT>(capacity * sizeof(XMFLOAT4X4)),
+			D3D11_BIND_VERTEX_BUFFER,
+			D3D11_USAGE_DYNAMIC,
+			D3D11_CPU_ACCESS_WRITE);
+
+		replay.instanceBuffer.Reset();
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&bufferDesc,
+				nullptr,
+				&replay.instanceBuffer
+			)
+		);
+
+		replay.instanceBufferCapacity = capacity;
+
+		lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	DX::ThrowIfFailed(
+		context->Map(replay.instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)
+	);
+
+	memcpy(mapped.pData, instanceTransforms.data(), instanceTransforms.size() * sizeof(XMFLOAT4X4));
+
+	context->Unmap(replay.instanceBuffer.Get(), 0);
+
+	lpglCount(LPGL_COUNTER_BYTES_UPLOADED, instanceTransforms.size() * sizeof(XMFLOAT4X4));
+}
+
+void lpglD3D11Backend::DrawElementsInstanced(ID3D11DeviceContext1* context, ReplayState& replay, const lpglDrawElementsCommand& command,
+	GLuint transformIndex, const XMFLOAT4X4& transform)
+{
+	// Draws without a vertex array, or recorded before it last changed, look
+	// their bindings up here.
+	const VertexArrayBindings* bindings = m_vertexArrays.Find(command.vertexArray);
+	VertexArrayBindings resolved;
+
+	if (!bindings || !bindings->Describes(command)) {
+		resolved.desc = { command.arrayBuffer, command.elementArrayBuffer, command.positionType, command.colorType };
+		ResolveVertexArray(resolved);
+		bindings = &resolved;
+	}
+
+	if (!bindings->vertexBuffer || !bindings->indexBuffer || bindings->positionType < 0 || bindings->colorType < 0)
+		return;
+
+	ID3D11InputLayout* inputLayout = m_inputLayouts[bindings->positionType][bindings->colorType].Get();
+
+	if (ChangeState(replay, replay.shadow.inputLayout, inputLayout))
+		context->IASetInputLayout(inputLayout);
+
+	if (ChangeState(replay, replay.shadow.vertexShader, m_vertexShader.Get()))
+		context->VSSetShader(
+			m_vertexShader.Get(),
+			nullptr,
+			0
+		);
+	if (ChangeState(replay, replay.shadow.pixelShader, m_pixelShader.Get()))
+		context->PSSetShader(
+			m_pixelShader.Get(),
+			nullptr,
+			0
+		);
+
+	if (!m_usingVprtShaders && ChangeState(replay, replay.shadow.geometryShader, m_geometryShader.Get()))
+	{
+		// On devices that do not support the D3D11_FEATURE_D3D11_OPTIONS3::
+		// VPAndRTArrayIndexFromAnyShaderFeedingRasterizer optional feature,
+		// a pass-through geometry shader is used to set the render target
+		// array index.
+		context->GSSetShader(
+			m_geometryShader.Get(),
+			nullptr,
+			0
+		);
+	}
+
+	// Draws recorded under the same matrix share a transform index.
+	if (replay.modelConstantsInRing) {
+		if (ChangeState(replay, replay.shadow.transform, transformIndex)) {
+			// Offsets and sizes are in 16-byte constants.
+			const UINT firstConstant = static_cast<UINT>((replay.modelConstantsOffset + transformIndex * kModelConstantsStride) / 16);
+			const UINT constantCount = static_cast<UINT>(kModelConstantsStride / 16);
+			context->VSSetConstantBuffers1(
+				0,
+				1,
+				m_modelConstantsRing.GetAddressOf(),
+				&firstConstant,
+				&constantCount
+			);
+		}
+	}
+	else if (ChangeState(replay, replay.shadow.transform, transformIndex)) {
+		ModelConstantBuffer modelConstantBufferData;
+
+		XMStoreFloat4x4(
+			&modelConstantBufferData.model,
+			XMMatrixTranspose(XMLoadFloat4x4(&transform)));
+		context->UpdateSubresource(
+			m_modelConstantBuffer.Get(),
+			0,
+			nullptr,
+			&modelConstantBufferData,
+			0,
+			0
+		);
+
+		lpglCount(LPGL_COUNTER_CONSTANT_BUFFER_UPDATES);
+		lpglCount(LPGL_COUNTER_BYTES_UPLOADED, sizeof(ModelConstantBuffer));
+	}
+
+	if (!replay.modelConstantsInRing && ChangeState(replay, replay.shadow.modelConstantBuffer, m_modelConstantBuffer.Get()))
+		context->VSSetConstantBuffers(
+			0,
+			1,
+			m_modelConstantBuffer.GetAddressOf()
+		);
+
+	bool vertexBufferChanged = ChangeState(replay, replay.shadow.vertexBuffer, bindings->vertexBuffer);
+	bool vertexStrideChanged = ChangeState(replay, replay.shadow.vertexStride, bindings->vertexStride);
+
+	if (vertexBufferChanged || vertexStrideChanged) {
+		const UINT offset = 0;
+		context->IASetVertexBuffers(
+			0,
+			1,
+			&bindings->vertexBuffer,
+			&bindings->vertexStride,
+			&offset
+		);
+	}
+
+	if (command.colorType == GL_NONE) {
+		ID3D11Buffer* colorBuffer = GetConstantColorBuffer(command.color);
+
+		if (colorBuffer && ChangeState(replay, replay.shadow.colorBuffer, colorBuffer)) {
+			const UINT stride = 0;
+			const UINT offset = 0;
+			context->IASetVertexBuffers(
+				2,
+				1,
+				&colorBuffer,
+				&stride,
+				&offset
+			);
+		}
+	}
+
+	// Both instance buffer and offset are shadowed; the buffer is replaced when it grows.
+	bool instanceBufferChanged = ChangeState(replay, replay.shadow.instanceBuffer, replay.instanceBuffer.Get());
+	bool instanceOffsetChanged = ChangeState(replay, replay.shadow.instanceBufferOffset,
+		static_cast<UINT>(command.firstInstanceTransform * sizeof(XMFLOAT4X4)));
+
+	if (instanceBufferChanged || instanceOffsetChanged) {
+		const UINT stride = sizeof(XMFLOAT4X4);
+		const UINT offset = replay.shadow.instanceBufferOffset;
+		context->IASetVertexBuffers(
+			1,
+			1,
+			replay.instanceBuffer.GetAddressOf(),
+			&stride,
+			&offset
+		);
+	}
+
+	DXGI_FORMAT indexBufferFormat;
+
+	switch (command.type) {
+	case GL_UNSIGNED_SHORT:
+		indexBufferFormat = DXGI_FORMAT_R16_UINT;
+		break;
+	case GL_UNSIGNED_INT:
+		indexBufferFormat = DXGI_FORMAT_R32_UINT;
+		break;
+	default:
+		return;
+	}
+
+	// Evaluate both so the counters see two state slots.
+	bool indexBufferChanged = ChangeState(replay, replay.shadow.indexBuffer, bindings->indexBuffer);
+	bool indexFormatChanged = ChangeState(replay, replay.shadow.indexBufferFormat, indexBufferFormat);
+
+	if (indexBufferChanged || indexFormatChanged)
+		context->IASetIndexBuffer(
+			bindings->indexBuffer,
+			indexBufferFormat,
+			0
+		);
+
+	D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	switch (command.mode) {
+	case GL_TRIANGLES:
+		topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		break;
+	}
+
+	if (ChangeState(replay, replay.shadow.topology, topology))
+		context->IASetPrimitiveTopology(topology);
+
+	context->DrawIndexedInstanced(
+		command.count,
+		command.primcount,
+		command.firstIndex,
+		command.baseVertex,
+		0
+	);
+}
+
+ID3D11Buffer* lpglD3D11Backend::GetConstantColorBuffer(GLuint color)
+{
+	std::lock_guard<std::mutex> lock(m_constantColorsMutex);
+
+	auto it = m_constantColors.find(color);
+
+	if (it != m_constantColors.end())
+		return it->second.Get();
+
+	const CD3D11_BUFFER_DESC bufferDesc(sizeof(color), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+
+	D3D11_SUBRESOURCE_DATA bufferData = { 0 };
+	bufferData.pSysMem = &color;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&bufferDesc,
+			&bufferData,
+			&buffer
+		)
+	);
+
+	lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+
+	return (m_constantColors[color] = buffer).Get();
+}
+
+void lpglD3D11Backend::TrimConstantColorBuffers()
+{
+	std::lock_guard<std::mutex> lock(m_constantColorsMutex);
+
+	// Colors that change every frame would otherwise pile up. The runtime keeps
+	// buffers still bound alive.
+	if (m_constantColors.size() >= kMaxConstantColorBuffers)
+		m_constantColors.clear();
+}
@@ -0,0 +1,144 @@
+#include "pch.h"
+#include "lpglD3D11Ring.h"
+
+#include "Common\DirectXHelper.h"
+
+void lpglD3D11Ring::Initialize(ID3D11Device* device, size_t capacity, UINT bindFlags)
+{
+	Release();
+
+	const CD3D11_BUFFER_DESC bufferDesc(
+		static_cast<UINT>(capacity),
+		bindFlags,
+		D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE);
+
+	DX::ThrowIfFailed(
+		device->CreateBuffer(
+			&bufferDesc,
+			nullptr,
+			&m_buffer
+		)
+	);
+
+	m_device = device;
+	m_capacity = capacity;
+}
+
+void lpglD3D11Ring::Release()
+{
+	m_buffer.Reset();
+	m_device.Reset();
+	m_capacity = 0;
+
+	m_head = 0;
+	m_inFlight = 0;
+	m_pending = 0;
+
+	for (FenceEntry& fence : m_fences) {
+		fence.query.Reset();
+		fence.size = 0;
+	}
+
+	m_oldestFence = 0;
+	m_fenceCount = 0;
+}
+
+void* lpglD3D11Ring::Map(ID3D11DeviceContext* context, size_t size, size_t alignment, size_t* offset)
+{
+	size_t aligned = (m_head + alignment - 1) & ~(alignment - 1);
+
+	// Never split an allocation across the end; skip the tail instead.
+	if (aligned + size > m_capacity)
+		aligned = m_capacity;
+
+	size_t needed = (aligned - m_head) + size;
+
+	if (aligned == m_capacity)
+		aligned = 0;
+
+	if (needed > m_capacity)
+		return nullptr;
+
+	Retire(context, false);
+
+	while (m_capacity - m_inFlight - m_pending < needed) {
+		// Our own unfenced allocations may be what fills the ring.
+		if (m_fenceCount == 0)
+			Fence(context);
+
+		Retire(context, true);
+	}
+
+	// Nothing of the buffer is in use, so the driver may hand out fresh memory.
+	D3D11_MAP mapType = m_inFlight == 0 && m_pending == 0 ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	DX::ThrowIfFailed(
+		context->Map(m_buffer.Get(), 0, mapType, 0, &mapped)
+	);
+
+	m_head = aligned + size;
+	m_pending += needed;
+	*offset = aligned;
+
+	return static_cast<byte*>(mapped.pData) + aligned;
+}
+
+void lpglD3D11Ring::Unmap(ID3D11DeviceContext* context)
+{
+	context->Unmap(m_buffer.Get(), 0);
+}
+
+void lpglD3D11Ring::Fence(ID3D11DeviceContext* context)
+{
+	if (m_pending == 0)
+		return;
+
+	if (m_fenceCount == kMaxFences)
+		Retire(context, true);
+
+	FenceEntry& fence = m_fences[(m_oldestFence + m_fenceCount) % kMaxFences];
+
+	if (!fence.query) {
+		const CD3D11_QUERY_DESC queryDesc(D3D11_QUERY_EVENT);
+
+		DX::ThrowIfFailed(
+			m_device->CreateQuery(&queryDesc, &fence.query)
+		);
+	}
+
+	context->End(fence.query.Get());
+
+	fence.size = m_pending;
+	m_inFlight += m_pending;
+	m_pending = 0;
+	m_fenceCount++;
+}
+
+bool lpglD3D11Ring::Retire(ID3D11DeviceContext* context, bool wait)
+{
+	bool retired = false;
+
+	while (m_fenceCount > 0) {
+		FenceEntry& fence = m_fences[m_oldestFence];
+
+		if (context->GetData(fence.query.Get(), nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			if (!wait || retired)
+				break;
+
+			m_stallCount++;
+
+			while (context->GetData(fence.query.Get(), nullptr, 0, 0) != S_OK)
+				;
+		}
+
+		m_inFlight -= fence.size;
+		m_oldestFence = (m_oldestFence + 1) % kMaxFences;
+		m_fenceCount--;
+		retired = true;
+	}
+
+	return retired;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+
+// Sub-allocates a dynamic D3D11 buffer as a ring. Each Map appends after the
+// previous one with D3D11_MAP_WRITE_NO_OVERWRITE; Fence marks everything
+// mapped so far as in use by the GPU until an event query signals. Space is
+// only handed out again once the fence that covers it has completed, so a ring
+// sized for a few frames never stalls.
+class lpglD3D11Ring {
+public:
+	void Initialize(ID3D11Device* device, size_t capacity, UINT bindFlags);
+	void Release();
+
+	bool IsInitialized() const { return m_buffer != nullptr; }
+
+	// Returns a CPU pointer to size bytes aligned to alignment, and their offset in the buffer.
+	void* Map(ID3D11DeviceContext* context, size_t size, size_t alignment, size_t* offset);
+	void Unmap(ID3D11DeviceContext* context);
+
+	// Issues a fence for all allocations made since the previous one.
+	void Fence(ID3D11DeviceContext* context);
+
+	ID3D11Buffer* GetBuffer() const { return m_buffer.Get(); }
+	ID3D11Buffer* const* GetAddressOf() const { return m_buffer.GetAddressOf(); }
+	size_t GetCapacity() const { return m_capacity; }
+
+	// Times Map had to block on the GPU because the ring was full.
+	unsigned long long GetStallCount() const { return m_stallCount; }
+
+private:
+	static const size_t kMaxFences = 16;
+
+	struct FenceEntry {
+		Microsoft::WRL::ComPtr<ID3D11Query> query;
+		size_t size = 0;
+	};
+
+	// Retires completed fences; with wait set, blocks until at least one retires.
+	bool Retire(ID3D11DeviceContext* context, bool wait);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> m_device;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_buffer;
+	size_t m_capacity = 0;
+
+	size_t m_head = 0;
+	size_t m_inFlight = 0;
+	size_t m_pending = 0;
+
+	std::array<FenceEntry, kMaxFences> m_fences;
+	size_t m_oldestFence = 0;
+	size_t m_fenceCount = 0;
+
+	unsigned long long m_stallCount = 0;
+};
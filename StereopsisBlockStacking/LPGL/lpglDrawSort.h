@@ -0,0 +1,54 @@
+#pragma once
+
+#include "lpglCommand.h"
+
+#include <cstdint>
+
+// Reorders a frame's draws by state before replay. Each draw gets a 64-bit key:
+//
+//   63..56 pipeline (topology and index format; LPGL has a single shader set)
+//   55..40 vertex buffer slot
+//   39..24 index buffer slot
+//   23..0  depth of the first instance, front to back
+//
+// Keys are radix sorted within runs of draws; any other command is a barrier
+// that draws do not move across. Draws of the same mesh end up adjacent and
+// are merged into one instanced draw, with their model matrices folded into
+// the instance transforms when they differ.
+class lpglDrawSorter {
+public:
+	// Rewrites commandBuffer in sorted order. Depth is taken from viewProjection,
+	// one eye's view-projection in the matrix stack's layout. Returns the number
+	// of draws merged away.
+	size_t Sort(lpglCommandBuffer& commandBuffer, const DirectX::XMFLOAT4X4& viewProjection);
+
+private:
+	struct KeyedDraw {
+		uint64_t key;
+		GLuint command;
+	};
+
+	static uint64_t MakeKey(const lpglDrawElementsCommand& draw, const lpglCommandBuffer& commandBuffer,
+		DirectX::FXMMATRIX viewProjection);
+
+	static bool CanMerge(const lpglDrawElementsCommand& a, const lpglDrawElementsCommand& b);
+
+	// Sorts m_keys by key, keeping the recorded order of equal keys.
+	void RadixSort();
+
+	// Appends the sorted draws of m_keys to m_commands, merging where possible.
+	size_t EmitRun(lpglCommandBuffer& commandBuffer);
+
+	void AppendInstanceTransforms(const lpglDrawElementsCommand& draw, const lpglCommandBuffer& commandBuffer, bool fold);
+
+	std::vector<KeyedDraw> m_keys;
+	std::vector<KeyedDraw> m_scratch;
+
+	// Rebuilt every Sort and swapped into the command buffer; they keep their
+	// capacity across frames.
+	std::vector<lpglCommand> m_commands;
+	std::vector<DirectX::XMFLOAT4X4> m_instanceTransforms;
+
+	// Index of the identity transform appended for folded draws, or -1.
+	GLuint m_identityTransform = static_cast<GLuint>(-1);
+};
@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "lpglNullBackend.h"
+
+#include "lpglVertexFormat.h"
+
+void lpglNullBackend::BufferData(GLuint buffer, GLenum /*target*/, GLsizei size, const GLvoid* /*data*/, GLenum /*usage*/)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	m_bufferSizes.Insert(buffer) = size;
+
+	m_counters.bufferDataCount++;
+	m_counters.bufferBytes += size;
+}
+
+void lpglNullBackend::DeleteBuffer(GLuint buffer)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	m_bufferSizes.Erase(buffer);
+
+	m_counters.deleteBufferCount++;
+}
+
+void lpglNullBackend::Execute(const lpglCommandBuffer& commandBuffer)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+	m_counters.executeCount++;
+	m_counters.commandCount += commandBuffer.commands.size();
+	m_counters.transformCount += commandBuffer.transforms.size();
+	m_counters.instanceTransformCount += commandBuffer.instanceTransforms.size();
+
+	for (const lpglCommand& command : commandBuffer.commands) {
+		switch (command.type) {
+		case LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED:
+			if (!IsValidDraw(command.drawElements, commandBuffer)) {
+				m_counters.invalidDrawCount++;
+				break;
+			}
+
+			m_counters.drawCount++;
+			m_counters.indexCount += static_cast<unsigned long long>(command.drawElements.count) * command.drawElements.primcount;
+			m_counters.instanceCount += command.drawElements.primcount;
+			break;
+		case LPGL_COMMAND_BUFFER_SUB_DATA:
+			if (!IsValidBufferSubData(command.bufferSubData, commandBuffer)) {
+				m_counters.invalidBufferSubDataCount++;
+				break;
+			}
+
+			m_counters.bufferSubDataCount++;
+			m_counters.bufferSubDataBytes += command.bufferSubData.size;
+			if (command.bufferSubData.orphan)
+				m_counters.orphanCount++;
+			break;
+		}
+	}
+}
+
+bool lpglNullBackend::IsValidDraw(const lpglDrawElementsCommand& command, const lpglCommandBuffer& commandBuffer) const
+{
+	if (command.transform >= commandBuffer.transforms.size())
+		return false;
+
+	// Every instance needs a transform to read.
+	if (static_cast<size_t>(command.firstInstanceTransform) + command.instanceTransformCount > commandBuffer.instanceTransforms.size() ||
+		command.primcount > LPGL_VIEW_COUNT * static_cast<GLsizei>(command.instanceTransformCount))
+		return false;
+
+	const GLsizei* vertexBufferSize = m_bufferSizes.Find(command.arrayBuffer);
+	const GLsizei* indexBufferSize = m_bufferSizes.Find(command.elementArrayBuffer);
+
+	if (!vertexBufferSize || !indexBufferSize)
+		return false;
+
+	const GLsizei stride = lpglVertexStride(command.positionType, command.colorType);
+
+	if (lpglPositionSize(command.positionType) == 0)
+		return false;
+
+	// Indices themselves are not read, so only a base vertex that cannot hit
+	// any vertex is caught.
+	if (command.baseVertex < 0 || static_cast<size_t>(command.baseVertex) * stride >= static_cast<size_t>(*vertexBufferSize))
+		return false;
+
+	size_t indexSize = 0;
+
+	switch (command.type) {
+	case GL_UNSIGNED_SHORT:
+		indexSize = sizeof(unsigned short);
+		break;
+	case GL_UNSIGNED_INT:
+		indexSize = sizeof(unsigned int);
+		break;
+	default:
+		return false;
+	}
+
+	return (static_cast<size_t>(command.firstIndex) + command.count) * indexSize <= static_cast<size_t>(*indexBufferSize);
+}
+
+bool lpglNullBackend::IsValidBufferSubData(const lpglBufferSubDataCommand& command, const lpglCommandBuffer& commandBuffer) const
+{
+	const GLsizei* bufferSize = m_bufferSizes.Find(command.buffer);
+
+	if (!bufferSize || command.offset < 0 || command.size < 0 || command.offset + command.size > *bufferSize)
+		return false;
+
+	if (command.orphan && (command.offset != 0 || command.size != *bufferSize))
+		return false;
+
+	return !command.hasData ||
+		static_cast<size_t>(command.payloadOffset) + command.size <= commandBuffer.payload.size();
+}
@@ -0,0 +1,397 @@
+#include "pch.h"
+#include "lpglSoftwareBackend.h"
+
+#include "lpglVertexFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+using namespace DirectX;
+
+lpglSoftwareBackend::lpglSoftwareBackend(int width, int height, unsigned threadCount) :
+	m_width(width),
+	m_height(height),
+	m_tilesX((width + kTileSize - 1) / kTileSize),
+	m_tilesY((height + kTileSize - 1) / kTileSize),
+	m_threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency()))
+{
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		XMStoreFloat4x4(&m_viewProjection[view], XMMatrixIdentity());
+
+		m_color[view].resize(static_cast<size_t>(width) * height);
+		m_depth[view].resize(static_cast<size_t>(width) * height);
+		m_bins[view].resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+	}
+
+	Clear();
+}
+
+void lpglSoftwareBackend::BufferData(GLuint buffer, GLenum /*target*/, GLsizei size, const GLvoid* data, GLenum /*usage*/)
+{
+	std::vector<unsigned char> storage(size);
+
+	if (data)
+		memcpy(storage.data(), data, size);
+
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+	m_buffers.Insert(buffer) = std::move(storage);
+}
+
+void lpglSoftwareBackend::DeleteBuffer(GLuint buffer)
+{
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+	m_buffers.Erase(buffer);
+}
+
+void lpglSoftwareBackend::SetViewProjection(int view, const XMFLOAT4X4& viewProjection)
+{
+	m_viewProjection[view] = viewProjection;
+}
+
+void lpglSoftwareBackend::Clear(uint32_t color, float depth)
+{
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		std::fill(m_color[view].begin(), m_color[view].end(), color);
+		std::fill(m_depth[view].begin(), m_depth[view].end(), depth);
+	}
+}
+
+void lpglSoftwareBackend::Execute(const lpglCommandBuffer& commandBuffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+
+		for (const lpglCommand& command : commandBuffer.commands) {
+			switch (command.type) {
+			case LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED:
+				DrawElementsInstanced(command.drawElements, commandBuffer);
+				break;
+			case LPGL_COMMAND_BUFFER_SUB_DATA: {
+				// Draws before the update were already transformed, so they keep the old contents.
+				const lpglBufferSubDataCommand& update = command.bufferSubData;
+				std::vector<unsigned char>* storage = m_buffers.Find(update.buffer);
+
+				if (storage && update.hasData && static_cast<size_t>(update.offset) + update.size <= storage->size())
+					memcpy(storage->data() + update.offset, commandBuffer.payload.data() + update.payloadOffset, update.size);
+				break;
+			}
+			}
+		}
+	}
+
+	RasterizeTiles();
+}
+
+void lpglSoftwareBackend::DrawElementsInstanced(const lpglDrawElementsCommand& command, const lpglCommandBuffer& commandBuffer)
+{
+	const std::vector<unsigned char>* vertexBuffer = m_buffers.Find(command.arrayBuffer);
+	const std::vector<unsigned char>* indexBuffer = m_buffers.Find(command.elementArrayBuffer);
+
+	if (!vertexBuffer || !indexBuffer || command.mode != GL_TRIANGLES)
+		return;
+
+	size_t indexSize;
+
+	switch (command.type) {
+	case GL_UNSIGNED_SHORT:
+		indexSize = sizeof(unsigned short);
+		break;
+	case GL_UNSIGNED_INT:
+		indexSize = sizeof(unsigned int);
+		break;
+	default:
+		return;
+	}
+
+	if ((static_cast<size_t>(command.firstIndex) + command.count) * indexSize > indexBuffer->size())
+		return;
+
+	const GLsizei stride = lpglVertexStride(command.positionType, command.colorType);
+
+	if (lpglPositionSize(command.positionType) == 0)
+		return;
+
+	const size_t vertexCount = vertexBuffer->size() / stride;
+
+	m_positions.resize(vertexCount);
+	m_colors.resize(vertexCount);
+
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const unsigned char* vertex = vertexBuffer->data() + i * stride;
+		m_positions[i] = lpglReadPosition(command.positionType, vertex);
+		m_colors[i] = lpglReadColor(command.positionType, command.colorType, command.color, vertex);
+	}
+
+	auto fetchIndex = [&](GLsizei i) -> long long {
+		size_t index = static_cast<size_t>(command.firstIndex) + i;
+		long long value = indexSize == sizeof(unsigned short)
+			? reinterpret_cast<const unsigned short*>(indexBuffer->data())[index]
+			: reinterpret_cast<const unsigned int*>(indexBuffer->data())[index];
+
+		return value + command.baseVertex;
+	};
+
+	const XMMATRIX model = XMLoadFloat4x4(&commandBuffer.transforms[command.transform]);
+
+	m_clipPositions.resize(vertexCount);
+
+	for (GLsizei instance = 0; instance < command.primcount; ++instance) {
+		const int view = instance % LPGL_VIEW_COUNT;
+		const GLuint instanceTransform = instance / LPGL_VIEW_COUNT;
+
+		if (instanceTransform >= command.instanceTransformCount)
+			break;
+
+		const XMMATRIX transform = XMMatrixMultiply(
+			XMMatrixMultiply(XMLoadFloat4x4(&commandBuffer.instanceTransforms[command.firstInstanceTransform + instanceTransform]), model),
+			XMLoadFloat4x4(&m_viewProjection[view]));
+
+		for (size_t i = 0; i < vertexCount; ++i)
+			XMStoreFloat4(&m_clipPositions[i], XMVector3Transform(XMLoadFloat3(&m_positions[i]), transform));
+
+		for (GLsizei i = 0; i + 2 < command.count; i += 3) {
+			XMFLOAT4 clip[3];
+			XMFLOAT3 color[3];
+			bool valid = true;
+
+			for (int corner = 0; corner < 3; ++corner) {
+				long long index = fetchIndex(i + corner);
+
+				if (index < 0 || static_cast<size_t>(index) >= vertexCount) {
+					valid = false;
+					break;
+				}
+
+				clip[corner] = m_clipPositions[index];
+				color[corner] = m_colors[index];
+			}
+
+			m_counters.triangleCount++;
+
+			if (valid)
+				SetupTriangle(clip, color, view);
+		}
+	}
+}
+
+void lpglSoftwareBackend::SetupTriangle(const XMFLOAT4* clip, const XMFLOAT3* color, int view)
+{
+	// Clipping one triangle against z >= 0 leaves at most a quad.
+	XMFLOAT4 polygonClip[4];
+	XMFLOAT3 polygonColor[4];
+	int polygonSize = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		const XMFLOAT4& a = clip[i];
+		const XMFLOAT4& b = clip[(i + 1) % 3];
+
+		if (a.z >= 0.0f) {
+			polygonClip[polygonSize] = a;
+			polygonColor[polygonSize] = color[i];
+			polygonSize++;
+		}
+
+		if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+			const float t = a.z / (a.z - b.z);
+			const XMFLOAT3& ca = color[i];
+			const XMFLOAT3& cb = color[(i + 1) % 3];
+
+			polygonClip[polygonSize] = XMFLOAT4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+			polygonColor[polygonSize] = XMFLOAT3(ca.x + (cb.x - ca.x) * t, ca.y + (cb.y - ca.y) * t, ca.z + (cb.z - ca.z) * t);
+			polygonSize++;
+		}
+	}
+
+	if (polygonSize != 3)
+		m_counters.clippedTriangleCount++;
+
+	ScreenVertex screen[4];
+
+	for (int i = 0; i < polygonSize; ++i) {
+		const XMFLOAT4& c = polygonClip[i];
+
+		if (c.w <= 1e-6f)
+			return;
+
+		ScreenVertex& v = screen[i];
+		v.invW = 1.0f / c.w;
+		v.x = (c.x * v.invW * 0.5f + 0.5f) * m_width;
+		v.y = (0.5f - c.y * v.invW * 0.5f) * m_height;
+		v.z = c.z * v.invW;
+		v.r = polygonColor[i].x * v.invW;
+		v.g = polygonColor[i].y * v.invW;
+		v.b = polygonColor[i].z * v.invW;
+	}
+
+	for (int i = 1; i + 1 < polygonSize; ++i)
+		BinTriangle(screen[0], screen[i], screen[i + 1], view);
+}
+
+void lpglSoftwareBackend::BinTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, int view)
+{
+	// With y pointing down, front faces (clockwise) have a positive area.
+	const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+
+	if (area <= 0.0f) {
+		m_counters.culledTriangleCount++;
+		return;
+	}
+
+	Triangle triangle;
+	triangle.v[0] = a;
+	triangle.v[1] = b;
+	triangle.v[2] = c;
+	triangle.view = view;
+
+	// Pixels whose centers can be covered.
+	triangle.minX = std::max(0, static_cast<int>(std::ceil(std::min({ a.x, b.x, c.x }) - 0.5f)));
+	triangle.minY = std::max(0, static_cast<int>(std::ceil(std::min({ a.y, b.y, c.y }) - 0.5f)));
+	triangle.maxX = std::min(m_width - 1, static_cast<int>(std::floor(std::max({ a.x, b.x, c.x }) - 0.5f)));
+	triangle.maxY = std::min(m_height - 1, static_cast<int>(std::floor(std::max({ a.y, b.y, c.y }) - 0.5f)));
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	const uint32_t index = static_cast<uint32_t>(m_triangles.size());
+	m_triangles.push_back(triangle);
+	m_counters.rasterizedTriangleCount++;
+
+	for (int tileY = triangle.minY / kTileSize; tileY <= triangle.maxY / kTileSize; ++tileY)
+		for (int tileX = triangle.minX / kTileSize; tileX <= triangle.maxX / kTileSize; ++tileX)
+			m_bins[view][tileY * m_tilesX + tileX].push_back(index);
+}
+
+void lpglSoftwareBackend::RasterizeTiles()
+{
+	if (m_triangles.empty())
+		return;
+
+	const int tileCount = m_tilesX * m_tilesY;
+	const int jobCount = LPGL_VIEW_COUNT * tileCount;
+
+	std::atomic<int> nextJob(0);
+	std::mutex countersMutex;
+
+	auto worker = [&]() {
+		Counters counters;
+
+		for (int job = nextJob++; job < jobCount; job = nextJob++) {
+			const int tile = job % tileCount;
+			RasterizeTile(job / tileCount, tile % m_tilesX, tile / m_tilesX, counters);
+		}
+
+		std::lock_guard<std::mutex> lock(countersMutex);
+		m_counters.pixelsTested += counters.pixelsTested;
+		m_counters.pixelsWritten += counters.pixelsWritten;
+	};
+
+	std::vector<std::thread> threads;
+
+	for (unsigned i = 1; i < m_threadCount; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	// Clearing keeps the capacity for the next Execute.
+	m_triangles.clear();
+
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view)
+		for (std::vector<uint32_t>& bin : m_bins[view])
+			bin.clear();
+}
+
+void lpglSoftwareBackend::RasterizeTile(int view, int tileX, int tileY, Counters& counters)
+{
+	const std::vector<uint32_t>& bin = m_bins[view][tileY * m_tilesX + tileX];
+
+	const int tileMinX = tileX * kTileSize;
+	const int tileMinY = tileY * kTileSize;
+	const int tileMaxX = std::min(tileMinX + kTileSize, m_width) - 1;
+	const int tileMaxY = std::min(tileMinY + kTileSize, m_height) - 1;
+
+	uint32_t* colorTarget = m_color[view].data();
+	float* depthTarget = m_depth[view].data();
+
+	for (uint32_t index : bin) {
+		const Triangle& triangle = m_triangles[index];
+		const ScreenVertex& a = triangle.v[0];
+		const ScreenVertex& b = triangle.v[1];
+		const ScreenVertex& c = triangle.v[2];
+
+		const int minX = std::max(triangle.minX, tileMinX);
+		const int minY = std::max(triangle.minY, tileMinY);
+		const int maxX = std::min(triangle.maxX, tileMaxX);
+		const int maxY = std::min(triangle.maxY, tileMaxY);
+
+		if (minX > maxX || minY > maxY)
+			continue;
+
+		const float invArea = 1.0f / ((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y));
+
+		// Edge functions, each opposite the vertex it weights, stepped per pixel.
+		auto edge = [](const ScreenVertex& from, const ScreenVertex& to, float x, float y) {
+			return (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x);
+		};
+
+		const float startX = minX + 0.5f;
+		const float startY = minY + 0.5f;
+
+		float row0 = edge(b, c, startX, startY);
+		float row1 = edge(c, a, startX, startY);
+		float row2 = edge(a, b, startX, startY);
+
+		const float stepX0 = -(c.y - b.y), stepY0 = c.x - b.x;
+		const float stepX1 = -(a.y - c.y), stepY1 = a.x - c.x;
+		const float stepX2 = -(b.y - a.y), stepY2 = b.x - a.x;
+
+		for (int y = minY; y <= maxY; ++y) {
+			float e0 = row0;
+			float e1 = row1;
+			float e2 = row2;
+
+			for (int x = minX; x <= maxX; ++x) {
+				// Pixels exactly on a shared edge are covered by both triangles;
+				// the depth test keeps the first.
+				if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+					counters.pixelsTested++;
+
+					const float w0 = e0 * invArea;
+					const float w1 = e1 * invArea;
+					const float w2 = e2 * invArea;
+
+					const float z = w0 * a.z + w1 * b.z + w2 * c.z;
+					const size_t pixel = static_cast<size_t>(y) * m_width + x;
+
+					if (z < depthTarget[pixel] && z <= 1.0f) {
+						const float w = 1.0f / (w0 * a.invW + w1 * b.invW + w2 * c.invW);
+
+						auto channel = [&](float va, float vb, float vc) {
+							float value = (w0 * va + w1 * vb + w2 * vc) * w;
+							return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+						};
+
+						colorTarget[pixel] = channel(a.r, b.r, c.r) | (channel(a.g, b.g, c.g) << 8) |
+							(channel(a.b, b.b, c.b) << 16) | 0xFF000000u;
+						depthTarget[pixel] = z;
+
+						counters.pixelsWritten++;
+					}
+				}
+
+				e0 += stepX0;
+				e1 += stepX1;
+				e2 += stepX2;
+			}
+
+			row0 += stepY0;
+			row1 += stepY1;
+			row2 += stepY2;
+		}
+	}
+}
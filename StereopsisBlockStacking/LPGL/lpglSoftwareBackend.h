@@ -0,0 +1,110 @@
+#pragma once
+
+#include "lpglBackend.h"
+#include "lpglSlotMap.h"
+
+#include <cstdint>
+#include <mutex>
+
+// Backend that renders on the CPU, for running and profiling the rendering
+// paths without a device. It applies the stereo vertex shader's transform,
+// position * instance transform * model * viewProjection[instance % 2], and
+// writes one color and one depth target per view, cleared to 1 and compared
+// LESS, with back faces (counter-clockwise on screen) culled as on the device.
+//
+// Each draw is transformed and clipped as it is replayed, and its triangles
+// are binned into screen tiles. At the end of Execute the tiles are rasterized
+// in parallel; a tile is only ever touched by one thread and processes its
+// triangles in submission order, so the output does not depend on timing.
+class lpglSoftwareBackend : public lpglBackend {
+public:
+	struct Counters {
+		// Triangles drawn, and of those the ones crossing the near plane. Culled
+		// and rasterized count what clipping left, so may add up to more.
+		unsigned long long triangleCount = 0;
+		unsigned long long culledTriangleCount = 0;
+		unsigned long long clippedTriangleCount = 0;
+		unsigned long long rasterizedTriangleCount = 0;
+
+		// Fill cost: pixels inside a triangle, and those that passed the depth test.
+		unsigned long long pixelsTested = 0;
+		unsigned long long pixelsWritten = 0;
+	};
+
+	static const int kTileSize = 64;
+
+	// threadCount 0 uses every hardware thread.
+	lpglSoftwareBackend(int width, int height, unsigned threadCount = 0);
+
+	void BufferData(GLuint buffer, GLenum target, GLsizei size, const GLvoid* data, GLenum usage) override;
+
+	void DeleteBuffer(GLuint buffer) override;
+
+	void Execute(const lpglCommandBuffer& commandBuffer) override;
+
+	// Matrix of one view in the matrix stack's layout, like CameraResources::GetViewProjection.
+	void SetViewProjection(int view, const DirectX::XMFLOAT4X4& viewProjection);
+
+	// Color is RGBA8 with red in the lowest byte.
+	void Clear(uint32_t color = 0, float depth = 1.0f);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+	const uint32_t* GetColor(int view) const { return m_color[view].data(); }
+	const float* GetDepth(int view) const { return m_depth[view].data(); }
+
+	const Counters& GetCounters() const { return m_counters; }
+	void ResetCounters() { m_counters = Counters(); }
+
+private:
+	// Post-viewport vertex: x and y in pixels, z in [0, 1], and the attributes
+	// divided by w for perspective-correct interpolation.
+	struct ScreenVertex {
+		float x, y, z;
+		float invW;
+		float r, g, b;
+	};
+
+	struct Triangle {
+		ScreenVertex v[3];
+		int minX, minY, maxX, maxY;
+		int view;
+	};
+
+	void DrawElementsInstanced(const lpglDrawElementsCommand& command, const lpglCommandBuffer& commandBuffer);
+
+	// Clips a clip-space triangle against the near plane and bins what is left.
+	void SetupTriangle(const DirectX::XMFLOAT4* clip, const DirectX::XMFLOAT3* color, int view);
+	void BinTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, int view);
+
+	void RasterizeTiles();
+	void RasterizeTile(int view, int tileX, int tileY, Counters& counters);
+
+	int m_width;
+	int m_height;
+	int m_tilesX;
+	int m_tilesY;
+	unsigned m_threadCount;
+
+	DirectX::XMFLOAT4X4 m_viewProjection[LPGL_VIEW_COUNT];
+
+	std::vector<uint32_t> m_color[LPGL_VIEW_COUNT];
+	std::vector<float> m_depth[LPGL_VIEW_COUNT];
+
+	// Triangles of the current Execute, and per view and tile the indices of
+	// those overlapping it.
+	std::vector<Triangle> m_triangles;
+	std::vector<std::vector<uint32_t>> m_bins[LPGL_VIEW_COUNT];
+
+	// Decoded vertices of the draw, and their transform for the instance being drawn.
+	std::vector<DirectX::XMFLOAT3> m_positions;
+	std::vector<DirectX::XMFLOAT3> m_colors;
+	std::vector<DirectX::XMFLOAT4> m_clipPositions;
+
+	Counters m_counters;
+
+	// Buffers are created from loader threads while the render thread executes.
+	std::mutex m_buffersMutex;
+	lpglSlotArray<std::vector<unsigned char>> m_buffers;
+};
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "lpglStatistics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+	// Written from any thread. Zero-initialized before any dynamic
+	// initialization, so counting from static constructors is safe.
+	std::atomic<unsigned long long> gCurrentCounters[LPGL_COUNTER_COUNT];
+	std::atomic<unsigned long long> gCurrentCalls[LPGL_TIMER_COUNT];
+	std::atomic<unsigned long long> gCurrentNanoseconds[LPGL_TIMER_COUNT];
+
+	// Only touched by the thread that calls lpglEndFrame.
+	lpglStatistics gLastFrame;
+	lpglStatistics gCumulative[LPGL_STATISTICS_MAX_TIERS];
+	bool gPerFrameDump = false;
+
+	const char* gCounterNames[LPGL_COUNTER_COUNT] = {
+		"draws", "merged draws", "culled draws", "passed draws", "instances", "triangles", "state changes",
+		"redundant state changes", "constant buffer updates", "buffer creations", "bytes uploaded"
+	};
+
+	const char* gTimerNames[LPGL_TIMER_COUNT] = { "draw", "buffer", "flush" };
+
+	void Output(const std::string& text)
+	{
+#ifdef _WIN32
+		OutputDebugStringA(text.c_str());
+#else
+		fputs(text.c_str(), stderr);
+#endif
+	}
+}
+
+void lpglCount(lpglCounter counter, unsigned long long amount)
+{
+	gCurrentCounters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+lpglTimerScope::lpglTimerScope(lpglTimer timer) :
+	m_timer(timer),
+	m_start(std::chrono::steady_clock::now())
+{
+}
+
+lpglTimerScope::~lpglTimerScope()
+{
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+
+	gCurrentCalls[m_timer].fetch_add(1, std::memory_order_relaxed);
+	gCurrentNanoseconds[m_timer].fetch_add(elapsed.count(), std::memory_order_relaxed);
+}
+
+void lpglEndFrame(int tier)
+{
+	tier = std::min(std::max(tier, 0), LPGL_STATISTICS_MAX_TIERS - 1);
+
+	lpglStatistics& cumulative = gCumulative[tier];
+
+	gLastFrame.frameCount = 1;
+	cumulative.frameCount++;
+
+	for (int i = 0; i < LPGL_COUNTER_COUNT; ++i) {
+		gLastFrame.counters[i] = gCurrentCounters[i].exchange(0, std::memory_order_relaxed);
+		cumulative.counters[i] += gLastFrame.counters[i];
+	}
+
+	for (int i = 0; i < LPGL_TIMER_COUNT; ++i) {
+		gLastFrame.calls[i] = gCurrentCalls[i].exchange(0, std::memory_order_relaxed);
+		gLastFrame.seconds[i] = gCurrentNanoseconds[i].exchange(0, std::memory_order_relaxed) * 1e-9;
+		cumulative.calls[i] += gLastFrame.calls[i];
+		cumulative.seconds[i] += gLastFrame.seconds[i];
+	}
+
+	if (gPerFrameDump) {
+		std::ostringstream s;
+		s << "LPGL frame, tier " << tier << ": " << lpglFormatStatistics(gLastFrame);
+		Output(s.str());
+	}
+}
+
+const lpglStatistics& lpglGetFrameStatistics()
+{
+	return gLastFrame;
+}
+
+const lpglStatistics& lpglGetCumulativeStatistics(int tier)
+{
+	return gCumulative[std::min(std::max(tier, 0), LPGL_STATISTICS_MAX_TIERS - 1)];
+}
+
+void lpglSetPerFrameDump(bool enable)
+{
+	gPerFrameDump = enable;
+}
+
+std::string lpglFormatStatistics(const lpglStatistics& statistics)
+{
+	std::ostringstream s;
+
+	// Several frames are shown as per-frame averages.
+	const double frames = statistics.frameCount > 0 ? static_cast<double>(statistics.frameCount) : 1.0;
+
+	for (int i = 0; i < LPGL_COUNTER_COUNT; ++i)
+		s << (i ? ", " : "") << statistics.counters[i] / frames << " " << gCounterNames[i];
+
+	s << "\n ";
+
+	for (int i = 0; i < LPGL_TIMER_COUNT; ++i)
+		s << " " << gTimerNames[i] << " " << statistics.seconds[i] * 1000.0 / frames << " ms ("
+			<< statistics.calls[i] / frames << " calls)";
+
+	s << "\n";
+
+	return s.str();
+}
+
+void lpglDumpStatistics()
+{
+	std::ostringstream s;
+
+	for (int tier = 0; tier < LPGL_STATISTICS_MAX_TIERS; ++tier) {
+		if (gCumulative[tier].frameCount == 0)
+			continue;
+
+		s << "LPGL per frame over " << gCumulative[tier].frameCount << " frames in tier " << tier << ": "
+			<< lpglFormatStatistics(gCumulative[tier]);
+	}
+
+	Output(s.str());
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "lpgl.h"
+
+#include <DirectXMath.h>
+
+#include <cstdint>
+
+// Sizes of the vertex attributes glVertexFormat accepts, 0 for other types.
+GLsizei lpglPositionSize(GLenum positionType);
+GLsizei lpglColorSize(GLenum colorType);
+
+inline GLsizei lpglVertexStride(GLenum positionType, GLenum colorType)
+{
+	return lpglPositionSize(positionType) + lpglColorSize(colorType);
+}
+
+uint16_t lpglFloatToHalf(float value);
+float lpglHalfToFloat(uint16_t value);
+
+// Decodes one vertex as the device would. Normalized positions come back in
+// [0, 1]; their bounds are applied by the instance transforms.
+DirectX::XMFLOAT3 lpglReadPosition(GLenum positionType, const unsigned char* vertex);
+DirectX::XMFLOAT3 lpglReadColor(GLenum positionType, GLenum colorType, GLuint color, const unsigned char* vertex);
+
+// Vertex layout of one mesh, from lpglChooseVertexLayout.
+struct lpglVertexLayout {
+	GLenum positionType = GL_FLOAT;
+	GLenum colorType = GL_FLOAT;
+
+	// Box normalized positions are quantized in.
+	DirectX::XMFLOAT3 boundsMin = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	DirectX::XMFLOAT3 boundsMax = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+	// Color of every vertex when colorType is GL_NONE.
+	DirectX::XMFLOAT3 color = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+	GLsizei Stride() const { return lpglVertexStride(positionType, colorType); }
+
+	// Makes the layout current for the following draws.
+	void Bind() const;
+
+	// Encodes vertex i of a buffer in this layout.
+	void Write(void* vertices, size_t i, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& color) const;
+};
+
+// Picks the smallest layout that stores positions within [boundsMin, boundsMax]
+// to within tolerance: half floats when they are precise enough over the whole
+// box, else 16-bit positions normalized to it, else floats. A mesh drawn in a
+// single color gets no color attribute.
+lpglVertexLayout lpglChooseVertexLayout(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax,
+	float tolerance, bool singleColor, const DirectX::XMFLOAT3& color = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f));
@@ -10,8 +10,8 @@
 
 #include <vector>
 #include <string>
-#include <sstream>
 
+#include "Common\AllocationTracker.h"
 #include "Common\FramerateController.h"
 
 using namespace StereopsisBlockStacking;
@@ -138,82 +138,61 @@ struct QuadTree
 
     Node* rootNode = nullptr;
 
-    static QuadTree* Create(const std::vector<const BoundingBox2D*>& geometries, const int kMaxDepth);
-
-    ~QuadTree()
-    {
-        DeleteSubtree(rootNode);
-
-        if (rootNode) {
-            delete rootNode;
-            rootNode = nullptr;
-        }
-    }
+    // The tree and its nodes are allocated from the given frame arena and are
+    // released when it is reset.
+    static QuadTree* Create(FrameArena& arena, const FrameVector<const BoundingBox2D*>& geometries, const int kMaxDepth);
+};
 
-    void DeleteSubtree(Node* node)
-    {
-        if (!node)
-            return;
+static void AddQuadTreeDepth(FrameArena& arena, const BoundingBox2D& area, const FrameVector<const BoundingBox2D*>& geometries,
+    int depth, const int kMaxDepth, QuadTree::Node* parent)
+{
+    auto& Min = area.Min;
+    auto& Max = area.Max;
+    float halfWidth = area.Width() * 0.5f;
+    float halfHeight = area.Height() * 0.5f;
+    const BoundingBox2D subareas[4] = {
+        BoundingBox2D(XMFLOAT2(Min.x, Min.y), XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight)),
+        BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y), XMFLOAT2(Max.x, Min.y + halfHeight)),
+        BoundingBox2D(XMFLOAT2(Min.x, Min.y + halfHeight), XMFLOAT2(Min.x + halfWidth, Max.y)),
+        BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight), XMFLOAT2(Max.x, Max.y))
+    };
 
-        for (auto* child : node->children) {
-            DeleteSubtree(child);
+    for (int i = 0; i < 4; ++i) {
+        auto& subarea = subareas[i];
+
+        for (auto* geometry : geometries) {
+            if (subarea.Intersect(*geometry)) {
+                QuadTree::Node* pNode = arena.Create<QuadTree::Node>();
+                parent->children[i] = pNode;
+                pNode->parent = parent;
+                pNode->isFull = false;
+                pNode->depth = depth;
+
+                if (depth + 1 < kMaxDepth) {
+                    AddQuadTreeDepth(arena, subarea, geometries, depth + 1, kMaxDepth, pNode);
+                }
 
-            if (child) {
-                delete child;
-                child = nullptr;
+                break;
             }
         }
     }
-};
 
-QuadTree* QuadTree::Create(const std::vector<const BoundingBox2D*>& geometries, const int kMaxDepth)
-{
-    QuadTree* res = new QuadTree();
-
-    std::function<void(const BoundingBox2D&, const std::vector<const BoundingBox2D*>&, int, QuadTree::Node*)> addDepth
-        = [&](const BoundingBox2D& area, const std::vector<const BoundingBox2D*>& geometries, int depth, QuadTree::Node* parent) {
-        auto& Min = area.Min;
-        auto& Max = area.Max;
-        float halfWidth = area.Width() * 0.5f;
-        float halfHeight = area.Height() * 0.5f;
-        std::vector<BoundingBox2D> subareas;
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x, Min.y), XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y), XMFLOAT2(Max.x, Min.y + halfHeight)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x, Min.y + halfHeight), XMFLOAT2(Min.x + halfWidth, Max.y)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight), XMFLOAT2(Max.x, Max.y)));
-
-        for (int i = 0; i < subareas.size(); ++i) {
-            auto& subarea = subareas[i];
-
-            for (auto* geometry : geometries) {
-                if (subarea.Intersect(*geometry)) {
-                    QuadTree::Node* pNode = new QuadTree::Node();
-                    parent->children[i] = pNode;
-                    pNode->parent = parent;
-                    pNode->isFull = false;
-                    pNode->depth = depth;
-
-                    if (depth + 1 < kMaxDepth) {
-                        addDepth(subarea, geometries, depth + 1, pNode);
-                    }
-
-                    break;
-                }
-            }
-        }
+    parent->isFull = parent->children[0] && parent->children[1] && parent->children[2] && parent->children[3];
+}
 
-        parent->isFull = parent->children[0] && parent->children[1] && parent->children[2] && parent->children[3];
-    };
+QuadTree* QuadTree::Create(FrameArena& arena, const FrameVector<const BoundingBox2D*>& geometries, const int kMaxDepth)
+{
+    QuadTree* res = arena.Create<QuadTree>();
 
     BoundingBox2D viewArea(XMFLOAT2(-1, -1), XMFLOAT2(1, 1));
-    QuadTree::Node* pRootNode = new QuadTree::Node();
+    QuadTree::Node* pRootNode = arena.Create<QuadTree::Node>();
     pRootNode->parent = nullptr;
     pRootNode->isFull = true;
     pRootNode->depth = 0;
 
     res->rootNode = pRootNode;
 
-    addDepth(viewArea, geometries, 1, res->rootNode);
+    AddQuadTreeDepth(arena, viewArea, geometries, 1, kMaxDepth, res->rootNode);
 
     return res;
 }
@@ -253,10 +232,17 @@ StereopsisBlockStackingMain::StereopsisBlockStackingMain(const std::shared_ptr<D
 {
     // Register to be notified if the device is lost or recreated.
     m_deviceResources->RegisterDeviceNotify(this);
+
+    // Simulate at a fixed rate, whatever rate the FramerateController picks for rendering.
+    m_timer.SetFixedTimeStep(true);
+    m_timer.SetTargetElapsedSeconds(1.0 / 60.0);
+    m_timer.SetMaxStepsPerTick(kMaxSimulationStepsPerFrame);
 }
 
 void StereopsisBlockStackingMain::SetHolographicSpace(HolographicSpace^ holographicSpace)
 {
+    AllocationPhaseScope loadPhase(eAPLoad);
+
     UnregisterHolographicEventHandlers();
 
     m_holographicSpace = holographicSpace;
@@ -338,196 +324,216 @@ HolographicFrame^ StereopsisBlockStackingMain::Update()
 
     SpatialInteractionSourceState^ pointerState = m_spatialInputHandler->CheckForInput();
 
-	m_timer.Tick([&]()
+	// Update-loop temporaries come from a frame arena. The two arenas alternate so
+	// the previous frame's quadtree stays valid while it is compared against.
+	m_frameArenaIndex ^= 1;
+	FrameArena& frameArena = m_frameArenas[m_frameArenaIndex];
+
+	if (lastQuadTree && frameArena.Owns(lastQuadTree))
+		lastQuadTree = nullptr;
+
+	frameArena.Reset();
+
+	holographicFrame->UpdateCurrentPrediction();
+	prediction = holographicFrame->CurrentPrediction;
+
+	auto headPosition = float3();
+	auto headDirection = float3();
+	auto timestamp = prediction->Timestamp->TargetTime.UniversalTime;
+	int numCameraPoses = prediction->CameraPoses->Size;
+
+	for (auto cameraPose : prediction->CameraPoses) {
+		auto coordinateSystem = m_referenceFrame->CoordinateSystem;
+		SpatialPointerPose^ pose = SpatialPointerPose::TryGetAtTimestamp(coordinateSystem, prediction->Timestamp);
+
+		auto headPositionInternal = pose->Head->Position;
+		auto headDirectionInternal = pose->Head->ForwardDirection;
+
+		headPosition += headPositionInternal;
+		headDirection += headDirectionInternal;
+	}
+
+	headPosition /= numCameraPoses;
+	headDirection /= numCameraPoses;
+
+	// Input is read once per frame, so a press or release grabs or drops a block
+	// once however many fixed steps the frame runs. Only moving the held block
+	// is left to the steps.
+	const eSpatialInputState inputState = pointerState != nullptr ? m_spatialInputHandler->m_spatialInputState : eSISNone;
+
+	auto grabGazedBlock = [&]()
 	{
-		holographicFrame->UpdateCurrentPrediction();
-		HolographicFramePrediction^ prediction = holographicFrame->CurrentPrediction;
+		for (int i = 0; i < m_cubeRenderers.size(); ++i) {
+			DirectX::BoundingBox bb = m_cubeRenderers[i]->GetBoundingBox();
 
-		auto headPosition = float3();
-		auto headDirection = float3();
-		auto timestamp = prediction->Timestamp->TargetTime.UniversalTime;
-		int numCameraPoses = prediction->CameraPoses->Size;
+			float distance = 0.0f;
 
-		for (auto cameraPose : prediction->CameraPoses) {
-			auto coordinateSystem = m_referenceFrame->CoordinateSystem;
-			SpatialPointerPose^ pose = SpatialPointerPose::TryGetAtTimestamp(coordinateSystem, prediction->Timestamp);
+			if (bb.Intersects(
+				DirectX::XMLoadFloat3(&headPosition),
+				DirectX::XMLoadFloat3(&headDirection),
+				distance)) {
+				m_cubeRenderers[i]->isGrabbed = true;
 
-			auto headPositionInternal = pose->Head->Position;
-			auto headDirectionInternal = pose->Head->ForwardDirection;
+				m_pickedObject = m_cubeRenderers[i].get();
 
-			headPosition += headPositionInternal;
-			headDirection += headDirectionInternal;
+				break;
+			}
 		}
+	};
 
-		headPosition /= numCameraPoses;
-		headDirection /= numCameraPoses;
+	switch (inputState) {
+	case eSISPressed:
+		grabGazedBlock();
+		break;
+	case eSISMoved:
+		if (!m_pickedObject)
+			grabGazedBlock();
+		break;
+	case eSISReleased:
+		m_pickedObject = nullptr;
+		break;
+	case eSISNone:
+		break;
+	}
 
+	// The simulation advances in fixed steps, independent of the rate the
+	// FramerateController renders at.
+	m_timer.Tick([&]()
+	{
 		if (m_aimingCube->IsVisible()) {
 			m_aimingCube->SetPosition(headPosition + headDirection);
 
-			std::ostringstream s;
+			// Formatted on the stack so the update path stays off the heap.
+			char line[512];
             // timestamp, headposition, headdirection, mesh0, mesh1, mesh2, mesh3, mesh4
-			s << timestamp << ',';
-            s << headPosition.x << ',' << headPosition.y << ',' << headPosition.z << ',';
-			s << headDirection.x << ',' << headDirection.y << ',' << headDirection.z;
+			int length = sprintf_s(line, "%lld,%g,%g,%g,%g,%g,%g", timestamp,
+				headPosition.x, headPosition.y, headPosition.z,
+				headDirection.x, headDirection.y, headDirection.z);
 
 			for (int i = 0; i < m_cubeRenderers.size(); ++i) {
 				const auto v = m_cubeRenderers[i]->GetPosition();
-				s << ',' << v.x << ',' << v.y << ',' << v.z;
+				length += sprintf_s(line + length, sizeof(line) - length, ",%g,%g,%g", v.x, v.y, v.z);
 			}
 
-            s << '\n';
+			sprintf_s(line + length, sizeof(line) - length, "\n");
 
-			OutputDebugStringA(s.str().c_str());
+			OutputDebugStringA(line);
 		}
 
-		for (auto cameraPose : prediction->CameraPoses)
-		{
-			auto coordinateSystem = m_referenceFrame->CoordinateSystem;
-
-			if (pointerState != nullptr) {
-				switch (m_spatialInputHandler->m_spatialInputState) {
-				case eSISPressed:
-					for (int i = 0; i < m_cubeRenderers.size(); ++i) {
-						DirectX::BoundingBox bb = m_cubeRenderers[i]->GetBoundingBox();
-
-						float distance = 0.0f;
-
-						if (bb.Intersects(
-							DirectX::XMLoadFloat3(&headPosition),
-							DirectX::XMLoadFloat3(&headDirection),
-							distance)) {
-							m_cubeRenderers[i]->isGrabbed = true;
-
-							m_pickedObject = m_cubeRenderers[i].get();
-
-							break;
-						}
-					}
-					break;
-				case eSISMoved:
-				{
-					if (m_pickedObject) {
-						DirectX::BoundingBox bb = m_pickedObject->GetBoundingBox();
-
-						float distance = 0.0f;
-
-						if (bb.Intersects(
-							DirectX::XMLoadFloat3(&headPosition),
-							DirectX::XMLoadFloat3(&headDirection),
-							distance)) {
-							auto diff = m_pickedObject->GetPosition() - headPosition;
-							float distance = 0.0f;
-
-							DirectX::XMStoreFloat(&distance, DirectX::XMVector3Length(DirectX::XMLoadFloat3(&diff)));
-
-							m_pickedObject->SetPosition(headPosition + headDirection * distance);
-						}
-						else {
-							m_pickedObject = nullptr;
-						}
-					}
-					else {
-						for (int i = 0; i < m_cubeRenderers.size(); ++i) {
-							DirectX::BoundingBox bb = m_cubeRenderers[i]->GetBoundingBox();
-
-							float distance = 0.0f;
-
-							if (bb.Intersects(
-								DirectX::XMLoadFloat3(&headPosition),
-								DirectX::XMLoadFloat3(&headDirection),
-								distance)) {
-								m_cubeRenderers[i]->isGrabbed = true;
-
-								m_pickedObject = m_cubeRenderers[i].get();
-
-								break;
-							}
-						}
-					}
-					break;
-				}
-				case eSISReleased:
-					m_pickedObject = nullptr;
-					break;
-				}
-			}
+		// The held block follows the gaze at its distance from the head, and is
+		// dropped once the gaze leaves it.
+		if (inputState == eSISMoved && m_pickedObject) {
+			DirectX::BoundingBox bb = m_pickedObject->GetBoundingBox();
 
-			Platform::IBox<HolographicStereoTransform>^ viewTransformContainer = cameraPose->TryGetViewTransform(coordinateSystem);
-			HolographicStereoTransform viewCoordinateSystemTransform = viewTransformContainer->Value;
-			auto viewMatrix = DirectX::XMLoadFloat4x4(&viewCoordinateSystemTransform.Left);
+			float distance = 0.0f;
 
-			HolographicStereoTransform cameraProjectionTransform = cameraPose->ProjectionTransform;
-			auto projectionMatrix = DirectX::XMLoadFloat4x4(&cameraProjectionTransform.Left);
+			if (bb.Intersects(
+				DirectX::XMLoadFloat3(&headPosition),
+				DirectX::XMLoadFloat3(&headDirection),
+				distance)) {
+				auto diff = m_pickedObject->GetPosition() - headPosition;
+				float distance = 0.0f;
 
-			auto VP = XMMatrixMultiply(viewMatrix, projectionMatrix);
+				DirectX::XMStoreFloat(&distance, DirectX::XMVector3Length(DirectX::XMLoadFloat3(&diff)));
 
-			for (int i = 0; i < m_cubeRenderers.size(); ++i) {
-				m_cubeRenderers[i]->Update(m_timer);
+				m_pickedObject->SetPosition(headPosition + headDirection * distance);
 			}
+			else {
+				m_pickedObject = nullptr;
+			}
+		}
 
-			m_aimingCube->Update(m_timer);
+		for (int i = 0; i < m_cubeRenderers.size(); ++i) {
+			m_cubeRenderers[i]->Update(m_timer);
+		}
 
-			std::vector<const BoundingBox2D*> bbs;
+		m_aimingCube->Update(m_timer);
+	});
 
-			for (int i = 0; i < m_cubeRenderers.size(); ++i) {
-				BoundingBox bb = m_cubeRenderers[i]->GetBoundingBox();
-				XMFLOAT3 corners[8];
-				auto boundingBox2D = new BoundingBox2D();
+	for (auto cameraPose : prediction->CameraPoses)
+	{
+		AllocationPhaseScope scorePhase(eAPScore);
 
-				bb.GetCorners(corners);
+		auto coordinateSystem = m_referenceFrame->CoordinateSystem;
 
-				for (int vi = 0; vi < 8; ++vi) {
-					XMFLOAT4 result;
-					XMStoreFloat4(&result,
-						XMVector3TransformCoord(XMLoadFloat3(&corners[i]), VP));
-					boundingBox2D->AddPoint(result.x, result.y);
-				}
-				bbs.push_back(boundingBox2D);
+		Platform::IBox<HolographicStereoTransform>^ viewTransformContainer = cameraPose->TryGetViewTransform(coordinateSystem);
+		HolographicStereoTransform viewCoordinateSystemTransform = viewTransformContainer->Value;
+		auto viewMatrix = DirectX::XMLoadFloat4x4(&viewCoordinateSystemTransform.Left);
+
+		HolographicStereoTransform cameraProjectionTransform = cameraPose->ProjectionTransform;
+		auto projectionMatrix = DirectX::XMLoadFloat4x4(&cameraProjectionTransform.Left);
+
+		auto VP = XMMatrixMultiply(viewMatrix, projectionMatrix);
+
+		FrameVector<const BoundingBox2D*> bbs(frameArena);
+		bbs.reserve(m_cubeRenderers.size());
+
+		for (int i = 0; i < m_cubeRenderers.size(); ++i) {
+			BoundingBox bb = m_cubeRenderers[i]->GetBoundingBox();
+			XMFLOAT3 corners[8];
+			auto boundingBox2D = frameArena.Create<BoundingBox2D>();
+
+			bb.GetCorners(corners);
+
+			for (int vi = 0; vi < 8; ++vi) {
+				XMFLOAT4 result;
+				XMStoreFloat4(&result,
+					XMVector3TransformCoord(XMLoadFloat3(&corners[i]), VP));
+				boundingBox2D->AddPoint(result.x, result.y);
 			}
+			bbs.push_back(boundingBox2D);
+		}
 
-			auto* quadTree = QuadTree::Create(bbs, 16);
+		auto* quadTree = QuadTree::Create(frameArena, bbs, 16);
 
-			if (lastQuadTree) {
-				float dynamicScore = GetDynamicScoreBasedOnQuadtree(lastQuadTree->rootNode, quadTree->rootNode);
+		if (lastQuadTree) {
+			float dynamicScore = GetDynamicScoreBasedOnQuadtree(lastQuadTree->rootNode, quadTree->rootNode);
 
-				auto* framerateController = FramerateController::get();
+			auto* framerateController = FramerateController::get();
 
-				if (framerateController->GetFPS() > 60 - 1) {
-					if (dynamicScore < threshold.level1) {
-						framerateController->SetFramerate(30);
-					}
+			if (framerateController->GetFPS() > 60 - 1) {
+				if (dynamicScore < threshold.level1) {
+					framerateController->RequestFramerate(30);
 				}
-				else if (framerateController->GetFPS() > 30 - 1) {
-					if (dynamicScore > threshold.level1) {
-						framerateController->SetFramerate(60);
-					}
-					else if (dynamicScore < threshold.level2) {
-						framerateController->SetFramerate(15);
-					}
-				}
-				else if (framerateController->GetFPS() > 15 - 1) {
-					if (dynamicScore > threshold.level2) {
-						framerateController->SetFramerate(30);
-					}
+			}
+			else if (framerateController->GetFPS() > 30 - 1) {
+				if (dynamicScore > threshold.level1) {
+					framerateController->RequestFramerate(60);
 				}
-
-				if (lastQuadTree) {
-					delete lastQuadTree;
-					lastQuadTree = nullptr;
+				else if (dynamicScore < threshold.level2) {
+					framerateController->RequestFramerate(15);
 				}
 			}
-
-			for (int i = 0; i < bbs.size(); ++i) {
-				if (bbs[i]) {
-					delete bbs[i];
-					bbs[i] = nullptr;
+			else if (framerateController->GetFPS() > 15 - 1) {
+				if (dynamicScore > threshold.level2) {
+					framerateController->RequestFramerate(30);
 				}
 			}
+		}
 
-			lastQuadTree = quadTree;
+		lastQuadTree = quadTree;
+	}
+
+#ifdef _DEBUG
+	// Once warmed up, Update should not reach the global heap at all. The tracker
+	// closes frames after Render, so it reports the previous Update; without
+	// TRACK_ALLOCATIONS only the frame arena's own growth is visible.
+	if (m_timer.GetFrameCount() > kFrameArenaWarmupSteps) {
+		const unsigned long long allocations = AllocationTracker::IsEnabled()
+			? AllocationTracker::GetLastFrameCounters(eAPUpdate).allocations + AllocationTracker::GetLastFrameCounters(eAPScore).allocations
+			: frameArena.GetHeapAllocationsThisFrame();
+
+		if (allocations != 0) {
+			m_steadyStateHeapAllocations += allocations;
+
+			// Formatted on the stack, so the report does not count against the next frame.
+			char message[128];
+			sprintf_s(message, "Update: %llu heap allocations after warm-up, %llu in total.\n",
+				allocations, m_steadyStateHeapAllocations);
+			OutputDebugStringA(message);
 		}
-	});
+	}
+#endif
 
 	return holographicFrame;
 }
@@ -564,10 +570,20 @@ bool StereopsisBlockStackingMain::Render(Windows::Graphics::Holographic::Hologra
 
 			if (cameraActive)
 			{
+				float interpolation = static_cast<float>(m_timer.GetInterpolationFactor());
+
+				// Draws are sorted front to back from the left eye at glFlush.
+				lpglSetViewProjection(&pCameraResources->GetViewProjection(0).m[0][0]);
+
+				// Draws no eye sees are dropped there too; both eyes' matrices are adjacent.
+				lpglSetCullingViewProjections(&pCameraResources->GetViewProjection(0).m[0][0]);
+
 				if (m_aimingCube->IsVisible())
-					m_aimingCube->Render();
-				for (int i = 0; i < m_cubeRenderers.size(); ++i)
-					m_cubeRenderers[i]->Render();
+					m_aimingCube->Render(interpolation);
+				SpinningCubeRenderer::RenderBatch(m_cubeRenderers, interpolation);
+
+				// Submit this camera's draws while its render target is bound.
+				glFlush();
 			}
 			atLeastOneCameraRendered = true;
 		}
@@ -4,6 +4,7 @@
 
 #include "Common\DeviceResources.h"
 #include "Common\StepTimer.h"
+#include "Common\FrameArena.h"
 
 #include "Content\SpinningCubeRenderer.h"
 #include "Content\SpatialInputHandler.h"
@@ -68,9 +69,23 @@ namespace StereopsisBlockStacking
         // Cached pointer to device resources.
         std::shared_ptr<DX::DeviceResources>                            m_deviceResources;
 
-        // Render loop timer.
+        // Fixed-rate simulation timer.
         DX::StepTimer                                                   m_timer;
 
+        // Catch-up limit for the simulation after a long frame.
+        static const uint32 kMaxSimulationStepsPerFrame = 5;
+
+        // Double-buffered arenas for per-frame temporaries in Update.
+        FrameArena                                                      m_frameArenas[2];
+        int                                                             m_frameArenaIndex = 0;
+
+#ifdef _DEBUG
+        static const uint32 kFrameArenaWarmupSteps = 60;
+
+        // Heap allocations made by Update after warm-up. Should stay zero.
+        unsigned long long                                              m_steadyStateHeapAllocations = 0;
+#endif
+
         // Represents the holographic space around the user.
         Windows::Graphics::Holographic::HolographicSpace^               m_holographicSpace;
 
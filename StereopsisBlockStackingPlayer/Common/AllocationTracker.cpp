@@ -0,0 +1,235 @@
+#include "pch.h"
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+namespace
+{
+    // Written from any thread by the allocation hooks.
+    struct AtomicCounters
+    {
+        std::atomic<unsigned long long> allocations;
+        std::atomic<unsigned long long> bytes;
+        std::atomic<unsigned long long> frees;
+    };
+
+    // Zero-initialized before any dynamic initialization, so allocations made
+    // by other static constructors are counted safely.
+    AtomicCounters currentFrame[eAPCount];
+
+    // Only touched by the thread that calls EndFrame.
+    AllocationTracker::Counters lastFrame[eAPCount];
+    AllocationTracker::Counters cumulative[eAPCount];
+    unsigned long long frameCount = 0;
+    bool perFrameReport = false;
+
+    thread_local eAllocationPhase currentPhase = eAPOther;
+
+    void Output(const std::string& text)
+    {
+#ifdef _WIN32
+        OutputDebugStringA(text.c_str());
+#else
+        fputs(text.c_str(), stderr);
+#endif
+    }
+
+    void AppendCounters(std::ostringstream& s, const AllocationTracker::Counters* counters)
+    {
+        for (int phase = 0; phase < eAPCount; ++phase) {
+            const AllocationTracker::Counters& c = counters[phase];
+
+            s << "  " << AllocationTracker::GetPhaseName(static_cast<eAllocationPhase>(phase))
+                << ": " << c.allocations << " allocations, " << c.bytes << " bytes, "
+                << c.frees << " frees\n";
+        }
+    }
+}
+
+bool AllocationTracker::IsEnabled()
+{
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+eAllocationPhase AllocationTracker::SetPhase(eAllocationPhase phase)
+{
+    eAllocationPhase previous = currentPhase;
+    currentPhase = phase;
+
+    return previous;
+}
+
+eAllocationPhase AllocationTracker::GetPhase()
+{
+    return currentPhase;
+}
+
+void AllocationTracker::RecordAllocation(size_t bytes)
+{
+    AtomicCounters& c = currentFrame[currentPhase];
+
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void AllocationTracker::RecordFree()
+{
+    currentFrame[currentPhase].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationTracker::EndFrame()
+{
+    bool allocated = false;
+
+    for (int phase = 0; phase < eAPCount; ++phase) {
+        AtomicCounters& c = currentFrame[phase];
+        Counters& last = lastFrame[phase];
+
+        last.allocations = c.allocations.exchange(0, std::memory_order_relaxed);
+        last.bytes = c.bytes.exchange(0, std::memory_order_relaxed);
+        last.frees = c.frees.exchange(0, std::memory_order_relaxed);
+
+        cumulative[phase].allocations += last.allocations;
+        cumulative[phase].bytes += last.bytes;
+        cumulative[phase].frees += last.frees;
+
+        allocated |= last.allocations != 0;
+    }
+
+    frameCount++;
+
+    if (perFrameReport && allocated)
+        Output(ReportLastFrame());
+}
+
+AllocationTracker::Counters AllocationTracker::GetLastFrameCounters(eAllocationPhase phase)
+{
+    return lastFrame[phase];
+}
+
+AllocationTracker::Counters AllocationTracker::GetCumulativeCounters(eAllocationPhase phase)
+{
+    return cumulative[phase];
+}
+
+unsigned long long AllocationTracker::GetFrameCount()
+{
+    return frameCount;
+}
+
+void AllocationTracker::SetPerFrameReport(bool enable)
+{
+    perFrameReport = enable;
+}
+
+const char* AllocationTracker::GetPhaseName(eAllocationPhase phase)
+{
+    static const char* names[eAPCount] = { "other", "load", "update", "score", "render" };
+
+    return names[phase];
+}
+
+std::string AllocationTracker::ReportLastFrame()
+{
+    std::ostringstream s;
+
+    s << "Allocations in frame " << frameCount << ":\n";
+    AppendCounters(s, lastFrame);
+
+    return s.str();
+}
+
+std::string AllocationTracker::ReportCumulative()
+{
+    std::ostringstream s;
+
+    if (!IsEnabled()) {
+        s << "Allocation tracking disabled (build with TRACK_ALLOCATIONS)\n";
+        return s.str();
+    }
+
+    s << "Allocations over " << frameCount << " frames:\n";
+    AppendCounters(s, cumulative);
+
+    return s.str();
+}
+
+void AllocationTracker::DumpCumulative()
+{
+    Output(ReportCumulative());
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+void* operator new(size_t size)
+{
+    AllocationTracker::RecordAllocation(size);
+
+    void* p = malloc(size ? size : 1);
+
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    AllocationTracker::RecordAllocation(size);
+
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (!p)
+        return;
+
+    AllocationTracker::RecordFree();
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+#endif // TRACK_ALLOCATIONS
@@ -0,0 +1,83 @@
+#ifndef ALLOCATIONTRACKER_H_
+#define ALLOCATIONTRACKER_H_
+
+#include <string>
+
+// Frame phases that heap allocations are attributed to.
+enum eAllocationPhase {
+    eAPOther,
+    eAPLoad,
+    eAPUpdate,
+    eAPScore,
+    eAPRender,
+    eAPCount
+};
+
+// Counts global operator new/delete traffic per frame phase.
+//
+// Tracking is opt-in: define TRACK_ALLOCATIONS for the build to replace the
+// global allocation operators. Without it the phase scopes compile away and
+// every counter stays zero.
+class AllocationTracker
+{
+public:
+    struct Counters
+    {
+        unsigned long long allocations = 0;
+        unsigned long long bytes = 0;
+        unsigned long long frees = 0;
+    };
+
+    static bool IsEnabled();
+
+    // Sets the phase of the calling thread and returns the previous one.
+    static eAllocationPhase SetPhase(eAllocationPhase phase);
+    static eAllocationPhase GetPhase();
+
+    static void RecordAllocation(size_t bytes);
+    static void RecordFree();
+
+    // Closes the current frame: its counters become the last-frame counters and
+    // are added to the cumulative totals.
+    static void EndFrame();
+
+    static Counters GetLastFrameCounters(eAllocationPhase phase);
+    static Counters GetCumulativeCounters(eAllocationPhase phase);
+    static unsigned long long GetFrameCount();
+
+    // Dump a line for every frame that allocated, in addition to the session report.
+    static void SetPerFrameReport(bool enable);
+
+    static const char* GetPhaseName(eAllocationPhase phase);
+
+    static std::string ReportLastFrame();
+    static std::string ReportCumulative();
+    static void DumpCumulative();
+};
+
+#ifdef TRACK_ALLOCATIONS
+// Attributes allocations on the calling thread to a phase for the lifetime of the scope.
+class AllocationPhaseScope
+{
+public:
+    explicit AllocationPhaseScope(eAllocationPhase phase)
+        : previous(AllocationTracker::SetPhase(phase))
+    {}
+
+    ~AllocationPhaseScope()
+    {
+        AllocationTracker::SetPhase(previous);
+    }
+
+private:
+    eAllocationPhase previous;
+};
+#else
+class AllocationPhaseScope
+{
+public:
+    explicit AllocationPhaseScope(eAllocationPhase) {}
+};
+#endif
+
+#endif // ALLOCATIONTRACKER_H_
@@ -0,0 +1,99 @@
+#ifndef FRAMEARENA_H_
+#define FRAMEARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Linear allocator for temporaries that live for a single frame. Allocation
+// bumps a pointer and Reset releases everything at once; destructors are never
+// run, so only trivially destructible objects may be created in it.
+//
+// When a frame needs more than the current capacity the arena falls back to an
+// extra heap block, and on the next Reset coalesces into a single block large
+// enough for that frame. A steady-state frame therefore never touches the heap,
+// which GetHeapAllocationsThisFrame lets callers check.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity = 64 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors.");
+
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Releases every allocation made since the previous Reset.
+    void Reset();
+
+    bool Owns(const void* p) const;
+
+    size_t GetBytesUsed() const { return bytesUsed; }
+    size_t GetCapacity() const { return capacity; }
+
+    // Heap allocations the arena itself made, in total and since the last Reset.
+    unsigned GetHeapAllocationCount() const { return heapAllocationCount; }
+    unsigned GetHeapAllocationsThisFrame() const { return heapAllocationsThisFrame; }
+
+private:
+    struct Block
+    {
+        Block* next;
+        size_t capacity;
+        size_t used;
+    };
+
+    Block* AllocateBlock(size_t blockCapacity);
+    void FreeBlocks();
+
+    Block* head = nullptr;
+    size_t capacity = 0;
+    size_t bytesUsed = 0;
+
+    unsigned heapAllocationCount = 0;
+    unsigned heapAllocationsThisFrame = 0;
+};
+
+// Standard allocator adaptor so containers on the update path can live in a FrameArena.
+template <typename T>
+class FrameArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    FrameArenaAllocator(FrameArena& arena) : arena(&arena) {}
+
+    template <typename U>
+    FrameArenaAllocator(const FrameArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    FrameArena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const FrameArenaAllocator<T>& a, const FrameArenaAllocator<U>& b) { return a.arena == b.arena; }
+
+template <typename T, typename U>
+bool operator!=(const FrameArenaAllocator<T>& a, const FrameArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+template <typename T>
+using FrameVector = std::vector<T, FrameArenaAllocator<T>>;
+
+#endif // FRAMEARENA_H_
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "FrameStatistics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+FrameStatistics::FrameStatistics()
+{
+    Reset();
+}
+
+void FrameStatistics::Reset()
+{
+    windowHead = 0;
+    windowCount = 0;
+    transitionCount = 0;
+    totalFrameCount = 0;
+
+    memset(histogram, 0, sizeof(histogram));
+    memset(framesInTier, 0, sizeof(framesInTier));
+
+    for (int i = 0; i < kTierCount; ++i) {
+        timeInTier[i] = 0.0;
+    }
+}
+
+void FrameStatistics::AddFrame(double frameTime, int tier)
+{
+    window[windowHead] = frameTime;
+    windowHead = (windowHead + 1) % kWindowSize;
+    windowCount = windowCount < kWindowSize ? windowCount + 1 : kWindowSize;
+
+    int bucket = static_cast<int>(frameTime / kHistogramBucketWidth);
+    bucket = bucket < kHistogramBucketCount ? bucket : kHistogramBucketCount - 1;
+
+    histogram[tier][bucket]++;
+    timeInTier[tier] += frameTime;
+    framesInTier[tier]++;
+
+    totalFrameCount++;
+}
+
+FrameStatistics::Summary FrameStatistics::GetSummary() const
+{
+    Summary summary;
+
+    if (windowCount == 0)
+        return summary;
+
+    double sorted[kWindowSize];
+    std::copy(window, window + windowCount, sorted);
+    std::sort(sorted, sorted + windowCount);
+
+    double sum = 0.0;
+    for (int i = 0; i < windowCount; ++i) {
+        sum += sorted[i];
+    }
+
+    auto percentile = [&](double p) {
+        return sorted[static_cast<int>(p * (windowCount - 1) + 0.5)];
+    };
+
+    summary.frameCount = windowCount;
+    summary.min = sorted[0];
+    summary.max = sorted[windowCount - 1];
+    summary.mean = sum / windowCount;
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+
+    return summary;
+}
+
+int FrameStatistics::TierFromFramerate(double frameratePerSecond)
+{
+    if (frameratePerSecond > 60 - 1)
+        return 0;
+    else if (frameratePerSecond > 30 - 1)
+        return 1;
+
+    return 2;
+}
+
+double FrameStatistics::FramerateOfTier(int tier)
+{
+    static const double framerates[kTierCount] = { 60.0, 30.0, 15.0 };
+
+    return framerates[tier];
+}
+
+std::string FrameStatistics::ToString() const
+{
+    std::ostringstream s;
+    Summary summary = GetSummary();
+
+    s << std::fixed << std::setprecision(2);
+    s << "Frame statistics: " << totalFrameCount << " frames, "
+        << transitionCount << " tier transitions\n";
+    s << "  last " << summary.frameCount << " frames (ms): min " << summary.min * 1000.0
+        << ", max " << summary.max * 1000.0
+        << ", mean " << summary.mean * 1000.0
+        << ", p50 " << summary.p50 * 1000.0
+        << ", p95 " << summary.p95 * 1000.0
+        << ", p99 " << summary.p99 * 1000.0 << '\n';
+
+    for (int tier = 0; tier < kTierCount; ++tier) {
+        s << "  " << FramerateOfTier(tier) << " FPS tier: " << framesInTier[tier] << " frames, "
+            << timeInTier[tier] << " s\n";
+
+        if (framesInTier[tier] == 0)
+            continue;
+
+        for (int bucket = 0; bucket < kHistogramBucketCount; ++bucket) {
+            if (histogram[tier][bucket] == 0)
+                continue;
+
+            double lower = bucket * kHistogramBucketWidth * 1000.0;
+
+            if (bucket + 1 < kHistogramBucketCount)
+                s << "    [" << lower << ", " << lower + kHistogramBucketWidth * 1000.0 << ") ms: ";
+            else
+                s << "    [" << lower << ", inf) ms: ";
+
+            s << histogram[tier][bucket] << '\n';
+        }
+    }
+
+    return s.str();
+}
@@ -0,0 +1,67 @@
+#ifndef FRAMESTATISTICS_H_
+#define FRAMESTATISTICS_H_
+
+#include <string>
+
+// Accumulates frame pacing data for the FramerateController. Recording a frame
+// only touches a ring buffer slot and a histogram bucket; the sorting needed for
+// percentiles is deferred until a summary is queried.
+class FrameStatistics
+{
+public:
+    // Rate tiers the controller switches between (60, 30 and 15 FPS).
+    static const int kTierCount = 3;
+
+    // Frame times are bucketed in 2 ms steps; the last bucket collects everything above.
+    static const int kHistogramBucketCount = 51;
+    static constexpr double kHistogramBucketWidth = 0.002;
+
+    // Number of recent frames the rolling summary is computed over.
+    static const int kWindowSize = 600;
+
+    struct Summary
+    {
+        int frameCount = 0;
+        double min = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
+
+    FrameStatistics();
+
+    void Reset();
+
+    void AddFrame(double frameTime, int tier);
+    void AddTransition() { transitionCount++; }
+
+    // Rolling summary over the last kWindowSize frames.
+    Summary GetSummary() const;
+
+    const unsigned* GetHistogram(int tier) const { return histogram[tier]; }
+    double GetTimeInTier(int tier) const { return timeInTier[tier]; }
+    unsigned GetFrameCountInTier(int tier) const { return framesInTier[tier]; }
+    unsigned GetTransitionCount() const { return transitionCount; }
+    unsigned long long GetTotalFrameCount() const { return totalFrameCount; }
+
+    static int TierFromFramerate(double frameratePerSecond);
+    static double FramerateOfTier(int tier);
+
+    std::string ToString() const;
+
+private:
+    double window[kWindowSize];
+    int windowHead = 0;
+    int windowCount = 0;
+
+    unsigned histogram[kTierCount][kHistogramBucketCount];
+    double timeInTier[kTierCount];
+    unsigned framesInTier[kTierCount];
+
+    unsigned transitionCount = 0;
+    unsigned long long totalFrameCount = 0;
+};
+
+#endif // FRAMESTATISTICS_H_
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "FramerateController.h"
 
+#include <sstream>
+
 
 FramerateController::FramerateController()
 {
@@ -26,6 +28,10 @@ void FramerateController::Tick()
     uint64 timeDelta = currentTime.QuadPart - lastTime.QuadPart;
     lastTime.QuadPart = currentTime.QuadPart;
 
+    // Statistics see the real frame time, hitches included.
+    statistics.AddFrame(static_cast<double>(timeDelta) / frequency.QuadPart,
+        FrameStatistics::TierFromFramerate(wantedFramePerSecond));
+
     if (timeDelta > qpcMaxDelta.QuadPart)
     {
         timeDelta = qpcMaxDelta.QuadPart;
@@ -37,6 +43,8 @@ void FramerateController::Tick()
 
     double dt = static_cast<double>(timeDelta) / TicksPerSecond;
 
+    UpdateCostPredictor();
+
     amountToSleep = 1.0 / wantedFramePerSecond - dt;
     amountToSleep = amountToSleep > 0 ? amountToSleep : 0;
 
@@ -58,5 +66,102 @@ void FramerateController::Wait()
 
 void FramerateController::SetFramerate(double frameratePerSecond)
 {
+    if (wantedFramePerSecond > 0
+        && FrameStatistics::TierFromFramerate(wantedFramePerSecond) != FrameStatistics::TierFromFramerate(frameratePerSecond)) {
+        statistics.AddTransition();
+    }
+
     wantedFramePerSecond = frameratePerSecond;
 }
+
+bool FramerateController::RequestFramerate(double frameratePerSecond)
+{
+    if (frameratePerSecond > wantedFramePerSecond
+        && GetPredictedFrameCost() > kStepUpBudgetRatio / frameratePerSecond) {
+        refusedStepUps++;
+        return false;
+    }
+
+    SetFramerate(frameratePerSecond);
+
+    return true;
+}
+
+void FramerateController::BeginPhase(eFramePhase phase)
+{
+    QueryPerformanceCounter(&phaseStart[phase]);
+}
+
+void FramerateController::EndPhase(eFramePhase phase)
+{
+    LARGE_INTEGER currentTime;
+    QueryPerformanceCounter(&currentTime);
+
+    phaseCost[phase] += static_cast<double>(currentTime.QuadPart - phaseStart[phase].QuadPart) / frequency.QuadPart;
+}
+
+double FramerateController::GetPredictedFrameCost() const
+{
+    double mean = 0.0;
+    double deviation = 0.0;
+
+    for (int i = 0; i < eFPCount; ++i) {
+        mean += phaseCostMean[i];
+        deviation += phaseCostDeviation[i];
+    }
+
+    double trend = frameCostTrend > 0 ? frameCostTrend * kTrendLookahead : 0;
+
+    return mean + 2.0 * deviation + trend;
+}
+
+void FramerateController::UpdateCostPredictor()
+{
+    double frameCost = 0.0;
+
+    for (int i = 0; i < eFPCount; ++i) {
+        if (hasCostSample) {
+            double error = phaseCost[i] - phaseCostMean[i];
+
+            phaseCostMean[i] += kCostSmoothing * error;
+            phaseCostDeviation[i] += kCostSmoothing * ((error > 0 ? error : -error) - phaseCostDeviation[i]);
+        }
+        else {
+            phaseCostMean[i] = phaseCost[i];
+            phaseCostDeviation[i] = 0.0;
+        }
+
+        frameCost += phaseCost[i];
+        phaseCost[i] = 0.0;
+    }
+
+    if (hasCostSample) {
+        frameCostTrend += kCostSmoothing * ((frameCost - lastFrameCost) - frameCostTrend);
+    }
+
+    lastFrameCost = frameCost;
+    hasCostSample = true;
+
+    // Step down before the deadline is actually missed.
+    int tier = FrameStatistics::TierFromFramerate(wantedFramePerSecond);
+
+    if (tier + 1 < FrameStatistics::kTierCount
+        && GetPredictedFrameCost() > kStepDownBudgetRatio / wantedFramePerSecond) {
+        proactiveStepDowns++;
+        SetFramerate(FrameStatistics::FramerateOfTier(tier + 1));
+    }
+}
+
+void FramerateController::DumpStatistics() const
+{
+    std::ostringstream s;
+
+    s << statistics.ToString();
+    s << "  governor: " << refusedStepUps << " refused step ups, "
+        << proactiveStepDowns << " proactive step downs, predicted cost "
+        << GetPredictedFrameCost() * 1000.0 << " ms (update "
+        << phaseCostMean[eFPUpdate] * 1000.0 << " ms, render "
+        << phaseCostMean[eFPRender] * 1000.0 << " ms)\n";
+
+    OutputDebugStringA(s.str().c_str());
+}
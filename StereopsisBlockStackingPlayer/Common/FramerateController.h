@@ -2,6 +2,13 @@
 #define FRAMERATECONTROLLER_H_
 
 #include "Common\Singleton.h"
+#include "Common\FrameStatistics.h"
+
+enum eFramePhase {
+    eFPUpdate,
+    eFPRender,
+    eFPCount
+};
 
 class FramerateController
     : public Singleton<FramerateController>
@@ -15,9 +22,24 @@ public:
     void Tick();
     void Wait();
     void SetFramerate(double frameratePerSecond);
+
+    // Switches to the given framerate unless it is a step up whose predicted CPU
+    // cost would not fit in the new frame budget. Returns whether it was applied.
+    bool RequestFramerate(double frameratePerSecond);
+
+    // Brackets the CPU work of a frame phase. Costs are folded into the
+    // predictor on the next Tick.
+    void BeginPhase(eFramePhase phase);
+    void EndPhase(eFramePhase phase);
+
+    double GetPhaseCost(eFramePhase phase) const { return phaseCostMean[phase]; }
+    double GetPredictedFrameCost() const;
     bool ShouldPassThisFrame() const { return currentFramesInSecond > wantedFramePerSecond; }
     double GetFPS() const { return wantedFramePerSecond; }
 
+    const FrameStatistics& GetStatistics() const { return statistics; }
+    void DumpStatistics() const;
+
 private:
     LARGE_INTEGER lastTime;
     LARGE_INTEGER frequency;
@@ -25,9 +47,35 @@ private:
 
     double oneSecTimer = 0;
 
-    double wantedFramePerSecond;
+    double wantedFramePerSecond = 0;
     int currentFramesInSecond = 0;
     double amountToSleep;
+
+    FrameStatistics statistics;
+
+    void UpdateCostPredictor();
+
+    // Fraction of a tier's budget the predicted cost may use before stepping up
+    // is refused, and before the controller steps down on its own.
+    static constexpr double kStepUpBudgetRatio = 0.75;
+    static constexpr double kStepDownBudgetRatio = 0.85;
+
+    // EWMA weight of the newest sample, and how many frames ahead the cost
+    // trend is extrapolated.
+    static constexpr double kCostSmoothing = 0.1;
+    static constexpr double kTrendLookahead = 4.0;
+
+    LARGE_INTEGER phaseStart[eFPCount];
+    double phaseCost[eFPCount] = {};
+    double phaseCostMean[eFPCount] = {};
+    double phaseCostDeviation[eFPCount] = {};
+
+    double lastFrameCost = 0.0;
+    double frameCostTrend = 0.0;
+    bool hasCostSample = false;
+
+    unsigned refusedStepUps = 0;
+    unsigned proactiveStepDowns = 0;
 };
 
 #endif // FRAMERATECONTROLLER_H_
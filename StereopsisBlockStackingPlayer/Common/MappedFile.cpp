@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+static std::wstring WidenPath(const std::string& path)
+{
+    const int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring widePath(length > 0 ? length - 1 : 0, L'\0');
+    if (length > 1)
+        MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+
+    return widePath;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    // CreateFile2 and the FromApp mapping functions are the ones open to UWP apps.
+    HANDLE fileHandle = CreateFile2(WidenPath(path).c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    file = fileHandle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        Close();
+        return false;
+    }
+
+    if (fileSize.QuadPart == 0)
+        return true;
+
+    mapping = CreateFileMappingFromApp(fileHandle, nullptr, PAGE_READONLY, 0, nullptr);
+    if (!mapping) {
+        Close();
+        return false;
+    }
+
+    data = static_cast<const char*>(MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0));
+    if (!data) {
+        Close();
+        return false;
+    }
+
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+
+    data = nullptr;
+    size = 0;
+    mapping = nullptr;
+    file = nullptr;
+}
+
+bool WriteWholeFile(const std::string& path, const void* data, size_t size)
+{
+    HANDLE fileHandle = CreateFile2(WidenPath(path).c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    const char* bytes = static_cast<const char*>(data);
+    bool written = true;
+
+    while (size > 0 && written) {
+        const DWORD chunk = static_cast<DWORD>(size < 0x40000000 ? size : 0x40000000);
+        DWORD chunkWritten = 0;
+
+        written = WriteFile(fileHandle, bytes, chunk, &chunkWritten, nullptr) && chunkWritten == chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+
+    CloseHandle(fileHandle);
+    return written;
+}
+#else
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        Close();
+        return false;
+    }
+
+    if (status.st_size == 0)
+        return true;
+
+    void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (view == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        munmap(const_cast<char*>(data), size);
+    if (descriptor >= 0)
+        close(descriptor);
+
+    data = nullptr;
+    size = 0;
+    descriptor = -1;
+}
+
+bool WriteWholeFile(const std::string& path, const void* data, size_t size)
+{
+    const int fileDescriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0)
+        return false;
+
+    const char* bytes = static_cast<const char*>(data);
+    bool written = true;
+
+    while (size > 0 && written) {
+        const ssize_t chunk = write(fileDescriptor, bytes, size);
+
+        written = chunk > 0;
+        if (written) {
+            bytes += chunk;
+            size -= static_cast<size_t>(chunk);
+        }
+    }
+
+    return close(fileDescriptor) == 0 && written;
+}
+#endif
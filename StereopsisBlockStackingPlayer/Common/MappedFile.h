@@ -0,0 +1,44 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are read in on first touch,
+// so several threads can parse different parts of the file without copying it.
+// The view stays valid until Close or destruction.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // path is UTF-8. Returns false if the file cannot be opened or mapped. An
+    // empty file opens with no data, since it cannot be mapped.
+    bool Open(const std::string& path);
+    void Close();
+
+    const char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+// Replaces the file at path, which is UTF-8, with size bytes of data. The
+// write is not atomic: a reader racing it or a crash can leave a partial file,
+// so files written this way should carry their own check.
+bool WriteWholeFile(const std::string& path, const void* data, size_t size);
+
+#endif // MAPPEDFILE_H_
@@ -0,0 +1,590 @@
+#include "pch.h"
+#include "MeshAssetCache.h"
+#include "MeshFile.h"
+#include "ObjLoader.h"
+#include "Common/MappedFile.h"
+#include "LPGL/lpglVertexFormat.h"
+
+#include <cstdint>
+#include <cstdio>
+
+using namespace StereopsisBlockStackingPlayer;
+using namespace DirectX;
+
+MeshAsset::~MeshAsset()
+{
+    const GLuint vertexArrays[] = { mesh.vertexArray, proxy.vertexArray };
+    glDeleteVertexArrays(2, vertexArrays);
+
+    const GLuint buffers[] = { mesh.vertexBuffer, mesh.indexBuffer, proxy.vertexBuffer, proxy.indexBuffer };
+    glDeleteBuffers(4, buffers);
+}
+
+MeshAssetCache::MeshAssetCache(const std::string& meshFileDirectory) :
+    m_meshFileDirectory(meshFileDirectory)
+{
+}
+
+std::shared_ptr<const MeshAsset> MeshAssetCache::Acquire(const MeshAssetDesc& desc)
+{
+    std::shared_ptr<Entry> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(m_entriesMutex);
+        std::shared_ptr<Entry>& slot = m_entries[desc];
+
+        if (!slot)
+            slot = std::make_shared<Entry>();
+
+        entry = slot;
+    }
+
+    // Other assets keep loading while this one does.
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    std::shared_ptr<const MeshAsset> asset = entry->asset.lock();
+
+    if (!asset) {
+        asset = Load(desc);
+        entry->asset = asset;
+    }
+
+    return asset;
+}
+
+struct BoundingBox3D {
+    XMFLOAT3 Min, Max;
+
+    BoundingBox3D()
+        : Min(FLT_MAX, FLT_MAX, FLT_MAX),
+        Max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+    BoundingBox3D(const XMFLOAT3& Min, const XMFLOAT3& Max)
+        : Min(Min), Max(Max) {}
+
+    void AddPoint(const XMFLOAT3& p) {
+        Min.x = p.x < Min.x ? p.x : Min.x;
+        Min.y = p.y < Min.y ? p.y : Min.y;
+        Min.z = p.z < Min.z ? p.z : Min.z;
+
+        Max.x = p.x > Max.x ? p.x : Max.x;
+        Max.y = p.y > Max.y ? p.y : Max.y;
+        Max.z = p.z > Max.z ? p.z : Max.z;
+    }
+
+    bool IncludePoint(const XMFLOAT3& p) {
+        return Min.x < p.x && Min.y < p.y && Min.z < p.z
+            && Max.x > p.x && Max.y > p.y && Max.z > p.z;
+    }
+};
+
+struct VoxelNode {
+    std::vector<int> position; // size of position is depth. Root is empty
+    BoundingBox3D* boundingBox = nullptr;
+
+    VoxelNode* parent = nullptr;
+    VoxelNode* children[8];
+    bool isCompleteSubtree = false;
+    bool isLeaf = false;
+
+    VoxelNode() {
+        memset(children, 0, sizeof(VoxelNode*) * 8);
+    }
+};
+
+struct VoxelOctree {
+    VoxelNode* rootNode = nullptr;
+    std::vector<const BoundingBox3D*> boxGeometries;
+};
+
+void createSuboctree(VoxelNode** parent, const std::vector<XMFLOAT3*>& vertices, const BoundingBox3D& boundingBox, int depth) {
+    assert(parent != nullptr && *parent != nullptr);
+    XMVECTOR mid, Min, Max;
+    Min = XMLoadFloat3(&boundingBox.Min);
+    Max = XMLoadFloat3(&boundingBox.Max);
+    mid = (Min + Max) * 0.5f;
+
+    auto halfLength = Max - mid;
+    auto halfLengthX = XMVectorSet(XMVectorGetX(halfLength), 0, 0, 0);
+    auto halfLengthY = XMVectorSet(0, XMVectorGetY(halfLength), 0, 0);
+    auto halfLengthZ = XMVectorSet(0, 0, XMVectorGetZ(halfLength), 0);
+
+    BoundingBox3D childrensBoundingBox[8];
+
+    XMStoreFloat3(&childrensBoundingBox[0].Min, Min + halfLengthZ);
+    XMStoreFloat3(&childrensBoundingBox[0].Max, mid + halfLengthZ);
+
+    XMStoreFloat3(&childrensBoundingBox[1].Min, Min - halfLengthY);
+    XMStoreFloat3(&childrensBoundingBox[1].Max, Max - halfLengthY);
+
+    XMStoreFloat3(&childrensBoundingBox[2].Min, Min + halfLengthX);
+    XMStoreFloat3(&childrensBoundingBox[2].Max, mid + halfLengthX);
+
+    XMStoreFloat3(&childrensBoundingBox[3].Min, Min);
+    XMStoreFloat3(&childrensBoundingBox[3].Max, mid);
+
+    XMStoreFloat3(&childrensBoundingBox[4].Min, mid - halfLengthX);
+    XMStoreFloat3(&childrensBoundingBox[4].Max, Max - halfLengthX);
+
+    XMStoreFloat3(&childrensBoundingBox[5].Min, mid);
+    XMStoreFloat3(&childrensBoundingBox[5].Max, Max);
+
+    XMStoreFloat3(&childrensBoundingBox[6].Min, mid - halfLengthZ);
+    XMStoreFloat3(&childrensBoundingBox[6].Max, Max - halfLengthZ);
+
+    XMStoreFloat3(&childrensBoundingBox[7].Min, Min + halfLengthY);
+    XMStoreFloat3(&childrensBoundingBox[7].Max, mid + halfLengthY);
+
+    for (int i = 0; i < 8; ++i) {
+        std::vector<XMFLOAT3*> subvertices;
+
+        for (auto* vertex : vertices) {
+            if (childrensBoundingBox[i].IncludePoint(*vertex)) {
+                subvertices.push_back(vertex);
+            }
+        }
+
+        if (subvertices.size() > 0) {
+            (*parent)->children[i] = new VoxelNode();
+            (*parent)->children[i]->parent = *parent;
+            (*parent)->children[i]->position = (*parent)->position;
+            (*parent)->children[i]->position.push_back(i);
+
+            BoundingBox3D* pChildBoundingBox = new BoundingBox3D();
+            *pChildBoundingBox = childrensBoundingBox[i];
+            (*parent)->children[i]->boundingBox = pChildBoundingBox;
+
+            if (depth - 1 > 0) {
+                createSuboctree(&(*parent)->children[i], subvertices, childrensBoundingBox[i], depth - 1);
+            }
+            else {
+                (*parent)->children[i]->isLeaf = true;
+            }
+        }
+    }
+
+    int isFull = 0;
+
+    for (int i = 0; i < 8; ++i) {
+        if (parent && (*parent)->children[i]
+            && ((*parent)->children[i]->isLeaf || (*parent)->children[i]->isCompleteSubtree)) {
+            isFull++;
+        }
+    }
+
+    if (isFull == 8) {
+        (*parent)->isCompleteSubtree = true;
+    }
+}
+
+void BuildOctreeGeometry(VoxelOctree* octree, VoxelNode* parent)
+{
+    if (!octree)
+        return;
+
+    if (parent->isCompleteSubtree) {
+        octree->boxGeometries.push_back(parent->boundingBox);
+    }
+    else {
+        for (int i = 0; i < 8; ++i) {
+            auto* child = parent->children[i];
+
+            if (child) {
+                if (child->isLeaf) {
+                    octree->boxGeometries.push_back(child->boundingBox);
+                }
+                else {
+                    BuildOctreeGeometry(octree, parent->children[i]);
+                }
+            }
+        }
+    }
+}
+
+VoxelOctree* createOctree(const std::vector<XMFLOAT3*>& vertices, int depth) {
+    VoxelOctree* voxelOctree = new VoxelOctree();
+    voxelOctree->rootNode = new VoxelNode();
+
+    BoundingBox3D *bb = new BoundingBox3D();
+    for (auto* vertex : vertices) {
+        bb->AddPoint(*vertex);
+    }
+    voxelOctree->rootNode->boundingBox = bb;
+
+    createSuboctree(&voxelOctree->rootNode, vertices, *bb, depth);
+
+    return voxelOctree;
+}
+
+// 16-bit indices address at most 65,536 vertices; larger meshes get 32-bit ones.
+static GLenum IndexTypeForVertexCount(size_t vertexCount)
+{
+    return vertexCount > 0x10000 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+}
+
+static size_t IndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_INT ? sizeof(unsigned int) : sizeof(unsigned short);
+}
+
+static void WriteIndex(void* indices, GLenum indexType, size_t i, unsigned int value)
+{
+    if (indexType == GL_UNSIGNED_INT)
+        static_cast<unsigned int*>(indices)[i] = value;
+    else
+        static_cast<unsigned short*>(indices)[i] = static_cast<unsigned short>(value);
+}
+
+// One geometry as built, before it is laid out in a mesh file.
+struct BuiltGeometry {
+    lpglVertexLayout layout;
+    BoundingBox bounds;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    size_t indexCount = 0;
+    std::vector<char> vertices;
+    std::vector<char> indices;
+};
+
+// 64-bit FNV-1a, continuing from hash.
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static uint64_t HashBuildParameters(const MeshAssetDesc& desc, uint64_t hash)
+{
+    hash = HashBytes(&desc.octreeDepth, sizeof(desc.octreeDepth), hash);
+    return HashBytes(&desc.positionTolerance, sizeof(desc.positionTolerance), hash);
+}
+
+// Key a mesh file built from desc's source as it is now must carry. False if
+// the source cannot be read.
+static bool HashMeshSource(const MeshAssetDesc& desc, uint64_t& key)
+{
+    MappedFile source;
+
+    if (!source.Open(desc.path))
+        return false;
+
+    key = HashBuildParameters(desc, HashBytes(source.GetData(), source.GetSize()));
+    return true;
+}
+
+// Named after the desc rather than the key, so a stale file is replaced
+// instead of left behind.
+static std::string MeshFilePath(const std::string& directory, const MeshAssetDesc& desc)
+{
+    const uint64_t hash = HashBuildParameters(desc, HashBytes(desc.path.data(), desc.path.size()));
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(hash));
+
+#ifdef _WIN32
+    return directory + "\\" + name;
+#else
+    return directory + "/" + name;
+#endif
+}
+
+static bool IsRangeInFile(uint64_t offset, uint64_t size, size_t fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+// Whether data is a complete mesh file of the current version built with key.
+static bool IsCurrentMeshFile(const char* data, size_t size, uint64_t key)
+{
+    MeshFileHeader header;
+
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != kMeshFileMagic || header.version != kMeshFileVersion || header.key != key)
+        return false;
+
+    for (const MeshFileGeometry* geometry : { &header.mesh, &header.proxy }) {
+        if (!IsRangeInFile(geometry->vertexOffset, geometry->vertexSize, size) ||
+            !IsRangeInFile(geometry->indexOffset, geometry->indexSize, size))
+            return false;
+    }
+
+    return header.payloadHash == HashBytes(data + sizeof(header), size - sizeof(header));
+}
+
+// Appends a geometry's streams to a mesh file and describes them in record.
+// Streams start 4-byte aligned, which covers every index and vertex component.
+static void AppendGeometry(std::vector<char>& file, MeshFileGeometry& record, const BuiltGeometry& geometry)
+{
+    record.positionType = geometry.layout.positionType;
+    record.colorType = geometry.layout.colorType;
+    record.layoutMin = geometry.layout.boundsMin;
+    record.layoutMax = geometry.layout.boundsMax;
+    record.color = geometry.layout.color;
+    record.boundsCenter = geometry.bounds.Center;
+    record.boundsExtents = geometry.bounds.Extents;
+    record.indexType = geometry.indexType;
+    record.indexCount = static_cast<uint32_t>(geometry.indexCount);
+
+    file.resize((file.size() + 3) & ~static_cast<size_t>(3));
+    record.vertexOffset = file.size();
+    record.vertexSize = geometry.vertices.size();
+    file.insert(file.end(), geometry.vertices.begin(), geometry.vertices.end());
+
+    file.resize((file.size() + 3) & ~static_cast<size_t>(3));
+    record.indexOffset = file.size();
+    record.indexSize = geometry.indices.size();
+    file.insert(file.end(), geometry.indices.begin(), geometry.indices.end());
+}
+
+// Parses desc's OBJ file and builds the mesh and its voxel proxy into a mesh
+// file carrying key.
+static std::vector<char> BuildMeshFile(const MeshAssetDesc& desc, uint64_t key)
+{
+    BuiltGeometry mesh;
+    BuiltGeometry proxy;
+
+    ObjMesh obj;
+    std::string err;
+
+    bool ret = LoadObjMesh(desc.path, obj, &err);
+
+    if (!err.empty())
+    {
+        OutputDebugStringA(err.c_str());
+    }
+
+    if (!ret)
+    {
+        OutputDebugStringA("Failed to load/parse .obj.\n");
+    }
+
+    size_t vertexCount = obj.positions.size() / 3;
+    size_t indexCount = obj.indices.size();
+
+    std::vector<XMFLOAT3> positions;
+    positions.reserve(vertexCount);
+
+    for (unsigned int i = 0; i < obj.positions.size() / 3; ++i)
+    {
+        XMFLOAT3 v;
+        v.x = obj.positions[3 * i + 0];
+        v.y = obj.positions[3 * i + 1];
+        v.z = obj.positions[3 * i + 2];
+
+        positions.push_back(v);
+    }
+
+    DirectX::BoundingBox::CreateFromPoints(
+        mesh.bounds,
+        positions.size(),
+        positions.data(),
+        sizeof(XMFLOAT3));
+
+    // The mesh is drawn in white, so only positions are stored, in the
+    // smallest format that keeps them within the tolerance.
+    XMFLOAT3 boundsMin;
+    XMFLOAT3 boundsMax;
+    XMStoreFloat3(&boundsMin, XMVectorSubtract(XMLoadFloat3(&mesh.bounds.Center), XMLoadFloat3(&mesh.bounds.Extents)));
+    XMStoreFloat3(&boundsMax, XMVectorAdd(XMLoadFloat3(&mesh.bounds.Center), XMLoadFloat3(&mesh.bounds.Extents)));
+
+    mesh.layout = lpglChooseVertexLayout(boundsMin, boundsMax, desc.positionTolerance, true);
+    mesh.indexType = IndexTypeForVertexCount(vertexCount);
+    mesh.indexCount = indexCount;
+
+    mesh.vertices.resize(mesh.layout.Stride() * vertexCount);
+    mesh.indices.resize(IndexSize(mesh.indexType) * indexCount);
+
+    for (size_t vertex = 0; vertex < positions.size(); ++vertex)
+    {
+        mesh.layout.Write(mesh.vertices.data(), vertex, positions[vertex], XMFLOAT3(1, 1, 1));
+    }
+
+    size_t index = 0;
+
+    for (unsigned int ii = 0; ii < obj.indices.size() / 3; ++ii)
+    {
+        unsigned int a = obj.indices[3 * ii + 0].vertex;
+        unsigned int b = obj.indices[3 * ii + 1].vertex;
+        unsigned int c = obj.indices[3 * ii + 2].vertex;
+
+        // CW order
+        WriteIndex(mesh.indices.data(), mesh.indexType, index++, a);
+        WriteIndex(mesh.indices.data(), mesh.indexType, index++, c);
+        WriteIndex(mesh.indices.data(), mesh.indexType, index++, b);
+    }
+
+    std::vector<XMFLOAT3*> vertices;
+
+    for (size_t i = 0; i < obj.positions.size() / 3; ++i) {
+        vertices.push_back(reinterpret_cast<XMFLOAT3*>(obj.positions.data() + 3 * i));
+    }
+
+    auto* voxelOctree = createOctree(vertices, desc.octreeDepth);
+
+    BuildOctreeGeometry(voxelOctree, voxelOctree->rootNode);
+
+    const size_t boxCount = voxelOctree->boxGeometries.size();
+
+    // Voxels can reach past the mesh, so their format is chosen from their own bounds.
+    XMFLOAT3 boxesMin = boundsMin;
+    XMFLOAT3 boxesMax = boundsMax;
+
+    for (const auto* leafNodeBox : voxelOctree->boxGeometries) {
+        XMStoreFloat3(&boxesMin, XMVectorMin(XMLoadFloat3(&boxesMin), XMLoadFloat3(&leafNodeBox->Min)));
+        XMStoreFloat3(&boxesMax, XMVectorMax(XMLoadFloat3(&boxesMax), XMLoadFloat3(&leafNodeBox->Max)));
+    }
+
+    BoundingBox::CreateFromPoints(proxy.bounds, XMLoadFloat3(&boxesMin), XMLoadFloat3(&boxesMax));
+
+    proxy.layout = lpglChooseVertexLayout(boxesMin, boxesMax, desc.positionTolerance, true);
+    // Each box appends 8 vertices, so past 8,192 boxes 16-bit indices would wrap.
+    proxy.indexType = IndexTypeForVertexCount(8 * boxCount);
+    proxy.indexCount = 36 * boxCount;
+
+    proxy.vertices.resize(proxy.layout.Stride() * 8 * boxCount);
+    proxy.indices.resize(IndexSize(proxy.indexType) * proxy.indexCount);
+
+    const unsigned int boxIndices[36] =
+    {
+        2,0,1, // -x
+        2,1,3,
+        6,5,4, // +x
+        6,7,5,
+        0,5,1, // -y
+        0,4,5,
+        2,7,6, // +y
+        2,3,7,
+        0,6,4, // -z
+        0,2,6,
+        1,7,3, // +z
+        1,5,7,
+    };
+
+    unsigned int baseIndex = 0;
+    index = 0;
+
+    for (const auto* leafNodeBox : voxelOctree->boxGeometries) {
+        auto &Min = leafNodeBox->Min;
+        auto &Max = leafNodeBox->Max;
+
+        const XMFLOAT3 corners[8] =
+        { XMFLOAT3(Min.x, Min.y, Min.z),
+            XMFLOAT3(Min.x, Min.y, Max.z),
+            XMFLOAT3(Min.x, Max.y, Min.z),
+            XMFLOAT3(Min.x, Max.y, Max.z),
+            XMFLOAT3(Max.x, Min.y, Min.z),
+            XMFLOAT3(Max.x, Min.y, Max.z),
+            XMFLOAT3(Max.x, Max.y, Min.z),
+            XMFLOAT3(Max.x, Max.y, Max.z) };
+
+        for (int corner = 0; corner < 8; ++corner) {
+            proxy.layout.Write(proxy.vertices.data(), baseIndex + corner, corners[corner], XMFLOAT3(1, 1, 1));
+        }
+
+        for (unsigned int boxIndex : boxIndices) {
+            WriteIndex(proxy.indices.data(), proxy.indexType, index++, baseIndex + boxIndex);
+        }
+
+        baseIndex += 8;
+    }
+
+    MeshFileHeader header = {};
+    header.magic = kMeshFileMagic;
+    header.version = kMeshFileVersion;
+    header.key = key;
+
+    std::vector<char> file(sizeof(header));
+    AppendGeometry(file, header.mesh, mesh);
+    AppendGeometry(file, header.proxy, proxy);
+
+    header.payloadHash = HashBytes(file.data() + sizeof(header), file.size() - sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
+
+    return file;
+}
+
+static void UploadGeometry(MeshGeometry& geometry, const MeshFileGeometry& record, const char* file)
+{
+    lpglVertexLayout layout;
+    layout.positionType = static_cast<GLenum>(record.positionType);
+    layout.colorType = static_cast<GLenum>(record.colorType);
+    layout.boundsMin = record.layoutMin;
+    layout.boundsMax = record.layoutMax;
+    layout.color = record.color;
+
+    geometry.bounds.Center = record.boundsCenter;
+    geometry.bounds.Extents = record.boundsExtents;
+    geometry.indexType = static_cast<GLenum>(record.indexType);
+    geometry.indexCount = record.indexCount;
+
+    glGenBuffers(1, &geometry.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizei>(record.vertexSize),
+        record.vertexSize ? file + record.vertexOffset : nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &geometry.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizei>(record.indexSize),
+        record.indexSize ? file + record.indexOffset : nullptr, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &geometry.vertexArray);
+    glBindVertexArray(geometry.vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.indexBuffer);
+    layout.Bind();
+    glBindVertexArray(0);
+}
+
+std::shared_ptr<const MeshAsset> MeshAssetCache::Load(const MeshAssetDesc& desc) const
+{
+    // Without a readable source there is nothing to check a mesh file against.
+    uint64_t key = 0;
+    const bool useMeshFile = !m_meshFileDirectory.empty() && HashMeshSource(desc, key);
+    const std::string meshFilePath = useMeshFile ? MeshFilePath(m_meshFileDirectory, desc) : std::string();
+
+    MappedFile mappedMeshFile;
+    std::vector<char> builtMeshFile;
+    const char* file = nullptr;
+
+    if (useMeshFile && mappedMeshFile.Open(meshFilePath) &&
+        IsCurrentMeshFile(mappedMeshFile.GetData(), mappedMeshFile.GetSize(), key)) {
+        file = mappedMeshFile.GetData();
+    }
+    else {
+        // A mapped file cannot be replaced.
+        mappedMeshFile.Close();
+
+        builtMeshFile = BuildMeshFile(desc, key);
+        file = builtMeshFile.data();
+
+        if (useMeshFile && !WriteWholeFile(meshFilePath, builtMeshFile.data(), builtMeshFile.size())) {
+            OutputDebugStringA(("Failed to write " + meshFilePath + ".\n").c_str());
+        }
+    }
+
+    MeshFileHeader header;
+    memcpy(&header, file, sizeof(header));
+
+    auto asset = std::make_shared<MeshAsset>();
+
+    // Bindings made on the default context could land in a vertex array the
+    // rendering thread has bound.
+    lpglContext* loadContext = lpglCreateContext();
+    lpglMakeCurrent(loadContext);
+
+    UploadGeometry(asset->mesh, header.mesh, file);
+    UploadGeometry(asset->proxy, header.proxy, file);
+
+    lpglMakeCurrent(nullptr);
+    lpglDestroyContext(loadContext);
+
+    return asset;
+}
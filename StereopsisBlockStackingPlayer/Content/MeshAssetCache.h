@@ -0,0 +1,101 @@
+#pragma once
+
+#include "LPGL/lpgl.h"
+
+#include <DirectXCollision.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace StereopsisBlockStackingPlayer
+{
+    // One drawable representation of a mesh asset.
+    struct MeshGeometry
+    {
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+
+        // Both buffers and the vertex layout.
+        GLuint vertexArray = 0;
+
+        uint32 indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_SHORT;
+
+        // In model space.
+        DirectX::BoundingBox bounds;
+    };
+
+    // What a mesh asset is built from. Requests with equal descriptions share one asset.
+    struct MeshAssetDesc
+    {
+        // OBJ file, relative to the package.
+        std::string path;
+
+        // Subdivisions of the voxel proxy drawn out of focus.
+        int octreeDepth = 3;
+
+        // Largest position error the vertex format may introduce, in meters.
+        float positionTolerance = 1e-4f;
+
+        bool operator<(const MeshAssetDesc& other) const
+        {
+            if (path != other.path)
+                return path < other.path;
+            if (octreeDepth != other.octreeDepth)
+                return octreeDepth < other.octreeDepth;
+            return positionTolerance < other.positionTolerance;
+        }
+    };
+
+    // A mesh and its voxel proxy in GPU buffers. Immutable once loaded; the
+    // buffers are deleted with the last reference.
+    class MeshAsset
+    {
+    public:
+        MeshAsset() = default;
+        MeshAsset(const MeshAsset&) = delete;
+        MeshAsset& operator=(const MeshAsset&) = delete;
+        ~MeshAsset();
+
+        MeshGeometry mesh;
+
+        // The voxel boxes can reach past the mesh, so the proxy has its own bounds.
+        MeshGeometry proxy;
+    };
+
+    // Loads each mesh asset once and hands it out to every renderer drawing it,
+    // so startup time and memory do not grow with the number of renderers.
+    // The cache holds no reference itself: an asset nobody uses is released,
+    // and loaded again by the next request.
+    //
+    // Processed meshes are also kept on disk between launches, so a load whose
+    // source and build parameters are unchanged maps the processed file and
+    // uploads it as is. A stale or damaged file is rebuilt and rewritten.
+    class MeshAssetCache
+    {
+    public:
+        // meshFileDirectory is a writable folder for the processed meshes, in
+        // UTF-8; empty keeps nothing on disk.
+        explicit MeshAssetCache(const std::string& meshFileDirectory = std::string());
+
+        // Returns the asset for desc, loading it on the calling thread if no one
+        // holds it. Concurrent requests for the same asset wait for a single load.
+        std::shared_ptr<const MeshAsset> Acquire(const MeshAssetDesc& desc);
+
+    private:
+        struct Entry
+        {
+            // Held while loading.
+            std::mutex mutex;
+            std::weak_ptr<const MeshAsset> asset;
+        };
+
+        std::shared_ptr<const MeshAsset> Load(const MeshAssetDesc& desc) const;
+
+        const std::string m_meshFileDirectory;
+        std::mutex m_entriesMutex;
+        std::map<MeshAssetDesc, std::shared_ptr<Entry>> m_entries;
+    };
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <cstdint>
+
+namespace StereopsisBlockStackingPlayer
+{
+    // A processed mesh file holds everything MeshAssetCache uploads, so a launch
+    // that finds a current one skips parsing and voxelization: a header
+    // describing both geometries, then their vertex and index streams exactly as
+    // they go to glBufferData. Files are in native byte order and only read on
+    // the device that wrote them. Bump kMeshFileVersion whenever the processing
+    // or this layout changes.
+    const uint32_t kMeshFileMagic = 0x4853454d; // "MESH"
+    const uint32_t kMeshFileVersion = 1;
+
+    struct MeshFileGeometry
+    {
+        uint32_t positionType;
+        uint32_t colorType;
+        DirectX::XMFLOAT3 layoutMin;
+        DirectX::XMFLOAT3 layoutMax;
+        DirectX::XMFLOAT3 color;
+        DirectX::XMFLOAT3 boundsCenter;
+        DirectX::XMFLOAT3 boundsExtents;
+        uint32_t indexType;
+        uint32_t indexCount;
+
+        // Byte ranges of the file.
+        uint64_t vertexOffset;
+        uint64_t vertexSize;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+    };
+
+    struct MeshFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+
+        // Of the source file's contents and the build parameters.
+        uint64_t key;
+
+        // Of everything after the header, so a torn write reads as stale.
+        uint64_t payloadHash;
+
+        MeshFileGeometry mesh;
+        MeshFileGeometry proxy;
+    };
+}
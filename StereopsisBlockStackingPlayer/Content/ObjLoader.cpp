@@ -0,0 +1,418 @@
+#include "pch.h"
+#include "ObjLoader.h"
+#include "Common/MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+using namespace StereopsisBlockStackingPlayer;
+
+namespace
+{
+    // Several chunks per thread even out lines that take longer to parse, such
+    // as faces against vertices; small files are not worth splitting finely.
+    const size_t kMinChunkSize = 64 * 1024;
+    const unsigned kChunksPerThread = 4;
+
+    // What one line-aligned chunk of the file holds. Relative indices count
+    // back from the last element read, so they are stored relative to the
+    // chunk's first element until the earlier chunks are counted.
+    struct ObjChunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        std::vector<float> positions;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        std::vector<ObjIndex> indices;
+
+        // Entries of indices holding relative components: 1 for the vertex,
+        // 2 for the texcoord and 4 for the normal.
+        std::vector<std::pair<size_t, unsigned char>> relativeIndices;
+
+        // Where this chunk's elements go in the merged mesh.
+        size_t positionBase = 0;
+        size_t normalBase = 0;
+        size_t texcoordBase = 0;
+        size_t indexBase = 0;
+    };
+
+    const unsigned char kRelativeVertex = 1;
+    const unsigned char kRelativeTexcoord = 2;
+    const unsigned char kRelativeNormal = 4;
+
+    // Every power of ten up to 1e22 is exact in a double.
+    const double kPowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+    inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && IsBlank(*p))
+            ++p;
+        return p;
+    }
+
+    // Runs job(i) for every i below count, spread over threadCount threads
+    // including the calling one.
+    template <typename Job>
+    void ParallelFor(size_t count, unsigned threadCount, const Job& job)
+    {
+        std::atomic<size_t> next(0);
+
+        auto worker = [&]() {
+            for (size_t i = next++; i < count; i = next++)
+                job(i);
+        };
+
+        std::vector<std::thread> threads;
+
+        for (unsigned i = 1; i < threadCount && i < count; ++i)
+            threads.emplace_back(worker);
+
+        worker();
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // Reads one whitespace-delimited number the way tinyobjloader does:
+    // [+-]digits[.digits][(e|E)[+-]digits], with a digit required before the
+    // point and anything after the number in the token ignored. A token that
+    // does not start with a number reads as 0.
+    //
+    // Up to 19 significant digits and a power of ten within 1e22 convert with a
+    // single exact multiply or divide, which rounds correctly; longer numbers
+    // and larger exponents go through strtod.
+    const char* ParseFloat(const char* p, const char* end, float& value)
+    {
+        p = SkipBlanks(p, end);
+
+        const char* tokenEnd = p;
+        while (tokenEnd < end && !IsBlank(*tokenEnd) && *tokenEnd != '\r')
+            ++tokenEnd;
+
+        value = 0.0f;
+
+        const char* s = p;
+        bool negative = false;
+
+        if (s < tokenEnd && (*s == '+' || *s == '-')) {
+            negative = *s == '-';
+            ++s;
+        }
+
+        if (s == tokenEnd || !IsDigit(*s))
+            return tokenEnd;
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool fastPath = true;
+
+        auto accumulate = [&](int digit) {
+            if (mantissa == 0 && digit == 0)
+                return;
+
+            if (digits == 19) {
+                fastPath = false;
+                return;
+            }
+
+            mantissa = mantissa * 10 + digit;
+            digits++;
+        };
+
+        for (; s < tokenEnd && IsDigit(*s); ++s)
+            accumulate(*s - '0');
+
+        if (s < tokenEnd && *s == '.') {
+            for (++s; s < tokenEnd && IsDigit(*s); ++s) {
+                accumulate(*s - '0');
+                exponent--;
+            }
+        }
+
+        if (s < tokenEnd && (*s == 'e' || *s == 'E')) {
+            ++s;
+
+            bool negativeExponent = false;
+
+            if (s < tokenEnd && (*s == '+' || *s == '-')) {
+                negativeExponent = *s == '-';
+                ++s;
+            }
+
+            // An exponent without digits makes the whole token invalid.
+            if (s == tokenEnd || !IsDigit(*s))
+                return tokenEnd;
+
+            int explicitExponent = 0;
+
+            for (; s < tokenEnd && IsDigit(*s); ++s) {
+                if (explicitExponent < 100000)
+                    explicitExponent = explicitExponent * 10 + (*s - '0');
+            }
+
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+
+        double result;
+
+        if (fastPath && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            result = static_cast<double>(mantissa);
+            result = exponent < 0 ? result / kPowersOfTen[-exponent] : result * kPowersOfTen[exponent];
+
+            if (negative)
+                result = -result;
+        }
+        else {
+            const std::string number(p, s);
+            result = strtod(number.c_str(), nullptr);
+        }
+
+        value = static_cast<float>(result);
+        return tokenEnd;
+    }
+
+    // Face indices are read with atoi.
+    int ParseInt(const char*& p, const char* end)
+    {
+        bool negative = false;
+
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative = *p == '-';
+            ++p;
+        }
+
+        int value = 0;
+
+        for (; p < end && IsDigit(*p); ++p)
+            value = value * 10 + (*p - '0');
+
+        return negative ? -value : value;
+    }
+
+    inline const char* SkipToSeparator(const char* p, const char* end)
+    {
+        while (p < end && *p != '/' && !IsBlank(*p) && *p != '\r')
+            ++p;
+        return p;
+    }
+
+    // One face corner: v, v/vt, v//vn or v/vt/vn.
+    ObjIndex ParseCorner(const char*& p, const char* end, const ObjChunk& chunk, unsigned char& relative)
+    {
+        ObjIndex corner = { -1, -1, -1 };
+        relative = 0;
+
+        // As tinyobjloader's fixIndex, but relative indices only count this chunk's elements.
+        auto fix = [&relative](int index, size_t count, unsigned char component) {
+            if (index > 0)
+                return index - 1;
+            if (index == 0)
+                return 0;
+
+            relative |= component;
+            return static_cast<int>(count) + index;
+        };
+
+        corner.vertex = fix(ParseInt(p, end), chunk.positions.size() / 3, kRelativeVertex);
+        p = SkipToSeparator(p, end);
+
+        if (p == end || *p != '/')
+            return corner;
+
+        ++p;
+
+        if (p < end && *p == '/') {
+            ++p;
+            corner.normal = fix(ParseInt(p, end), chunk.normals.size() / 3, kRelativeNormal);
+            p = SkipToSeparator(p, end);
+            return corner;
+        }
+
+        corner.texcoord = fix(ParseInt(p, end), chunk.texcoords.size() / 2, kRelativeTexcoord);
+        p = SkipToSeparator(p, end);
+
+        if (p == end || *p != '/')
+            return corner;
+
+        ++p;
+        corner.normal = fix(ParseInt(p, end), chunk.normals.size() / 3, kRelativeNormal);
+        p = SkipToSeparator(p, end);
+
+        return corner;
+    }
+
+    void ParseChunk(ObjChunk& chunk)
+    {
+        std::vector<ObjIndex> face;
+        std::vector<unsigned char> faceRelative;
+
+        // Typical exporters write about 30 bytes per line.
+        const size_t lineEstimate = (chunk.end - chunk.begin) / 30;
+        chunk.positions.reserve(lineEstimate * 3 / 2);
+        chunk.indices.reserve(lineEstimate * 3 / 2);
+
+        for (const char* line = chunk.begin; line < chunk.end;) {
+            const char* lineEnd = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+            const char* next = lineEnd ? lineEnd + 1 : chunk.end;
+
+            if (!lineEnd)
+                lineEnd = chunk.end;
+            if (lineEnd > line && lineEnd[-1] == '\r')
+                --lineEnd;
+
+            const char* p = SkipBlanks(line, lineEnd);
+            line = next;
+
+            if (lineEnd - p < 2)
+                continue;
+
+            if (p[0] == 'v' && IsBlank(p[1])) {
+                float x, y, z;
+                p = ParseFloat(p + 2, lineEnd, x);
+                p = ParseFloat(p, lineEnd, y);
+                ParseFloat(p, lineEnd, z);
+
+                chunk.positions.push_back(x);
+                chunk.positions.push_back(y);
+                chunk.positions.push_back(z);
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2])) {
+                float x, y, z;
+                p = ParseFloat(p + 3, lineEnd, x);
+                p = ParseFloat(p, lineEnd, y);
+                ParseFloat(p, lineEnd, z);
+
+                chunk.normals.push_back(x);
+                chunk.normals.push_back(y);
+                chunk.normals.push_back(z);
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && IsBlank(p[2])) {
+                float u, v;
+                p = ParseFloat(p + 3, lineEnd, u);
+                ParseFloat(p, lineEnd, v);
+
+                chunk.texcoords.push_back(u);
+                chunk.texcoords.push_back(v);
+            }
+            else if (p[0] == 'f' && IsBlank(p[1])) {
+                face.clear();
+                faceRelative.clear();
+
+                p = SkipBlanks(p + 2, lineEnd);
+
+                while (p < lineEnd && *p != '\r' && *p != '\0') {
+                    unsigned char relative;
+                    face.push_back(ParseCorner(p, lineEnd, chunk, relative));
+                    faceRelative.push_back(relative);
+
+                    while (p < lineEnd && (IsBlank(*p) || *p == '\r'))
+                        ++p;
+                }
+
+                for (size_t k = 2; k < face.size(); ++k) {
+                    for (size_t corner : { size_t(0), k - 1, k }) {
+                        if (faceRelative[corner])
+                            chunk.relativeIndices.emplace_back(chunk.indices.size(), faceRelative[corner]);
+
+                        chunk.indices.push_back(face[corner]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool StereopsisBlockStackingPlayer::LoadObjMesh(const std::string& path, ObjMesh& mesh, std::string* err, unsigned threadCount)
+{
+    mesh = ObjMesh();
+
+    MappedFile file;
+
+    if (!file.Open(path)) {
+        if (err)
+            *err += "Cannot open file [" + path + "]\n";
+        return false;
+    }
+
+    if (!threadCount)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    const char* data = file.GetData();
+    const char* dataEnd = data + file.GetSize();
+
+    const size_t chunkSize = std::max(kMinChunkSize, file.GetSize() / (threadCount * kChunksPerThread) + 1);
+    std::vector<ObjChunk> chunks;
+
+    for (const char* begin = data; begin < dataEnd;) {
+        const char* end = begin + std::min(chunkSize, static_cast<size_t>(dataEnd - begin));
+        const char* newline = static_cast<const char*>(memchr(end, '\n', dataEnd - end));
+        end = newline ? newline + 1 : dataEnd;
+
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+
+        begin = end;
+    }
+
+    ParallelFor(chunks.size(), threadCount, [&](size_t i) { ParseChunk(chunks[i]); });
+
+    // Each chunk starts where the ones before it end.
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+    size_t indexCount = 0;
+
+    for (ObjChunk& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        chunk.texcoordBase = texcoordCount;
+        chunk.indexBase = indexCount;
+
+        positionCount += chunk.positions.size();
+        normalCount += chunk.normals.size();
+        texcoordCount += chunk.texcoords.size();
+        indexCount += chunk.indices.size();
+    }
+
+    mesh.positions.resize(positionCount);
+    mesh.normals.resize(normalCount);
+    mesh.texcoords.resize(texcoordCount);
+    mesh.indices.resize(indexCount);
+
+    ParallelFor(chunks.size(), threadCount, [&](size_t i) {
+        const ObjChunk& chunk = chunks[i];
+
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + chunk.positionBase);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + chunk.normalBase);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), mesh.texcoords.begin() + chunk.texcoordBase);
+        std::copy(chunk.indices.begin(), chunk.indices.end(), mesh.indices.begin() + chunk.indexBase);
+
+        for (const auto& relativeIndex : chunk.relativeIndices) {
+            ObjIndex& index = mesh.indices[chunk.indexBase + relativeIndex.first];
+
+            if (relativeIndex.second & kRelativeVertex)
+                index.vertex += static_cast<int>(chunk.positionBase / 3);
+            if (relativeIndex.second & kRelativeTexcoord)
+                index.texcoord += static_cast<int>(chunk.texcoordBase / 2);
+            if (relativeIndex.second & kRelativeNormal)
+                index.normal += static_cast<int>(chunk.normalBase / 3);
+        }
+    });
+
+    return true;
+}
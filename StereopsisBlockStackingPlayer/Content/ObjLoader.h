@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace StereopsisBlockStackingPlayer
+{
+    // Corner of an OBJ face, as zero-based indices into ObjMesh's arrays; -1
+    // where the face leaves one out.
+    struct ObjIndex
+    {
+        int vertex;
+        int texcoord;
+        int normal;
+    };
+
+    // Geometry of an OBJ file, laid out like tinyobj::attrib_t and the shapes'
+    // mesh indices.
+    struct ObjMesh
+    {
+        std::vector<float> positions;   // x, y, z per 'v'
+        std::vector<float> normals;     // x, y, z per 'vn'
+        std::vector<float> texcoords;   // u, v per 'vt'
+
+        // Three per triangle in file order across every group; polygons are
+        // fanned from their first corner, as tinyobj triangulates them.
+        std::vector<ObjIndex> indices;
+    };
+
+    // Loads the geometry of an OBJ file, giving the same numbers as
+    // tinyobj::LoadObj. The file is memory-mapped and split into line-aligned
+    // chunks that are parsed in parallel, then stitched together; relative
+    // indices are resolved once every chunk's vertex count is known. Groups,
+    // smoothing groups and materials are not read. threadCount 0 uses every
+    // hardware thread.
+    bool LoadObjMesh(const std::string& path, ObjMesh& mesh, std::string* err = nullptr, unsigned threadCount = 0);
+}
@@ -3,21 +3,36 @@
 #include "..\Common\DeviceResources.h"
 #include "..\Common\StepTimer.h"
 #include "ShaderStructures.h"
+#include "MeshAssetCache.h"
 #include "LPGL\lpgl.h"
 
 #include <DirectXCollision.h>
 
+#include <memory>
+#include <vector>
+
 namespace StereopsisBlockStackingPlayer
 {
     // This sample renderer instantiates a basic rendering pipeline.
     class SpinningCubeRenderer
     {
     public:
-        SpinningCubeRenderer();
+        SpinningCubeRenderer(const std::shared_ptr<MeshAssetCache>& meshAssets);
         void CreateDeviceDependentResources();
         void ReleaseDeviceDependentResources();
         void Update(const DX::StepTimer& timer);
-        void Render();
+
+        // Shows the last step's position as is, for a step that jumps rather
+        // than moves.
+        void SkipInterpolation() { m_previousPosition = m_lastStepPosition; }
+
+        // Renders the mesh between its last two simulated positions; interpolation
+        // is the fraction of a fixed update elapsed since the last one.
+        void Render(float interpolation = 1.0f);
+
+        // Renders all visible meshes with one stereo-instanced draw per mesh
+        // asset and representation (in focus or out of focus).
+        static void RenderBatch(const std::vector<std::unique_ptr<SpinningCubeRenderer>>& renderers, float interpolation = 1.0f);
 
         // Property accessors.
         void SetPosition(Windows::Foundation::Numerics::float3 pos) { m_position = pos;  }
@@ -29,19 +44,17 @@ namespace StereopsisBlockStackingPlayer
         bool IsOutFocused = true;
 
     private:
-        DirectX::BoundingBox initialBoundingBox;
-
-        GLuint vertexBuffer;
-        GLuint indexBuffer;
-
-        uint32                                          m_indexCount = 0;
+        // Interpolated position, applied per instance.
+        DirectX::XMFLOAT4X4 GetInstanceTransform(float interpolation) const;
 
-        GLuint outFocusVertexBuffer;
-        GLuint outFocusIndexBuffer;
+        std::shared_ptr<MeshAssetCache>                 m_meshAssets;
 
-        uint32                                          m_indexCountOutFocused = 0;
+        // Shared with every renderer of the same asset; set once loading completes.
+        std::shared_ptr<const MeshAsset>                m_mesh;
 
         bool                                            m_loadingComplete = false;
         Windows::Foundation::Numerics::float3           m_position = { 0.f, 0.f, -2.f };
+        Windows::Foundation::Numerics::float3           m_previousPosition = { 0.f, 0.f, -2.f };
+        Windows::Foundation::Numerics::float3           m_lastStepPosition = { 0.f, 0.f, -2.f };
     };
 }
@@ -16,6 +16,12 @@ struct VertexShaderInput
     min16float3 pos     : POSITION;
     min16float3 color   : COLOR0;
     uint        instId  : SV_InstanceID;
+
+    // Per-instance model matrix rows; advances once per stereo pair of instances.
+    float4      instanceTransform0 : INSTANCE_TRANSFORM0;
+    float4      instanceTransform1 : INSTANCE_TRANSFORM1;
+    float4      instanceTransform2 : INSTANCE_TRANSFORM2;
+    float4      instanceTransform3 : INSTANCE_TRANSFORM3;
 };
 
 // Per-vertex data passed to the geometry shader.
@@ -39,7 +45,14 @@ VertexShaderOutput main(VertexShaderInput input)
     // instance would be drawn, one for left and one for right.
     int idx = input.instId % 2;
 
-    // Transform the vertex position into world space.
+    // Transform the vertex position into world space: the instance's own
+    // transform first, then the model transform shared by the whole draw.
+    float4x4 instanceTransform = float4x4(
+        input.instanceTransform0,
+        input.instanceTransform1,
+        input.instanceTransform2,
+        input.instanceTransform3);
+    pos = mul(pos, instanceTransform);
     pos = mul(pos, model);
 
     // Correct for perspective and project the vertex position onto the screen.
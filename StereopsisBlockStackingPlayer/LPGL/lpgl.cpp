@@ -1,321 +1,1095 @@
 #include "pch.h"
 #include "lpgl.h"
+#include "lpglBackend.h"
+#include "lpglCull.h"
+#include "lpglDrawSort.h"
+#include "lpglSlotMap.h"
+#include "lpglStatistics.h"
 
-#include "Content\ShaderStructures.h"
-#include "Common\DirectXHelper.h"
+#ifdef _WIN32
+#include "lpglD3D11Backend.h"
+#endif
 
-#include <stack>
-#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 using namespace DirectX;
-using namespace Concurrency;
 
-static std::shared_ptr<DX::DeviceResources> gDeviceResources;
+struct lpglBufferObject {
+	GLsizei size = 0;
+	GLenum target = GL_ARRAY_BUFFER;
+	GLenum usage = GL_STATIC_DRAW;
+
+	// Whether the backend has storage for the buffer, and whether creating it
+	// waits for the first write because it was specified without data.
+	bool hasStorage = false;
+	bool storageDeferred = false;
 
-struct __lpglBuffer {
-	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	// Memory handed out by glMapBufferRange until glUnmapBuffer.
+	std::unique_ptr<unsigned char[]> mapping;
+	GLsizei mapOffset = 0;
+	GLsizei mapLength = 0;
+	GLbitfield mapAccess = 0;
 };
 
-static struct lpglContext {
-	std::stack<XMFLOAT4X4> transform;
+// Vertex input: the buffers draws read and the layout of their vertices. Each
+// context has a current one, and vertex array objects store one.
+struct lpglVertexArrayObject {
+	GLuint arrayBuffer = 0;
+	GLuint elementArrayBuffer = 0;
 
-	Microsoft::WRL::ComPtr<ID3D11InputLayout>       m_inputLayout;
-	Microsoft::WRL::ComPtr<ID3D11VertexShader>      m_vertexShader;
-	Microsoft::WRL::ComPtr<ID3D11GeometryShader>    m_geometryShader;
-	Microsoft::WRL::ComPtr<ID3D11PixelShader>       m_pixelShader;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> modelConstantBuffer;
+	GLenum positionType = GL_FLOAT;
+	GLenum colorType = GL_FLOAT;
+	XMFLOAT3 positionBoundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	XMFLOAT3 positionBoundsMax = XMFLOAT3(1.0f, 1.0f, 1.0f);
+};
 
-	bool                                            m_usingVprtShaders = false;
+// State shared by every context: buffer and vertex array names, the backend
+// and flush settings.
+static struct lpglSharedState {
+	lpglSharedState();
 
-	ModelConstantBuffer modelConstantBufferData;
+	// Buffers are generated and filled from loader threads.
+	std::mutex buffersMutex;
+	lpglSlotMap<lpglBufferObject> buffers;
 
-	GLuint idGen = 1;
+	std::mutex vertexArraysMutex;
+	lpglSlotMap<lpglVertexArrayObject> vertexArrays;
 
-	void Initialize();
+	std::unique_ptr<lpglBackend> backend;
 
-	GLuint activeArrayBuffer = -1;
-	GLuint activeElementArrayBuffer = -1;
+	bool drawSorting = true;
+	lpglDrawSorter drawSorter;
+	XMFLOAT4X4 viewProjection;
 
-	std::unordered_map<GLuint, __lpglBuffer*> buffers;
-} gLpglContext;
+	// Off until lpglSetCullingViewProjections gives the culler its frusta.
+	bool culling = false;
+	lpglFrustumCuller culler;
 
-void lpglContext::Initialize()
-{
-	const CD3D11_BUFFER_DESC constantBufferDesc(sizeof(ModelConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-	lpglGetDeviceResources().GetD3DDevice()->CreateBuffer(
-		&constantBufferDesc,
-		nullptr,
-		&modelConstantBuffer
-	);
+	// Contexts from lpglCreateContext in creation order, which is the order
+	// their command lists are submitted in. Also guards their closed lists.
+	std::mutex contextsMutex;
+	std::vector<lpglContext*> contexts;
 
-	m_usingVprtShaders = lpglGetDeviceResources().GetDeviceSupportsVprt();
+	// The lists of one flush, rebuilt every flush.
+	std::vector<lpglCommandBuffer*> commandLists;
 
-	std::wstring vertexShaderFileName = m_usingVprtShaders ? L"ms-appx:///VprtVertexShader.cso" : L"ms-appx:///VertexShader.cso";
+	// Creates storage deferred by glBufferData, contents undefined. Called with
+	// buffersMutex held.
+	void CommitDeferredStorage(GLuint buffer, lpglBufferObject& bufferObject)
+	{
+		if (!bufferObject.storageDeferred)
+			return;
 
-	task<std::vector<byte>> loadVSTask = DX::ReadDataAsync(vertexShaderFileName);
-	task<std::vector<byte>> loadPSTask = DX::ReadDataAsync(L"ms-appx:///PixelShader.cso");
+		backend->BufferData(buffer, bufferObject.target, bufferObject.size, nullptr, bufferObject.usage);
+		lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+		bufferObject.hasStorage = true;
+		bufferObject.storageDeferred = false;
+	}
 
-	task<std::vector<byte>> loadGSTask;
-	if (!m_usingVprtShaders)
+	bool IsBufferName(GLuint buffer)
 	{
-		loadGSTask = DX::ReadDataAsync(L"ms-appx:///GeometryShader.cso");
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		return buffers.IsValid(buffer);
 	}
 
-	task<void> createVSTask = loadVSTask.then([this](const std::vector<byte>& fileData)
+	// Stores the vertex input into a vertex array and lets the backend prepare it.
+	void StoreVertexArray(GLuint array, const lpglVertexArrayObject& vertexInput)
 	{
-		DX::ThrowIfFailed(
-			lpglGetDeviceResources().GetD3DDevice()->CreateVertexShader(
-				fileData.data(),
-				fileData.size(),
-				nullptr,
-				&m_vertexShader
-			)
-		);
-
-		constexpr std::array<D3D11_INPUT_ELEMENT_DESC, 2> vertexDesc =
-		{ {
-			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-			{ "COLOR",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		} };
-
-		DX::ThrowIfFailed(
-			lpglGetDeviceResources().GetD3DDevice()->CreateInputLayout(
-				vertexDesc.data(),
-				static_cast<UINT>(vertexDesc.size()),
-				fileData.data(),
-				static_cast<UINT>(fileData.size()),
-				&m_inputLayout
-			)
-		);
-	});
-
-	task<void> createPSTask = loadPSTask.then([this](const std::vector<byte>& fileData)
+		{
+			std::lock_guard<std::mutex> lock(vertexArraysMutex);
+			lpglVertexArrayObject* vertexArray = vertexArrays.Get(array);
+
+			// Changing a deleted vertex array.
+			assert(vertexArray);
+
+			if (!vertexArray)
+				return;
+
+			*vertexArray = vertexInput;
+		}
+
+		const lpglVertexArrayDesc desc = {
+			vertexInput.arrayBuffer, vertexInput.elementArrayBuffer, vertexInput.positionType, vertexInput.colorType
+		};
+
+		backend->VertexArray(array, desc);
+	}
+} gLpglShared;
+
+// Recording state: the matrix stack, bindings, error and the commands recorded
+// since the last flush.
+struct lpglContext {
+	lpglContext();
+
+	// Composed in registers; converted to XMFLOAT4X4 only when a draw records it.
+	alignas(16) XMMATRIX matrixStack[LPGL_MAX_MATRIX_STACK_DEPTH];
+	int matrixStackTop = 0;
+
+	GLenum error = GL_NO_ERROR;
+
+	// Thread the context is current on, if any. Read by other threads to catch
+	// a context made current twice or destroyed while in use.
+	std::atomic<std::thread::id> owner;
+
+	// The current vertex input, and the vertex array it is stored into, if any.
+	lpglVertexArrayObject vertexInput;
+	GLuint vertexArray = 0;
+
+	lpglCommandBuffer commandBuffer;
+
+	// Commands closed by glFlush on a created context, waiting for the default
+	// context's glFlush. Guarded by lpglSharedState::contextsMutex.
+	lpglCommandBuffer closedCommands;
+
+	// Set when the top of the transform stack differs from the last recorded transform.
+	bool transformDirty = true;
+
+	// Empty means the single identity transform.
+	std::vector<XMFLOAT4X4> instanceTransforms;
+	bool instanceTransformsDirty = true;
+	GLuint recordedInstanceTransform = 0;
+	GLuint recordedInstanceTransformCount = 0;
+
+	GLuint color = 0xFFFFFFFF;
+
+	// Bounds from glDrawBounds for the next draw call.
+	bool hasDrawBounds = false;
+	lpglDrawBounds drawBounds;
+
+	XMMATRIX& Top() { return matrixStack[matrixStackTop]; }
+
+	// Maps normalized positions onto their bounds; applied before the instance transforms.
+	XMMATRIX PositionDecode() const
 	{
-		DX::ThrowIfFailed(
-			lpglGetDeviceResources().GetD3DDevice()->CreatePixelShader(
-				fileData.data(),
-				fileData.size(),
-				nullptr,
-				&m_pixelShader
-			)
-		);
-	});
-
-	task<void> createGSTask;
-	if (!m_usingVprtShaders)
+		const XMFLOAT3& min = vertexInput.positionBoundsMin;
+		const XMFLOAT3& max = vertexInput.positionBoundsMax;
+
+		return XMMatrixMultiply(
+			XMMatrixScaling(max.x - min.x, max.y - min.y, max.z - min.z),
+			XMMatrixTranslation(min.x, min.y, min.z));
+	}
+
+	void SetVertexInput(const lpglVertexArrayObject& newVertexInput)
 	{
-		createGSTask = loadGSTask.then([this](const std::vector<byte>& fileData)
-		{
-			DX::ThrowIfFailed(
-				lpglGetDeviceResources().GetD3DDevice()->CreateGeometryShader(
-					fileData.data(),
-					fileData.size(),
-					nullptr,
-					&m_geometryShader
-				)
-			);
-		});
+		const bool normalized = newVertexInput.positionType == GL_UNSIGNED_SHORT;
+
+		// Normalized positions are decoded by the recorded instance transforms.
+		if (normalized != (vertexInput.positionType == GL_UNSIGNED_SHORT) ||
+			(normalized && (memcmp(&newVertexInput.positionBoundsMin, &vertexInput.positionBoundsMin, sizeof(XMFLOAT3)) != 0 ||
+				memcmp(&newVertexInput.positionBoundsMax, &vertexInput.positionBoundsMax, sizeof(XMFLOAT3)) != 0)))
+			instanceTransformsDirty = true;
+
+		vertexInput = newVertexInput;
+	}
+
+	// Changes the current vertex input, and the bound vertex array with it.
+	void ChangeVertexInput(const lpglVertexArrayObject& newVertexInput)
+	{
+		SetVertexInput(newVertexInput);
+
+		if (vertexArray)
+			gLpglShared.StoreVertexArray(vertexArray, vertexInput);
+	}
+
+	// GL post-multiplies: the new operation applies to vertices first.
+	void Apply(FXMMATRIX m)
+	{
+		Top() = XMMatrixMultiply(m, Top());
+		transformDirty = true;
 	}
+
+	GLuint GetBoundBuffer(GLenum target) const
+	{
+		switch (target) {
+		case GL_ARRAY_BUFFER:
+			return vertexInput.arrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return vertexInput.elementArrayBuffer;
+		default:
+			return 0;
+		}
+	}
+
+	void RecordBufferUpdate(GLuint buffer, GLsizei offset, GLsizei size, const GLvoid* data, bool orphan)
+	{
+		lpglCommand command;
+		command.type = LPGL_COMMAND_BUFFER_SUB_DATA;
+
+		lpglBufferSubDataCommand& update = command.bufferSubData;
+		update.buffer = buffer;
+		update.offset = offset;
+		update.size = size;
+		update.payloadOffset = static_cast<GLuint>(commandBuffer.payload.size());
+		update.hasData = data != nullptr;
+		update.orphan = orphan;
+
+		if (data) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			commandBuffer.payload.insert(commandBuffer.payload.end(), bytes, bytes + size);
+			lpglCount(LPGL_COUNTER_BYTES_UPLOADED, size);
+		}
+
+		commandBuffer.commands.push_back(command);
+	}
+
+	// Records the current transform and instance transforms, if they changed
+	// since the last draw.
+	void RecordTransforms()
+	{
+		if (transformDirty) {
+			XMFLOAT4X4 transform;
+			XMStoreFloat4x4(&transform, Top());
+			commandBuffer.transforms.push_back(transform);
+			transformDirty = false;
+		}
+
+		if (!instanceTransformsDirty)
+			return;
+
+		recordedInstanceTransform = static_cast<GLuint>(commandBuffer.instanceTransforms.size());
+
+		if (vertexInput.positionType == GL_UNSIGNED_SHORT) {
+			const XMMATRIX decode = PositionDecode();
+
+			if (instanceTransforms.empty()) {
+				XMFLOAT4X4 mat;
+				XMStoreFloat4x4(&mat, decode);
+				commandBuffer.instanceTransforms.push_back(mat);
+			}
+
+			for (const XMFLOAT4X4& instanceTransform : instanceTransforms) {
+				XMFLOAT4X4 mat;
+				XMStoreFloat4x4(&mat, XMMatrixMultiply(decode, XMLoadFloat4x4(&instanceTransform)));
+				commandBuffer.instanceTransforms.push_back(mat);
+			}
+		}
+		else if (instanceTransforms.empty()) {
+			XMFLOAT4X4 mat;
+			XMStoreFloat4x4(&mat, XMMatrixIdentity());
+			commandBuffer.instanceTransforms.push_back(mat);
+		}
+		else {
+			commandBuffer.instanceTransforms.insert(commandBuffer.instanceTransforms.end(),
+				instanceTransforms.begin(), instanceTransforms.end());
+		}
+
+		recordedInstanceTransformCount =
+			static_cast<GLuint>(commandBuffer.instanceTransforms.size()) - recordedInstanceTransform;
+		instanceTransformsDirty = false;
+	}
+
+	// Records the pending glDrawBounds bounds, once per draw call. Returns their
+	// index, or LPGL_NO_BOUNDS.
+	GLuint RecordBounds()
+	{
+		if (!hasDrawBounds)
+			return LPGL_NO_BOUNDS;
+
+		commandBuffer.bounds.push_back(drawBounds);
+		hasDrawBounds = false;
+		return static_cast<GLuint>(commandBuffer.bounds.size() - 1);
+	}
+
+	// Records a draw with the current bindings, after RecordTransforms.
+	void RecordDraw(GLenum mode, GLenum type, GLsizei count, GLsizei primcount, GLuint firstIndex, GLint baseVertex,
+		GLuint firstInstanceTransform, GLuint instanceTransformCount, GLuint bounds)
+	{
+		lpglCommand command;
+		command.type = LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED;
+
+		lpglDrawElementsCommand& draw = command.drawElements;
+		draw.mode = mode;
+		draw.type = type;
+		draw.count = count;
+		draw.primcount = primcount;
+		draw.firstIndex = firstIndex;
+		draw.baseVertex = baseVertex;
+		draw.arrayBuffer = vertexInput.arrayBuffer;
+		draw.elementArrayBuffer = vertexInput.elementArrayBuffer;
+		draw.vertexArray = vertexArray;
+		draw.positionType = vertexInput.positionType;
+		draw.colorType = vertexInput.colorType;
+		draw.color = color;
+		draw.transform = static_cast<GLuint>(commandBuffer.transforms.size() - 1);
+		draw.firstInstanceTransform = firstInstanceTransform;
+		draw.instanceTransformCount = instanceTransformCount;
+		draw.bounds = bounds;
+
+		commandBuffer.commands.push_back(command);
+
+		lpglCount(LPGL_COUNTER_DRAWS);
+		lpglCount(LPGL_COUNTER_INSTANCES, primcount);
+		if (mode == GL_TRIANGLES)
+			lpglCount(LPGL_COUNTER_TRIANGLES, static_cast<unsigned long long>(count / 3) * primcount);
+	}
+
+	// Starts a new command buffer; the first draw in it records the transforms again.
+	void ResetCommands()
+	{
+		// Clearing keeps the vectors' capacity, so steady-state frames record without allocating.
+		commandBuffer.Clear();
+		transformDirty = true;
+		instanceTransformsDirty = true;
+	}
+
+	void SetError(GLenum newError)
+	{
+		// As in GL, the first error sticks until it is queried.
+		if (error == GL_NO_ERROR)
+			error = newError;
+	}
+};
+
+// The context threads record into until they make another one current. Loader
+// threads share it with the rendering thread, as before contexts existed.
+static lpglContext gLpglDefaultContext;
+static thread_local lpglContext* gLpglCurrentContext = &gLpglDefaultContext;
+
+lpglSharedState::lpglSharedState()
+{
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+}
+
+lpglContext::lpglContext()
+{
+	matrixStack[0] = XMMatrixIdentity();
+}
+
+void lpglInit(std::unique_ptr<lpglBackend> backend)
+{
+	gLpglShared.backend = std::move(backend);
+	gLpglDefaultContext.ResetCommands();
 }
 
+lpglContext* lpglCreateContext()
+{
+	lpglContext* context = new lpglContext();
+
+	std::lock_guard<std::mutex> lock(gLpglShared.contextsMutex);
+	gLpglShared.contexts.push_back(context);
+
+	return context;
+}
+
+void lpglDestroyContext(lpglContext* context)
+{
+	if (!context)
+		return;
+
+	// Another thread would record through the deleted context.
+	assert(context->owner == std::thread::id() || context->owner == std::this_thread::get_id());
+
+	if (gLpglCurrentContext == context)
+		lpglMakeCurrent(nullptr);
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.contextsMutex);
+		auto& contexts = gLpglShared.contexts;
+		contexts.erase(std::remove(contexts.begin(), contexts.end(), context), contexts.end());
+	}
+
+	delete context;
+}
+
+void lpglMakeCurrent(lpglContext* context)
+{
+	// The default context is shared by every thread and has no owner.
+	if (gLpglCurrentContext != &gLpglDefaultContext)
+		gLpglCurrentContext->owner = std::thread::id();
+
+	if (context) {
+		assert(context->owner == std::thread::id());
+		context->owner = std::this_thread::get_id();
+	}
+
+	gLpglCurrentContext = context ? context : &gLpglDefaultContext;
+}
+
+lpglBackend& lpglGetBackend()
+{
+	return *gLpglShared.backend;
+}
+
+void lpglSetDrawSorting(bool enable)
+{
+	gLpglShared.drawSorting = enable;
+}
+
+void lpglSetViewProjection(const GLfloat* m)
+{
+	gLpglShared.viewProjection = *reinterpret_cast<const XMFLOAT4X4*>(m);
+}
+
+void lpglSetCullingViewProjections(const GLfloat* m)
+{
+	gLpglShared.culling = m != nullptr;
+
+	if (m)
+		gLpglShared.culler.SetViewProjections(reinterpret_cast<const XMFLOAT4X4*>(m));
+}
+
+#ifdef _WIN32
+static std::shared_ptr<DX::DeviceResources> gDeviceResources;
+
 void lpglInit(const std::shared_ptr<DX::DeviceResources>& deviceResources)
 {
 	gDeviceResources = deviceResources;
 
-	gLpglContext.Initialize();
+	lpglInit(std::make_unique<lpglD3D11Backend>(deviceResources));
 }
 
 DX::DeviceResources& lpglGetDeviceResources()
 {
 	return *gDeviceResources;
 }
+#endif
 
 void __lpglDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei primcount)
 {
-	auto context = lpglGetDeviceResources().GetD3DDeviceContext();
-
-    context->IASetInputLayout(gLpglContext.m_inputLayout.Get());
-
-	context->VSSetShader(
-		gLpglContext.m_vertexShader.Get(),
-		nullptr,
-		0
-	);
-	context->PSSetShader(
-		gLpglContext.m_pixelShader.Get(),
-		nullptr,
-		0
-	);
-
-    if (!gLpglContext.m_usingVprtShaders)
-    {
-        // On devices that do not support the D3D11_FEATURE_D3D11_OPTIONS3::
-        // VPAndRTArrayIndexFromAnyShaderFeedingRasterizer optional feature,
-        // a pass-through geometry shader is used to set the render target 
-        // array index.
-        context->GSSetShader(
-            gLpglContext.m_geometryShader.Get(),
-            nullptr,
-            0
-            );
-    }
-
-	XMStoreFloat4x4(
-		&gLpglContext.modelConstantBufferData.model,
-		XMMatrixTranspose(XMLoadFloat4x4(&gLpglContext.transform.top())));
-	context->UpdateSubresource(
-		gLpglContext.modelConstantBuffer.Get(),
-		0,
-		nullptr,
-		&gLpglContext.modelConstantBufferData,
-		0,
-		0
-	);
-	context->VSSetConstantBuffers(
-		0,
-		1,
-		gLpglContext.modelConstantBuffer.GetAddressOf()
-	);
-
-	const UINT stride = sizeof(VertexPositionColor);
-	const UINT offset = 0;
-	context->IASetVertexBuffers(
-		0,
-		1,
-		gLpglContext.buffers[gLpglContext.activeArrayBuffer]->buffer.GetAddressOf(),
-		&stride,
-		&offset
-	);
-
-	DXGI_FORMAT indexBufferFormat;
+	__lpglDrawElementsInstancedBaseVertex(mode, count, type, indices, primcount, 0);
+}
+
+void __lpglDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei primcount,
+	GLint basevertex)
+{
+	lpglTimerScope timer(LPGL_TIMER_DRAW);
+
+	lpglContext& context = *gLpglCurrentContext;
+
+	GLuint indexSize;
 
 	switch (type) {
 	case GL_UNSIGNED_SHORT:
-		indexBufferFormat = DXGI_FORMAT_R16_UINT;
+		indexSize = sizeof(unsigned short);
+		break;
+	case GL_UNSIGNED_INT:
+		indexSize = sizeof(unsigned int);
+		break;
+	default:
+		context.SetError(GL_INVALID_ENUM);
+		return;
 	}
 
-	context->IASetIndexBuffer(
-		gLpglContext.buffers[gLpglContext.activeElementArrayBuffer]->buffer.Get(),
-		indexBufferFormat,
-		0
-	);
+	context.RecordTransforms();
+
+	// Drawing from a deleted buffer.
+	assert(gLpglShared.IsBufferName(context.vertexInput.arrayBuffer));
+	assert(gLpglShared.IsBufferName(context.vertexInput.elementArrayBuffer));
+
+	// With an element array buffer bound, indices is a byte offset into it.
+	context.RecordDraw(mode, type, count, primcount, static_cast<GLuint>(reinterpret_cast<size_t>(indices) / indexSize),
+		basevertex, context.recordedInstanceTransform, context.recordedInstanceTransformCount, context.RecordBounds());
+}
+
+void __lpglMultiDrawElementsIndirect(GLenum mode, GLenum type, const void * indirect, GLsizei drawcount, GLsizei stride)
+{
+	lpglTimerScope timer(LPGL_TIMER_DRAW);
+
+	lpglContext& context = *gLpglCurrentContext;
 
-	switch (mode) {
-	case GL_TRIANGLES:
-		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	GLuint indexSize;
+
+	switch (type) {
+	case GL_UNSIGNED_SHORT:
+		indexSize = sizeof(unsigned short);
 		break;
+	case GL_UNSIGNED_INT:
+		indexSize = sizeof(unsigned int);
+		break;
+	default:
+		context.SetError(GL_INVALID_ENUM);
+		return;
 	}
 
-	context->DrawIndexedInstanced(
-		count,
-		primcount,
-		0,
-		0,
-		0
-	);
-}
+	if (drawcount < 0 || stride < 0 || stride % 4 != 0) {
+		context.SetError(GL_INVALID_VALUE);
+		return;
+	}
 
-void __lpglLoadIdentity() {
-	if (gLpglContext.transform.empty()) {
-		XMFLOAT4X4 mat;
-		XMStoreFloat4x4(&mat, XMMatrixIdentity());
-		gLpglContext.transform.push(mat);
+	if (stride == 0)
+		stride = sizeof(lpglDrawElementsIndirectCommand);
+
+	GLsizei elementArrayBufferSize;
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+		const lpglBufferObject* elementArrayBuffer = gLpglShared.buffers.Get(context.vertexInput.elementArrayBuffer);
+
+		// Drawing from a deleted or unbound buffer.
+		assert(elementArrayBuffer && gLpglShared.buffers.IsValid(context.vertexInput.arrayBuffer));
+
+		if (!elementArrayBuffer) {
+			context.SetError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		elementArrayBufferSize = elementArrayBuffer->size;
 	}
-	else {
-		XMFLOAT4X4 mat;
-		XMStoreFloat4x4(&mat, XMMatrixIdentity());
-		gLpglContext.transform.top() = mat;
+
+	context.RecordTransforms();
+
+	const GLuint bounds = context.RecordBounds();
+	const unsigned char* records = static_cast<const unsigned char*>(indirect);
+	const size_t indexCapacity = static_cast<size_t>(elementArrayBufferSize) / indexSize;
+
+	for (GLsizei i = 0; i < drawcount; ++i) {
+		lpglDrawElementsIndirectCommand record;
+		memcpy(&record, records + static_cast<size_t>(i) * stride, sizeof(record));
+
+		// As in GL, empty records draw nothing.
+		if (record.count == 0 || record.instanceCount == 0)
+			continue;
+
+		const GLuint instanceTransformCount = (record.instanceCount + LPGL_VIEW_COUNT - 1) / LPGL_VIEW_COUNT;
+
+		// Records reaching past the indices or the instance transforms are skipped.
+		if (static_cast<size_t>(record.firstIndex) + record.count > indexCapacity ||
+			static_cast<size_t>(record.baseInstance) + instanceTransformCount > context.recordedInstanceTransformCount) {
+			context.SetError(GL_INVALID_VALUE);
+			continue;
+		}
+
+		context.RecordDraw(mode, type, static_cast<GLsizei>(record.count), static_cast<GLsizei>(record.instanceCount),
+			record.firstIndex, record.baseVertex, context.recordedInstanceTransform + record.baseInstance, instanceTransformCount,
+			bounds);
 	}
 }
 
+void __lpglDrawBounds(const GLfloat* min, const GLfloat* max)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	context.drawBounds.center = XMFLOAT3((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f);
+	context.drawBounds.extents = XMFLOAT3((max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f, (max[2] - min[2]) * 0.5f);
+	context.hasDrawBounds = true;
+}
+
+void __lpglLoadIdentity() {
+	lpglContext& context = *gLpglCurrentContext;
+	context.Top() = XMMatrixIdentity();
+	context.transformDirty = true;
+}
+
+void __lpglLoadMatrixf(const GLfloat* m) {
+	lpglContext& context = *gLpglCurrentContext;
+	context.Top() = XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(m));
+	context.transformDirty = true;
+}
+
+void __lpglMultMatrixf(const GLfloat* m) {
+	lpglContext& context = *gLpglCurrentContext;
+	context.Apply(XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(m)));
+}
+
 void __lpglTranslatef(float x, float y, float z) {
-	if (gLpglContext.transform.empty()) {
-		XMFLOAT4X4 mat;
-		XMStoreFloat4x4(&mat, XMMatrixTranslation(x, y, z));
-		gLpglContext.transform.push(mat);
-	}
-	else {
-		XMStoreFloat4x4(&gLpglContext.transform.top(),
-			XMMatrixMultiply(
-				XMLoadFloat4x4(&gLpglContext.transform.top()),
-				XMMatrixTranslation(x, y, z)
-			));
-	}
+	lpglContext& context = *gLpglCurrentContext;
+	context.Apply(XMMatrixTranslation(x, y, z));
 }
 
 void __lpglScalef(float x, float y, float z) {
-	if (gLpglContext.transform.empty()) {
-		XMFLOAT4X4 mat;
-		XMStoreFloat4x4(&mat, XMMatrixScaling(x, y, z));
-		gLpglContext.transform.push(mat);
+	lpglContext& context = *gLpglCurrentContext;
+	context.Apply(XMMatrixScaling(x, y, z));
+}
+
+void __lpglRotatef(float angle, float x, float y, float z) {
+	lpglContext& context = *gLpglCurrentContext;
+	context.Apply(XMMatrixRotationAxis(XMVectorSet(x, y, z, 0.0f), XMConvertToRadians(angle)));
+}
+
+void __lpglPushMatrix() {
+	lpglContext& context = *gLpglCurrentContext;
+
+	if (context.matrixStackTop + 1 == LPGL_MAX_MATRIX_STACK_DEPTH) {
+		context.SetError(GL_STACK_OVERFLOW);
+		return;
 	}
-	else {
-		XMStoreFloat4x4(&gLpglContext.transform.top(),
-			XMMatrixMultiply(
-				XMLoadFloat4x4(&gLpglContext.transform.top()),
-				XMMatrixScaling(x, y, z)
-			));
+
+	context.matrixStack[context.matrixStackTop + 1] = context.Top();
+	context.matrixStackTop++;
+}
+
+void __lpglPopMatrix() {
+	lpglContext& context = *gLpglCurrentContext;
+
+	if (context.matrixStackTop == 0) {
+		context.SetError(GL_STACK_UNDERFLOW);
+		return;
 	}
+
+	context.matrixStackTop--;
+	context.transformDirty = true;
+}
+
+GLenum __lpglGetError() {
+	lpglContext& context = *gLpglCurrentContext;
+
+	GLenum error = context.error;
+	context.error = GL_NO_ERROR;
+
+	return error;
 }
 
 void __lpglGenBuffers(GLsizei n, GLuint * buffers)
 {
+	std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+
 	for (int i = 0; i < n; ++i) {
-		buffers[i] = gLpglContext.idGen++;
+		buffers[i] = gLpglShared.buffers.Allocate();
 	}
 }
 
+void __lpglDeleteBuffers(GLsizei n, const GLuint * buffers)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	lpglVertexArrayObject vertexInput = context.vertexInput;
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+
+		for (int i = 0; i < n; ++i) {
+			// As in GL, 0 is ignored.
+			if (buffers[i] == 0)
+				continue;
+
+			// Deleting a mapped buffer unmaps it.
+			if (lpglBufferObject* bufferObject = gLpglShared.buffers.Get(buffers[i]))
+				bufferObject->mapping.reset();
+
+			bool freed = gLpglShared.buffers.Free(buffers[i]);
+
+			// Deleting a buffer twice.
+			assert(freed);
+
+			if (!freed)
+				continue;
+
+			if (vertexInput.arrayBuffer == buffers[i])
+				vertexInput.arrayBuffer = 0;
+			if (vertexInput.elementArrayBuffer == buffers[i])
+				vertexInput.elementArrayBuffer = 0;
+
+			gLpglShared.backend->DeleteBuffer(buffers[i]);
+		}
+	}
+
+	// As in GL, the bound vertex array lets go of them too; others keep the stale names.
+	if (vertexInput.arrayBuffer != context.vertexInput.arrayBuffer ||
+		vertexInput.elementArrayBuffer != context.vertexInput.elementArrayBuffer)
+		context.ChangeVertexInput(vertexInput);
+}
+
 void __lpglBindBuffer(GLenum target, GLuint buffer)
 {
+	lpglContext& context = *gLpglCurrentContext;
+
+	// Binding a deleted buffer.
+	assert(buffer == 0 || gLpglShared.IsBufferName(buffer));
+
+	lpglVertexArrayObject vertexInput = context.vertexInput;
+
 	switch (target) {
 	case GL_ARRAY_BUFFER:
-		gLpglContext.activeArrayBuffer = buffer;
+		vertexInput.arrayBuffer = buffer;
 		break;
 	case GL_ELEMENT_ARRAY_BUFFER:
-		gLpglContext.activeElementArrayBuffer = buffer;
+		vertexInput.elementArrayBuffer = buffer;
 		break;
+	default:
+		return;
 	}
 
-	if (gLpglContext.buffers.find(buffer) == gLpglContext.buffers.end()) {
-		gLpglContext.buffers.insert_or_assign(buffer, new __lpglBuffer());
-	}
+	context.ChangeVertexInput(vertexInput);
 }
 
 void __lpglBufferData(GLenum target, GLsizei size, const GLvoid* data, GLenum usage)
 {
-	GLuint activeArrayBufferID = 0;
-	D3D11_BIND_FLAG bindFlag;
+	lpglTimerScope timer(LPGL_TIMER_BUFFER);
+
+	lpglContext& context = *gLpglCurrentContext;
 
 	switch (target) {
 	case GL_ARRAY_BUFFER:
-		activeArrayBufferID = gLpglContext.activeArrayBuffer;
-		bindFlag = D3D11_BIND_VERTEX_BUFFER;
-		break;
 	case GL_ELEMENT_ARRAY_BUFFER:
-		activeArrayBufferID = gLpglContext.activeElementArrayBuffer;
-		bindFlag = D3D11_BIND_INDEX_BUFFER;
 		break;
+	default:
+		return;
 	}
 
-	auto bufIter = gLpglContext.buffers.find(activeArrayBufferID);
+	GLuint activeBufferID = context.GetBoundBuffer(target);
+	bool orphan;
+	bool defer;
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+		lpglBufferObject* bufferObject = gLpglShared.buffers.Get(activeBufferID);
+
+		// Specifying storage for a deleted or unbound buffer.
+		assert(bufferObject);
+
+		if (!bufferObject)
+			return;
+
+		if (bufferObject->mapping) {
+			context.SetError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		orphan = bufferObject->hasStorage && size > 0 && bufferObject->size == size &&
+			bufferObject->target == target && bufferObject->usage == usage;
+		defer = !data && !orphan && !bufferObject->hasStorage;
+
+		bufferObject->size = size;
+		bufferObject->target = target;
+		bufferObject->usage = usage;
+		bufferObject->storageDeferred = defer;
+		bufferObject->hasStorage = !defer;
+	}
+
+	if (orphan)
+		context.RecordBufferUpdate(activeBufferID, 0, size, data, true);
+	else if (!defer) {
+		gLpglShared.backend->BufferData(activeBufferID, target, size, data, usage);
+
+		lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+		if (data)
+			lpglCount(LPGL_COUNTER_BYTES_UPLOADED, size);
+	}
+}
+
+void __lpglBufferSubData(GLenum target, GLsizei offset, GLsizei size, const GLvoid* data)
+{
+	lpglTimerScope timer(LPGL_TIMER_BUFFER);
+
+	lpglContext& context = *gLpglCurrentContext;
+
+	GLuint activeBufferID = context.GetBoundBuffer(target);
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+		lpglBufferObject* bufferObject = gLpglShared.buffers.Get(activeBufferID);
+
+		// Updating a deleted or unbound buffer.
+		assert(bufferObject);
+
+		if (!bufferObject)
+			return;
+
+		if (offset < 0 || size < 0 || offset + size > bufferObject->size || !data) {
+			context.SetError(GL_INVALID_VALUE);
+			return;
+		}
+
+		if (bufferObject->mapping) {
+			context.SetError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		gLpglShared.CommitDeferredStorage(activeBufferID, *bufferObject);
+	}
+
+	if (size > 0)
+		context.RecordBufferUpdate(activeBufferID, offset, size, data, false);
+}
+
+void* __lpglMapBufferRange(GLenum target, GLsizei offset, GLsizei length, GLbitfield access)
+{
+	lpglTimerScope timer(LPGL_TIMER_BUFFER);
+
+	lpglContext& context = *gLpglCurrentContext;
+
+	GLuint activeBufferID = context.GetBoundBuffer(target);
+
+	std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+	lpglBufferObject* bufferObject = gLpglShared.buffers.Get(activeBufferID);
+
+	// Mapping a deleted or unbound buffer.
+	assert(bufferObject);
+
+	if (!bufferObject)
+		return nullptr;
+
+	if (offset < 0 || length <= 0 || offset + length > bufferObject->size) {
+		context.SetError(GL_INVALID_VALUE);
+		return nullptr;
+	}
+
+	if (!(access & GL_MAP_WRITE_BIT) || bufferObject->mapping) {
+		context.SetError(GL_INVALID_OPERATION);
+		return nullptr;
+	}
+
+	// Left uninitialized: the caller is about to overwrite all of it.
+	bufferObject->mapping.reset(new unsigned char[length]);
+	bufferObject->mapOffset = offset;
+	bufferObject->mapLength = length;
+	bufferObject->mapAccess = access;
+
+	return bufferObject->mapping.get();
+}
+
+GLboolean __lpglUnmapBuffer(GLenum target)
+{
+	lpglTimerScope timer(LPGL_TIMER_BUFFER);
+
+	lpglContext& context = *gLpglCurrentContext;
+
+	GLuint activeBufferID = context.GetBoundBuffer(target);
+
+	std::unique_ptr<unsigned char[]> mapping;
+	GLsizei offset;
+	GLsizei length;
+	bool orphan;
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.buffersMutex);
+		lpglBufferObject* bufferObject = gLpglShared.buffers.Get(activeBufferID);
+
+		// Unmapping a deleted or unbound buffer.
+		assert(bufferObject);
+
+		if (!bufferObject)
+			return false;
+
+		if (!bufferObject->mapping) {
+			context.SetError(GL_INVALID_OPERATION);
+			return false;
+		}
+
+		mapping = std::move(bufferObject->mapping);
+		offset = bufferObject->mapOffset;
+		length = bufferObject->mapLength;
+
+		const bool wholeBuffer = offset == 0 && length == bufferObject->size;
+
+		// The mapped memory becomes the initial data; nothing is recorded.
+		if (bufferObject->storageDeferred && wholeBuffer) {
+			gLpglShared.backend->BufferData(activeBufferID, bufferObject->target, bufferObject->size,
+				mapping.get(), bufferObject->usage);
+			lpglCount(LPGL_COUNTER_BUFFER_CREATIONS);
+			lpglCount(LPGL_COUNTER_BYTES_UPLOADED, bufferObject->size);
+			bufferObject->hasStorage = true;
+			bufferObject->storageDeferred = false;
+
+			return true;
+		}
+
+		gLpglShared.CommitDeferredStorage(activeBufferID, *bufferObject);
 
-	if (bufIter == gLpglContext.buffers.end())
+		orphan = wholeBuffer && (bufferObject->mapAccess & GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	context.RecordBufferUpdate(activeBufferID, offset, length, mapping.get(), orphan);
+
+	return true;
+}
+
+void __lpglInstanceTransforms(GLsizei count, const GLfloat* matrices)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	const XMFLOAT4X4* first = reinterpret_cast<const XMFLOAT4X4*>(matrices);
+
+	context.instanceTransforms.assign(first, first + count);
+	context.instanceTransformsDirty = true;
+}
+
+void __lpglGenVertexArrays(GLsizei n, GLuint * arrays)
+{
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.vertexArraysMutex);
+
+		for (int i = 0; i < n; ++i)
+			arrays[i] = gLpglShared.vertexArrays.Allocate();
+	}
+
+	// Backends see every vertex array from the start, holding the default state.
+	const lpglVertexArrayObject vertexInput;
+
+	for (int i = 0; i < n; ++i)
+		gLpglShared.StoreVertexArray(arrays[i], vertexInput);
+}
+
+void __lpglDeleteVertexArrays(GLsizei n, const GLuint * arrays)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	std::lock_guard<std::mutex> lock(gLpglShared.vertexArraysMutex);
+
+	for (int i = 0; i < n; ++i) {
+		// As in GL, 0 is ignored.
+		if (arrays[i] == 0)
+			continue;
+
+		bool freed = gLpglShared.vertexArrays.Free(arrays[i]);
+
+		// Deleting a vertex array twice.
+		assert(freed);
+
+		if (!freed)
+			continue;
+
+		if (context.vertexArray == arrays[i])
+			context.vertexArray = 0;
+
+		gLpglShared.backend->DeleteVertexArray(arrays[i]);
+	}
+}
+
+void __lpglBindVertexArray(GLuint array)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	if (array == 0) {
+		context.vertexArray = 0;
+		return;
+	}
+
+	lpglVertexArrayObject vertexInput;
+
+	{
+		std::lock_guard<std::mutex> lock(gLpglShared.vertexArraysMutex);
+		const lpglVertexArrayObject* vertexArray = gLpglShared.vertexArrays.Get(array);
+
+		// Binding a deleted vertex array.
+		assert(vertexArray);
+
+		if (!vertexArray) {
+			context.SetError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		vertexInput = *vertexArray;
+	}
+
+	context.SetVertexInput(vertexInput);
+	context.vertexArray = array;
+}
+
+void __lpglVertexFormat(GLenum positionType, GLenum colorType)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	switch (positionType) {
+	case GL_FLOAT:
+	case GL_HALF_FLOAT:
+	case GL_UNSIGNED_SHORT:
+		break;
+	default:
+		context.SetError(GL_INVALID_ENUM);
+		return;
+	}
+
+	switch (colorType) {
+	case GL_FLOAT:
+	case GL_UNSIGNED_BYTE:
+	case GL_NONE:
+		break;
+	default:
+		context.SetError(GL_INVALID_ENUM);
+		return;
+	}
+
+	lpglVertexArrayObject vertexInput = context.vertexInput;
+	vertexInput.positionType = positionType;
+	vertexInput.colorType = colorType;
+
+	context.ChangeVertexInput(vertexInput);
+}
+
+void __lpglVertexPositionBounds(const GLfloat* min, const GLfloat* max)
+{
+	lpglContext& context = *gLpglCurrentContext;
+
+	lpglVertexArrayObject vertexInput = context.vertexInput;
+	vertexInput.positionBoundsMin = XMFLOAT3(min[0], min[1], min[2]);
+	vertexInput.positionBoundsMax = XMFLOAT3(max[0], max[1], max[2]);
+
+	if (memcmp(&vertexInput.positionBoundsMin, &context.vertexInput.positionBoundsMin, sizeof(XMFLOAT3)) == 0 &&
+		memcmp(&vertexInput.positionBoundsMax, &context.vertexInput.positionBoundsMax, sizeof(XMFLOAT3)) == 0)
+		return;
+
+	context.ChangeVertexInput(vertexInput);
+}
+
+void __lpglColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+	auto channel = [](GLfloat value) {
+		return static_cast<GLuint>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	};
+
+	gLpglCurrentContext->color = channel(r) | (channel(g) << 8) | (channel(b) << 16) | 0xFF000000u;
+}
+
+void __lpglFlush()
+{
+	lpglTimerScope timer(LPGL_TIMER_FLUSH);
+
+	lpglContext& context = *gLpglCurrentContext;
+
+	std::lock_guard<std::mutex> lock(gLpglShared.contextsMutex);
+
+	// A created context only closes its list; it is submitted with the default
+	// context's next flush.
+	if (&context != &gLpglDefaultContext) {
+		context.closedCommands.Append(context.commandBuffer);
+		context.ResetCommands();
 		return;
+	}
+
+	lpglBackend& backend = *gLpglShared.backend;
+	lpglCommandBuffer& commandBuffer = context.commandBuffer;
+
+	if (backend.SupportsCommandLists()) {
+		// Each list is sorted on its own and replayed after the ones before it.
+		std::vector<lpglCommandBuffer*>& commandLists = gLpglShared.commandLists;
+		commandLists.clear();
+
+		if (!commandBuffer.commands.empty())
+			commandLists.push_back(&commandBuffer);
+
+		for (lpglContext* other : gLpglShared.contexts) {
+			if (!other->closedCommands.commands.empty())
+				commandLists.push_back(&other->closedCommands);
+		}
+
+		if (gLpglShared.culling) {
+			for (lpglCommandBuffer* commandList : commandLists)
+				gLpglShared.culler.Cull(*commandList);
+		}
+
+		if (gLpglShared.drawSorting) {
+			for (lpglCommandBuffer* commandList : commandLists)
+				lpglCount(LPGL_COUNTER_MERGED_DRAWS, gLpglShared.drawSorter.Sort(*commandList, gLpglShared.viewProjection));
+		}
+
+		if (!commandLists.empty())
+			backend.ExecuteCommandLists(commandLists.data(), commandLists.size());
+	}
+	else {
+		// Concatenated behind the default context's commands, so draws from
+		// different contexts can be sorted and merged together.
+		for (lpglContext* other : gLpglShared.contexts)
+			commandBuffer.Append(other->closedCommands);
+
+		if (gLpglShared.culling)
+			gLpglShared.culler.Cull(commandBuffer);
+
+		if (!commandBuffer.commands.empty()) {
+			if (gLpglShared.drawSorting)
+				lpglCount(LPGL_COUNTER_MERGED_DRAWS, gLpglShared.drawSorter.Sort(commandBuffer, gLpglShared.viewProjection));
+
+			backend.Execute(commandBuffer);
+		}
+	}
+
+	for (lpglContext* other : gLpglShared.contexts)
+		other->closedCommands.Clear();
 
-	D3D11_SUBRESOURCE_DATA bufferData = { 0 };
-	bufferData.pSysMem = data;
-	bufferData.SysMemPitch = 0;
-	bufferData.SysMemSlicePitch = 0;
-
-	const CD3D11_BUFFER_DESC bufferDesc(
-		static_cast<UINT>(size),
-		bindFlag);
-
-	DX::ThrowIfFailed(
-		lpglGetDeviceResources().GetD3DDevice()->CreateBuffer(
-			&bufferDesc,
-			&bufferData,
-			&bufIter->second->buffer
-		)
-	);
+	context.ResetCommands();
 }
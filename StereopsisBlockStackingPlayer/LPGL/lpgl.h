@@ -1,60 +1,308 @@
 #pragma once
 
-#include "Common/DeviceResources.h"
+#include <memory>
 
 enum GLenum {
 	GL_TRIANGLES,
 
+	GL_UNSIGNED_BYTE,
 	GL_UNSIGNED_SHORT,
+	GL_UNSIGNED_INT,
+	GL_HALF_FLOAT,
+	GL_FLOAT,
+	GL_NONE,
 
 	GL_ARRAY_BUFFER,
 	GL_ELEMENT_ARRAY_BUFFER,
 
-	GL_STATIC_DRAW
+	GL_STATIC_DRAW,
+	GL_DYNAMIC_DRAW,
+	GL_STREAM_DRAW,
+
+	GL_NO_ERROR,
+	GL_INVALID_ENUM,
+	GL_INVALID_VALUE,
+	GL_INVALID_OPERATION,
+	GL_STACK_OVERFLOW,
+	GL_STACK_UNDERFLOW
 };
 
+typedef int GLint;
 typedef int GLsizei;
 typedef unsigned int GLuint;
+typedef float GLfloat;
 typedef void GLvoid;
 typedef int* GLsizeiptr;
 typedef bool GLboolean;
+typedef unsigned int GLbitfield;
+
+// Access flags for glMapBufferRange. Mappings are write-only.
+const GLbitfield GL_MAP_WRITE_BIT = 0x0002;
+const GLbitfield GL_MAP_INVALIDATE_RANGE_BIT = 0x0004;
+const GLbitfield GL_MAP_INVALIDATE_BUFFER_BIT = 0x0008;
+
+// Each instance transform is drawn once per eye, so an instanced draw passes
+// primcount = LPGL_VIEW_COUNT * the number of instance transforms.
+const GLsizei LPGL_VIEW_COUNT = 2;
+
+// Depth of the matrix stack, including the bottom entry.
+const GLsizei LPGL_MAX_MATRIX_STACK_DEPTH = 32;
+
+class lpglBackend;
+
+// Draw calls are recorded into a command buffer and replayed by the backend on
+// glFlush; buffer storage is handed to the backend immediately.
+void lpglInit(std::unique_ptr<lpglBackend> backend);
+
+lpglBackend& lpglGetBackend();
 
+// Draws are sorted by state and depth at glFlush, and draws of the same mesh
+// merged into instanced ones. Turn it off to replay draws in recorded order.
+void lpglSetDrawSorting(bool enable);
+
+// View-projection the sort measures depth with, 16 floats in the matrix stack's
+// layout. Set it per camera before flushing that camera's draws.
+void lpglSetViewProjection(const GLfloat* m);
+
+// View-projections of every view, LPGL_VIEW_COUNT matrices of 16 floats in the
+// matrix stack's layout, back to back. While set, glFlush drops draws given
+// bounds by glDrawBounds that no view can see. Null, the default, keeps every
+// draw. Set it per camera before flushing that camera's draws.
+void lpglSetCullingViewProjections(const GLfloat* m);
+
+// Recording contexts let several threads record draws at once. Each has its own
+// matrix stack, buffer bindings, instance transforms, error and command list;
+// buffer names are shared. Threads record into the default context until they
+// make a created one current.
+//
+// glFlush on a created context closes its list. glFlush on the default context
+// submits its own commands followed by every closed list, in the order the
+// contexts were created, so the result does not depend on which worker finished
+// first. Closed lists must be complete before that flush starts.
+struct lpglContext;
+
+lpglContext* lpglCreateContext();
+
+// Drops any list the context closed but that was not submitted yet. The
+// context must not be current on another thread; if it is current on the
+// calling thread, the default context is made current instead.
+void lpglDestroyContext(lpglContext* context);
+
+// Makes context current on the calling thread; null restores the default context.
+// A created context can be current on only one thread at a time.
+void lpglMakeCurrent(lpglContext* context);
+
+#ifdef _WIN32
+#include "Common/DeviceResources.h"
+
+// Initializes LPGL with the D3D11 backend.
 void lpglInit(const std::shared_ptr<DX::DeviceResources>& deviceResources);
 
 DX::DeviceResources& lpglGetDeviceResources();
+#endif
 
 void __lpglDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type,
 	const void * indices, GLsizei primcount);
 
+// basevertex is added to every index before the vertex is fetched, so several
+// meshes can share one vertex and index buffer pair with indices local to each.
+void __lpglDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type,
+	const void * indices, GLsizei primcount, GLint basevertex);
+
+// Record of glMultiDrawElementsIndirect, laid out as in GL. instanceCount counts
+// views like primcount, and baseInstance is the first of the current instance
+// transforms the record draws with.
+struct lpglDrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Draws drawcount records read from memory at indirect, stride bytes apart or
+// tightly packed for 0, all with the current bindings and transforms. Each
+// record becomes its own draw, so they are sorted and merged like any other.
+// Records reaching past the element array buffer or the instance transforms
+// are skipped with GL_INVALID_VALUE.
+void __lpglMultiDrawElementsIndirect(GLenum mode, GLenum type, const void * indirect, GLsizei drawcount, GLsizei stride);
+
+// World-space box containing everything the next draw call draws, for culling
+// at glFlush; min and max are 3 floats. It applies to every record of a
+// glMultiDrawElementsIndirect. Draws without bounds are never culled.
+void __lpglDrawBounds(const GLfloat* min, const GLfloat* max);
+
+// Matrix operations follow GL: each one multiplies the current matrix on the
+// right, so it applies to vertices before everything already on the stack.
+// Matrices are 16 floats in GL memory order, which is DirectXMath's row-major
+// layout for row vectors.
 void __lpglLoadIdentity();
 
+void __lpglLoadMatrixf(const GLfloat* m);
+
+void __lpglMultMatrixf(const GLfloat* m);
+
 void __lpglTranslatef(float x, float y, float z);
 
 void __lpglScalef(float x, float y, float z);
 
+// Angle in degrees, counter-clockwise around the axis.
+void __lpglRotatef(float angle, float x, float y, float z);
+
+void __lpglPushMatrix();
+
+void __lpglPopMatrix();
+
+GLenum __lpglGetError();
+
 void __lpglGenBuffers(GLsizei n, GLuint * buffers);
 
+// Deleted names are recycled with a new generation; in debug builds using a
+// deleted name asserts.
+void __lpglDeleteBuffers(GLsizei n, const GLuint * buffers);
+
 void __lpglBindBuffer(GLenum target, GLuint buffer);
 
+// Calling this again with the size, target and usage a buffer already has
+// orphans its storage: the new contents are recorded like glBufferSubData and
+// the device buffer is reused instead of reallocated. With no data, creating
+// the storage is deferred until the buffer is first written, so a buffer filled
+// through glMapBufferRange is created once, already holding its contents.
 void __lpglBufferData(GLenum target, GLsizei size, const GLvoid* data, GLenum usage);
 
+// Updates are recorded like draws, so they must be made on the rendering thread,
+// and draws recorded before them still see the old contents.
+void __lpglBufferSubData(GLenum target, GLsizei offset, GLsizei size, const GLvoid* data);
+
+// Returns uninitialized memory for length bytes at offset, to be written in
+// place and handed over by glUnmapBuffer. Mapping the whole of a buffer whose
+// storage is still deferred may happen on any thread, and unmapping it creates
+// the storage straight from the mapped memory; any other mapping is applied
+// like glBufferSubData. Returns null and sets an error on failure.
+void* __lpglMapBufferRange(GLenum target, GLsizei offset, GLsizei length, GLbitfield access);
+
+GLboolean __lpglUnmapBuffer(GLenum target);
+
+// Sets the per-instance model matrices for the following draws, 16 floats each
+// in the same layout as the matrix stack. They are applied before the current
+// matrix. A count of 0 restores the single identity transform.
+void __lpglInstanceTransforms(GLsizei count, const GLfloat* matrices);
+
+// Vertex array names are shared by every context, like buffer names.
+void __lpglGenVertexArrays(GLsizei n, GLuint * arrays);
+
+// Deleting the bound vertex array binds 0.
+void __lpglDeleteVertexArrays(GLsizei n, const GLuint * arrays);
+
+// A vertex array holds the array and element array buffer bindings, the vertex
+// format and the position bounds; while one is bound, setting any of them
+// changes it. Unlike GL it holds the array buffer binding, as LPGL has no
+// vertex attribute pointers. Binding one restores all of it with one lookup,
+// and the backend prepares its device bindings when it is specified rather
+// than on every draw. Binding 0 keeps the current state without tracking it.
+void __lpglBindVertexArray(GLuint array);
+
+// Layout of the vertices the following draws read from the array buffer: the
+// position, then the color, tightly packed. Positions are GL_FLOAT (x, y, z),
+// or GL_HALF_FLOAT or normalized GL_UNSIGNED_SHORT (x, y, z, unused); colors
+// are GL_FLOAT (r, g, b), normalized GL_UNSIGNED_BYTE (r, g, b, a), or GL_NONE
+// to draw every vertex in the glColor3f color. The default is GL_FLOAT for both.
+// lpglVertexFormat.h picks and writes the smallest layout for a mesh.
+void __lpglVertexFormat(GLenum positionType, GLenum colorType);
+
+// Box GL_UNSIGNED_SHORT positions span, 0 mapping to min and 65535 to max.
+// Decoding is folded into the instance transforms of the draw.
+void __lpglVertexPositionBounds(const GLfloat* min, const GLfloat* max);
+
+// Color of vertices without one; white by default.
+void __lpglColor3f(GLfloat r, GLfloat g, GLfloat b);
+
+void __lpglFlush();
+
 #define glDrawElementsInstanced(mode, count, type, indices, primcount) \
 __lpglDrawElementsInstanced(mode, count, type, indices, primcount)
 
+#define glDrawElementsInstancedBaseVertex(mode, count, type, indices, primcount, basevertex) \
+__lpglDrawElementsInstancedBaseVertex(mode, count, type, indices, primcount, basevertex)
+
+// Every draw is stereo, so the non-instanced form draws once per view.
+#define glDrawElementsBaseVertex(mode, count, type, indices, basevertex) \
+__lpglDrawElementsInstancedBaseVertex(mode, count, type, indices, LPGL_VIEW_COUNT, basevertex)
+
+#define glMultiDrawElementsIndirect(mode, type, indirect, drawcount, stride) \
+__lpglMultiDrawElementsIndirect(mode, type, indirect, drawcount, stride)
+
+#define glDrawBounds(min, max) \
+__lpglDrawBounds(min, max)
+
 #define glLoadIdentity() \
 __lpglLoadIdentity()
 
+#define glLoadMatrixf(m) \
+__lpglLoadMatrixf(m)
+
+#define glMultMatrixf(m) \
+__lpglMultMatrixf(m)
+
 #define glTranslatef(x, y, z) \
 __lpglTranslatef(x, y, z)
 
 #define glScalef(x, y, z) \
 __lpglScalef(x, y, z)
 
+#define glRotatef(angle, x, y, z) \
+__lpglRotatef(angle, x, y, z)
+
+#define glPushMatrix() \
+__lpglPushMatrix()
+
+#define glPopMatrix() \
+__lpglPopMatrix()
+
+#define glGetError() \
+__lpglGetError()
+
 #define glGenBuffers(n, buffers) \
 __lpglGenBuffers(n, buffers)
 
+#define glDeleteBuffers(n, buffers) \
+__lpglDeleteBuffers(n, buffers)
+
 #define glBindBuffer(target, buffer) \
 __lpglBindBuffer(target, buffer)
 
 #define glBufferData(target, size, data, usage) \
 __lpglBufferData(target, size, data, usage)
+
+#define glBufferSubData(target, offset, size, data) \
+__lpglBufferSubData(target, offset, size, data)
+
+#define glMapBufferRange(target, offset, length, access) \
+__lpglMapBufferRange(target, offset, length, access)
+
+#define glUnmapBuffer(target) \
+__lpglUnmapBuffer(target)
+
+#define glInstanceTransforms(count, matrices) \
+__lpglInstanceTransforms(count, matrices)
+
+#define glGenVertexArrays(n, arrays) \
+__lpglGenVertexArrays(n, arrays)
+
+#define glDeleteVertexArrays(n, arrays) \
+__lpglDeleteVertexArrays(n, arrays)
+
+#define glBindVertexArray(array) \
+__lpglBindVertexArray(array)
+
+#define glVertexFormat(positionType, colorType) \
+__lpglVertexFormat(positionType, colorType)
+
+#define glVertexPositionBounds(min, max) \
+__lpglVertexPositionBounds(min, max)
+
+#define glColor3f(r, g, b) \
+__lpglColor3f(r, g, b)
+
+#define glFlush() \
+__lpglFlush()
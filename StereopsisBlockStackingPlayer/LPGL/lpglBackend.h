@@ -0,0 +1,45 @@
+#pragma once
+
+#include "lpglCommand.h"
+
+// What a vertex array binds for the draws that use it.
+struct lpglVertexArrayDesc {
+	GLuint arrayBuffer;
+	GLuint elementArrayBuffer;
+	GLenum positionType;
+	GLenum colorType;
+};
+
+// Device side of LPGL. Buffer storage is created as soon as it is specified
+// (usually on a loader thread); everything else, including updates to existing
+// storage, arrives as a command buffer on the rendering thread.
+class lpglBackend {
+public:
+	virtual ~lpglBackend() {}
+
+	virtual void BufferData(GLuint buffer, GLenum target, GLsizei size, const GLvoid* data, GLenum usage) = 0;
+
+	virtual void DeleteBuffer(GLuint buffer) = 0;
+
+	// Called whenever a vertex array is specified or changed, so its device
+	// bindings can be prepared ahead of the draws that use it. Draws still carry
+	// the full state, and one recorded before the latest change must not use the
+	// prepared bindings.
+	virtual void VertexArray(GLuint /*array*/, const lpglVertexArrayDesc& /*desc*/) {}
+
+	virtual void DeleteVertexArray(GLuint /*array*/) {}
+
+	virtual void Execute(const lpglCommandBuffer& commandBuffer) = 0;
+
+	// Whether command lists recorded on separate contexts are handed over as
+	// they are, through ExecuteCommandLists. Otherwise they are concatenated into
+	// one command buffer for Execute.
+	virtual bool SupportsCommandLists() const { return false; }
+
+	// Replays the lists with the same result as executing them one after another.
+	virtual void ExecuteCommandLists(const lpglCommandBuffer* const* commandLists, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			Execute(*commandLists[i]);
+	}
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "lpgl.h"
+
+#include <DirectXMath.h>
+
+#include <type_traits>
+#include <vector>
+
+enum lpglCommandType {
+	LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED,
+	LPGL_COMMAND_BUFFER_SUB_DATA
+};
+
+// Indexed draw using the buffer bindings and transform current at record time.
+struct lpglDrawElementsCommand {
+	GLenum mode;
+	GLenum type;
+	GLsizei count;
+	GLsizei primcount;
+	GLuint firstIndex;
+	GLint baseVertex;
+
+	GLuint arrayBuffer;
+	GLuint elementArrayBuffer;
+
+	// Vertex array bound when the draw was recorded, or 0.
+	GLuint vertexArray;
+
+	// Vertex layout from glVertexFormat, and with GL_NONE colors the glColor3f
+	// color as RGBA8, red in the lowest byte.
+	GLenum positionType;
+	GLenum colorType;
+	GLuint color;
+
+	// Index into lpglCommandBuffer::transforms.
+	GLuint transform;
+
+	// Range of lpglCommandBuffer::instanceTransforms; instance i of the draw
+	// uses entry firstInstanceTransform + i / LPGL_VIEW_COUNT.
+	GLuint firstInstanceTransform;
+	GLuint instanceTransformCount;
+
+	// Index into lpglCommandBuffer::bounds, or LPGL_NO_BOUNDS.
+	GLuint bounds;
+};
+
+const GLuint LPGL_NO_BOUNDS = static_cast<GLuint>(-1);
+
+// World-space box from glDrawBounds, as the center and half extents the culling
+// tests take.
+struct lpglDrawBounds {
+	DirectX::XMFLOAT3 center;
+	DirectX::XMFLOAT3 extents;
+};
+
+// Replaces size bytes at offset in a buffer with bytes from
+// lpglCommandBuffer::payload. An orphaning update covers the whole buffer, whose
+// previous contents may be thrown away; without data they are left undefined.
+struct lpglBufferSubDataCommand {
+	GLuint buffer;
+	GLsizei offset;
+	GLsizei size;
+
+	GLuint payloadOffset;
+	GLboolean hasData;
+	GLboolean orphan;
+};
+
+struct lpglCommand {
+	lpglCommandType type;
+
+	union {
+		lpglDrawElementsCommand drawElements;
+		lpglBufferSubDataCommand bufferSubData;
+	};
+};
+
+static_assert(std::is_trivially_copyable<lpglCommand>::value, "LPGL commands must stay POD.");
+
+// The calls recorded between two flushes. Draws refer to transforms by index so
+// consecutive draws under the same matrix share one entry.
+struct lpglCommandBuffer {
+	std::vector<lpglCommand> commands;
+	std::vector<DirectX::XMFLOAT4X4> transforms;
+	std::vector<DirectX::XMFLOAT4X4> instanceTransforms;
+	std::vector<lpglDrawBounds> bounds;
+
+	// Buffer contents copied at record time, so callers may reuse their memory.
+	std::vector<unsigned char> payload;
+
+	// Appends the calls recorded in other, rebasing the indices its commands hold.
+	void Append(const lpglCommandBuffer& other)
+	{
+		const GLuint transformBase = static_cast<GLuint>(transforms.size());
+		const GLuint instanceTransformBase = static_cast<GLuint>(instanceTransforms.size());
+		const GLuint boundsBase = static_cast<GLuint>(bounds.size());
+		const GLuint payloadBase = static_cast<GLuint>(payload.size());
+
+		for (lpglCommand command : other.commands) {
+			switch (command.type) {
+			case LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED:
+				command.drawElements.transform += transformBase;
+				command.drawElements.firstInstanceTransform += instanceTransformBase;
+				if (command.drawElements.bounds != LPGL_NO_BOUNDS)
+					command.drawElements.bounds += boundsBase;
+				break;
+			case LPGL_COMMAND_BUFFER_SUB_DATA:
+				command.bufferSubData.payloadOffset += payloadBase;
+				break;
+			}
+
+			commands.push_back(command);
+		}
+
+		transforms.insert(transforms.end(), other.transforms.begin(), other.transforms.end());
+		instanceTransforms.insert(instanceTransforms.end(), other.instanceTransforms.begin(), other.instanceTransforms.end());
+		bounds.insert(bounds.end(), other.bounds.begin(), other.bounds.end());
+		payload.insert(payload.end(), other.payload.begin(), other.payload.end());
+	}
+
+	void Clear()
+	{
+		commands.clear();
+		transforms.clear();
+		instanceTransforms.clear();
+		bounds.clear();
+		payload.clear();
+	}
+};
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "lpglCull.h"
+#include "lpglStatistics.h"
+
+using namespace DirectX;
+
+void lpglFrustumCuller::SetViewProjections(const XMFLOAT4X4* viewProjections)
+{
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		const XMFLOAT4X4& m = viewProjections[view];
+
+		// With row vectors, clip coordinate j is the dot product of the position
+		// with column j. Points inside satisfy -w <= x <= w, -w <= y <= w and
+		// 0 <= z, which gives each plane as a sum or difference of columns.
+		float planes[kPlaneGroups * 4][4];
+
+		for (int i = 0; i < 4; ++i) {
+			planes[0][i] = m.m[i][3] + m.m[i][0];
+			planes[1][i] = m.m[i][3] - m.m[i][0];
+			planes[2][i] = m.m[i][3] + m.m[i][1];
+			planes[3][i] = m.m[i][3] - m.m[i][1];
+			planes[4][i] = m.m[i][2];
+		}
+
+		// The remaining lanes hold 0 >= -1, which every box passes.
+		for (int plane = 5; plane < kPlaneGroups * 4; ++plane) {
+			planes[plane][0] = planes[plane][1] = planes[plane][2] = 0.0f;
+			planes[plane][3] = 1.0f;
+		}
+
+		for (int group = 0; group < kPlaneGroups; ++group) {
+			const float (*p)[4] = planes + group * 4;
+			PlaneGroup& planeGroup = m_planes[view][group];
+
+			planeGroup.a = XMVectorSet(p[0][0], p[1][0], p[2][0], p[3][0]);
+			planeGroup.b = XMVectorSet(p[0][1], p[1][1], p[2][1], p[3][1]);
+			planeGroup.c = XMVectorSet(p[0][2], p[1][2], p[2][2], p[3][2]);
+			planeGroup.d = XMVectorSet(p[0][3], p[1][3], p[2][3], p[3][3]);
+			planeGroup.absA = XMVectorAbs(planeGroup.a);
+			planeGroup.absB = XMVectorAbs(planeGroup.b);
+			planeGroup.absC = XMVectorAbs(planeGroup.c);
+		}
+	}
+}
+
+bool lpglFrustumCuller::IsVisible(const lpglDrawBounds& bounds) const
+{
+	const XMVECTOR centerX = XMVectorReplicate(bounds.center.x);
+	const XMVECTOR centerY = XMVectorReplicate(bounds.center.y);
+	const XMVECTOR centerZ = XMVectorReplicate(bounds.center.z);
+	const XMVECTOR extentX = XMVectorReplicate(bounds.extents.x);
+	const XMVECTOR extentY = XMVectorReplicate(bounds.extents.y);
+	const XMVECTOR extentZ = XMVectorReplicate(bounds.extents.z);
+
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		XMVECTOR nearest = XMVectorReplicate(1.0f);
+
+		for (const PlaneGroup& planes : m_planes[view]) {
+			// Signed distance of the center plus the box's radius along the
+			// normal: negative when the whole box is behind the plane. Planes
+			// are not normalized, which scales both terms alike.
+			XMVECTOR distance = XMVectorMultiplyAdd(centerX, planes.a, planes.d);
+			distance = XMVectorMultiplyAdd(centerY, planes.b, distance);
+			distance = XMVectorMultiplyAdd(centerZ, planes.c, distance);
+			distance = XMVectorMultiplyAdd(extentX, planes.absA, distance);
+			distance = XMVectorMultiplyAdd(extentY, planes.absB, distance);
+			distance = XMVectorMultiplyAdd(extentZ, planes.absC, distance);
+
+			nearest = XMVectorMin(nearest, distance);
+		}
+
+		if (XMVector4GreaterOrEqual(nearest, XMVectorZero()))
+			return true;
+	}
+
+	return false;
+}
+
+size_t lpglFrustumCuller::Cull(lpglCommandBuffer& commandBuffer) const
+{
+	std::vector<lpglCommand>& commands = commandBuffer.commands;
+
+	size_t kept = 0;
+	size_t passed = 0;
+
+	for (size_t i = 0; i < commands.size(); ++i) {
+		const lpglCommand& command = commands[i];
+
+		if (command.type == LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED && command.drawElements.bounds != LPGL_NO_BOUNDS) {
+			if (!IsVisible(commandBuffer.bounds[command.drawElements.bounds]))
+				continue;
+
+			passed++;
+		}
+
+		commands[kept++] = command;
+	}
+
+	const size_t culled = commands.size() - kept;
+	commands.resize(kept);
+
+	lpglCount(LPGL_COUNTER_CULLED_DRAWS, culled);
+	lpglCount(LPGL_COUNTER_PASSED_DRAWS, passed);
+
+	return culled;
+}
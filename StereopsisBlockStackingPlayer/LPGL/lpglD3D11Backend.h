@@ -0,0 +1,234 @@
+#pragma once
+
+#include "lpglBackend.h"
+#include "lpglD3D11Ring.h"
+#include "lpglSlotMap.h"
+#include "lpglStatistics.h"
+
+#include "Common/DeviceResources.h"
+
+#include <mutex>
+#include <unordered_map>
+
+// Replays LPGL command buffers on the D3D11 immediate context.
+//
+// GL_STATIC_DRAW and GL_DYNAMIC_DRAW buffers live in default-usage memory and
+// are updated by copying from an upload ring, which keeps updates ordered with
+// the draws around them. GL_STREAM_DRAW buffers are dynamic: every update
+// rewrites the whole buffer with WRITE_DISCARD from a CPU copy, so the driver
+// renames the storage instead of the GPU waiting for it.
+//
+// When the driver supports command lists natively, lists recorded on separate
+// LPGL contexts are translated on deferred contexts in parallel and executed
+// on the immediate context in submission order.
+class lpglD3D11Backend : public lpglBackend {
+public:
+	lpglD3D11Backend(const std::shared_ptr<DX::DeviceResources>& deviceResources);
+
+	void BufferData(GLuint buffer, GLenum target, GLsizei size, const GLvoid* data, GLenum usage) override;
+
+	void DeleteBuffer(GLuint buffer) override;
+
+	void VertexArray(GLuint array, const lpglVertexArrayDesc& desc) override;
+
+	void DeleteVertexArray(GLuint array) override;
+
+	void Execute(const lpglCommandBuffer& commandBuffer) override;
+
+	bool SupportsCommandLists() const override { return m_driverCommandLists; }
+
+	void ExecuteCommandLists(const lpglCommandBuffer* const* commandLists, size_t count) override;
+
+	DX::DeviceResources& GetDeviceResources() { return *m_deviceResources; }
+
+	// Pipeline state changes sent to the device versus skipped because the
+	// shadowed state already matched.
+	struct StateCounters {
+		unsigned long long issued = 0;
+		unsigned long long skipped = 0;
+	};
+
+	const StateCounters& GetStateCounters() const { return m_stateCounters; }
+	void ResetStateCounters() { m_stateCounters = StateCounters(); }
+
+private:
+	// Last state this backend bound on a context. Other code uses the immediate
+	// context between flushes, so the shadow only holds within one replay.
+	struct ShadowState {
+		ID3D11InputLayout* inputLayout = nullptr;
+		ID3D11VertexShader* vertexShader = nullptr;
+		ID3D11GeometryShader* geometryShader = nullptr;
+		ID3D11PixelShader* pixelShader = nullptr;
+		ID3D11Buffer* modelConstantBuffer = nullptr;
+		D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		ID3D11Buffer* vertexBuffer = nullptr;
+		UINT vertexStride = 0;
+		ID3D11Buffer* colorBuffer = nullptr;
+		ID3D11Buffer* indexBuffer = nullptr;
+		ID3D11Buffer* instanceBuffer = nullptr;
+		UINT instanceBufferOffset = static_cast<UINT>(-1);
+		DXGI_FORMAT indexBufferFormat = DXGI_FORMAT_UNKNOWN;
+		GLuint transform = static_cast<GLuint>(-1);
+	};
+
+	// Everything one replay of a command buffer binds and counts; one for the
+	// immediate context and one per deferred context.
+	struct ReplayState {
+		ShadowState shadow;
+		StateCounters stateCounters;
+
+		// Per-instance model matrices, vertex buffer slot 1, rewritten every replay.
+		Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+		size_t instanceBufferCapacity = 0;
+
+		// Where this replay's model constants are in m_modelConstantsRing, if there.
+		bool modelConstantsInRing = false;
+		size_t modelConstantsOffset = 0;
+	};
+
+	struct DeferredContext {
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context;
+		Microsoft::WRL::ComPtr<ID3D11CommandList> commandList;
+		ReplayState replay;
+	};
+
+	template <typename T>
+	static bool ChangeState(ReplayState& replay, T& shadow, T value)
+	{
+		if (shadow == value) {
+			replay.stateCounters.skipped++;
+			lpglCount(LPGL_COUNTER_REDUNDANT_STATE_CHANGES);
+			return false;
+		}
+
+		shadow = value;
+		replay.stateCounters.issued++;
+		lpglCount(LPGL_COUNTER_STATE_CHANGES);
+		return true;
+	}
+
+	// Input assembler bindings for a draw, as prepared for a vertex array.
+	// Pointers are owned by m_buffers.
+	struct VertexArrayBindings {
+		lpglVertexArrayDesc desc = {};
+
+		// Indices into m_inputLayouts, -1 for formats without one.
+		int positionType = -1;
+		int colorType = -1;
+
+		UINT vertexStride = 0;
+		ID3D11Buffer* vertexBuffer = nullptr;
+		ID3D11Buffer* indexBuffer = nullptr;
+
+		bool Describes(const lpglDrawElementsCommand& command) const
+		{
+			return desc.arrayBuffer == command.arrayBuffer && desc.elementArrayBuffer == command.elementArrayBuffer &&
+				desc.positionType == command.positionType && desc.colorType == command.colorType;
+		}
+	};
+
+	void Initialize();
+
+	// Looks up everything bindings.desc names. Called with m_buffersMutex held.
+	void ResolveVertexArray(VertexArrayBindings& bindings) const;
+
+	// Resolves the vertex arrays using a buffer whose storage changed. Called
+	// with m_buffersMutex held.
+	void RefreshVertexArrays(GLuint buffer);
+
+	// Whether a command list can be replayed on a deferred context: it needs the
+	// shaders, and buffer updates go through the immediate context's upload ring.
+	bool CanDefer(const lpglCommandBuffer& commandBuffer) const;
+
+	// Translates the lists on deferred contexts in parallel, then executes them in order.
+	void ExecuteDeferred(const lpglCommandBuffer* const* commandLists, size_t count);
+
+	// Replays the draws of a command buffer; buffer updates need the immediate context.
+	void ReplayDraws(ID3D11DeviceContext1* context, ReplayState& replay, const lpglCommandBuffer& commandBuffer);
+
+	// Copies the command buffer's instance transforms into the instance vertex stream.
+	void UploadInstanceTransforms(ID3D11DeviceContext* context, ReplayState& replay,
+		const std::vector<DirectX::XMFLOAT4X4>& instanceTransforms);
+
+	// Writes every transform of the command buffer into the constant buffer ring.
+	bool UploadModelConstants(ID3D11DeviceContext* context, ReplayState& replay,
+		const std::vector<DirectX::XMFLOAT4X4>& transforms);
+
+	void BufferSubData(ID3D11DeviceContext* context, const lpglBufferSubDataCommand& command, const unsigned char* payload);
+
+	// One-element vertex buffer holding an RGBA8 color, read with a stride of 0
+	// by draws without a color attribute. The buffer stays alive until the next
+	// TrimConstantColorBuffers, so replays can keep the raw pointer, and a
+	// replay's shadow state cannot mistake a new buffer for a freed one.
+	ID3D11Buffer* GetConstantColorBuffer(GLuint color);
+
+	// Drops the cached color buffers once there are too many. Called only
+	// before a replay starts, never while deferred workers may hold buffers.
+	void TrimConstantColorBuffers();
+
+	void DrawElementsInstanced(ID3D11DeviceContext1* context, ReplayState& replay, const lpglDrawElementsCommand& command,
+		GLuint transformIndex, const DirectX::XMFLOAT4X4& transform);
+
+	std::shared_ptr<DX::DeviceResources> m_deviceResources;
+
+	// One input layout per vertex format, indexed by position then color type in
+	// the order of kPositionTypes and kColorTypes.
+	static const int kPositionTypeCount = 3;
+	static const int kColorTypeCount = 3;
+
+	Microsoft::WRL::ComPtr<ID3D11InputLayout>       m_inputLayouts[kPositionTypeCount][kColorTypeCount];
+	Microsoft::WRL::ComPtr<ID3D11VertexShader>      m_vertexShader;
+	Microsoft::WRL::ComPtr<ID3D11GeometryShader>    m_geometryShader;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader>       m_pixelShader;
+	Microsoft::WRL::ComPtr<ID3D11Buffer>            m_modelConstantBuffer;
+
+	// Model constants for every draw of an Execute, bound by offset. Needs
+	// constant buffer offsetting and NO_OVERWRITE maps of constant buffers;
+	// without them, and on deferred contexts, draws update m_modelConstantBuffer
+	// instead.
+	static const size_t kModelConstantsStride = 256;
+	static const size_t kModelConstantsRingSize = 1024 * kModelConstantsStride;
+
+	bool                                            m_useModelConstantsRing = false;
+	lpglD3D11Ring                                   m_modelConstantsRing;
+
+	// Source of buffer updates, copied into default-usage buffers on the GPU.
+	// Created on first use; updates that do not fit go through UpdateSubresource.
+	static const size_t kUploadRingSize = 4 * 1024 * 1024;
+
+	lpglD3D11Ring                                   m_uploadRing;
+	bool                                            m_uploadRingUsed = false;
+
+	bool                                            m_usingVprtShaders = false;
+
+	// Without driver support the runtime emulates command lists, which costs
+	// more than it saves; lists are then concatenated instead.
+	bool                                            m_driverCommandLists = false;
+
+	// Vertex buffer slot 2 for GL_NONE colors, by color. Deferred contexts look
+	// them up from worker threads.
+	static const size_t kMaxConstantColorBuffers = 256;
+
+	std::mutex m_constantColorsMutex;
+	std::unordered_map<GLuint, Microsoft::WRL::ComPtr<ID3D11Buffer>> m_constantColors;
+
+	ReplayState m_immediate;
+	std::vector<std::unique_ptr<DeferredContext>> m_deferredContexts;
+
+	StateCounters m_stateCounters;
+
+	struct Buffer {
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		GLenum usage = GL_STATIC_DRAW;
+		GLsizei size = 0;
+
+		// GL_STREAM_DRAW only: the current contents, written out whole on each update.
+		std::vector<unsigned char> contents;
+	};
+
+	// Buffers are created from loader threads while the render thread executes.
+	// Also guards m_vertexArrays, which point into the buffers.
+	std::mutex m_buffersMutex;
+	lpglSlotArray<Buffer> m_buffers;
+	lpglSlotArray<VertexArrayBindings> m_vertexArrays;
+};
@@ -0,0 +1,196 @@
+#include "pch.h"
+#include "lpglDrawSort.h"
+#include "lpglSlotMap.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+size_t lpglDrawSorter::Sort(lpglCommandBuffer& commandBuffer, const XMFLOAT4X4& viewProjection)
+{
+	const XMMATRIX viewProjectionMatrix = XMLoadFloat4x4(&viewProjection);
+
+	m_commands.clear();
+	m_instanceTransforms.clear();
+	m_keys.clear();
+	m_identityTransform = static_cast<GLuint>(-1);
+
+	size_t merged = 0;
+
+	for (GLuint i = 0; i < commandBuffer.commands.size(); ++i) {
+		const lpglCommand& command = commandBuffer.commands[i];
+
+		if (command.type == LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED) {
+			m_keys.push_back({ MakeKey(command.drawElements, commandBuffer, viewProjectionMatrix), i });
+			continue;
+		}
+
+		// Draws on either side may depend on what this command changes.
+		merged += EmitRun(commandBuffer);
+		m_keys.clear();
+
+		m_commands.push_back(command);
+	}
+
+	merged += EmitRun(commandBuffer);
+
+	commandBuffer.commands.swap(m_commands);
+	commandBuffer.instanceTransforms.swap(m_instanceTransforms);
+
+	return merged;
+}
+
+uint64_t lpglDrawSorter::MakeKey(const lpglDrawElementsCommand& draw, const lpglCommandBuffer& commandBuffer,
+	FXMMATRIX viewProjection)
+{
+	const uint64_t pipeline = ((static_cast<uint64_t>(draw.mode) & 0xF) << 4) | (static_cast<uint64_t>(draw.type) & 0xF);
+	const uint64_t vertexBuffer = lpglSlotIndex(draw.arrayBuffer) & 0xFFFF;
+	const uint64_t indexBuffer = lpglSlotIndex(draw.elementArrayBuffer) & 0xFFFF;
+
+	const XMMATRIX world = XMMatrixMultiply(
+		XMLoadFloat4x4(&commandBuffer.instanceTransforms[draw.firstInstanceTransform]),
+		XMLoadFloat4x4(&commandBuffer.transforms[draw.transform]));
+
+	// The clip-space position of the instance's origin is the last row.
+	XMFLOAT4X4 clip;
+	XMStoreFloat4x4(&clip, XMMatrixMultiply(world, viewProjection));
+
+	float depth = clip.m[3][3] > 0.0f ? clip.m[3][2] / clip.m[3][3] : 1.0f;
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+
+	const uint64_t depthBits = static_cast<uint64_t>(depth * 0xFFFFFF);
+
+	return (pipeline << 56) | (vertexBuffer << 40) | (indexBuffer << 24) | depthBits;
+}
+
+bool lpglDrawSorter::CanMerge(const lpglDrawElementsCommand& a, const lpglDrawElementsCommand& b)
+{
+	// Only draws that use each of their instance transforms once per view can
+	// have their instances concatenated.
+	return a.mode == b.mode && a.type == b.type && a.count == b.count &&
+		a.firstIndex == b.firstIndex && a.baseVertex == b.baseVertex &&
+		a.arrayBuffer == b.arrayBuffer && a.elementArrayBuffer == b.elementArrayBuffer &&
+		a.positionType == b.positionType && a.colorType == b.colorType &&
+		(a.colorType != GL_NONE || a.color == b.color) &&
+		a.primcount == LPGL_VIEW_COUNT * static_cast<GLsizei>(a.instanceTransformCount) &&
+		b.primcount == LPGL_VIEW_COUNT * static_cast<GLsizei>(b.instanceTransformCount);
+}
+
+void lpglDrawSorter::RadixSort()
+{
+	const size_t n = m_keys.size();
+
+	if (n < 2)
+		return;
+
+	m_scratch.resize(n);
+
+	KeyedDraw* source = m_keys.data();
+	KeyedDraw* destination = m_scratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t offsets[256] = {};
+
+		for (size_t i = 0; i < n; ++i)
+			offsets[(source[i].key >> shift) & 0xFF]++;
+
+		// Every key has the same digit; the pass would not move anything.
+		if (offsets[(source[0].key >> shift) & 0xFF] == n)
+			continue;
+
+		size_t offset = 0;
+
+		for (size_t& bucket : offsets) {
+			size_t count = bucket;
+			bucket = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < n; ++i)
+			destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+		std::swap(source, destination);
+	}
+
+	if (source != m_keys.data())
+		m_keys.swap(m_scratch);
+}
+
+size_t lpglDrawSorter::EmitRun(lpglCommandBuffer& commandBuffer)
+{
+	if (m_keys.empty())
+		return 0;
+
+	RadixSort();
+
+	size_t merged = 0;
+	size_t current = m_commands.size();
+
+	for (const KeyedDraw& keyedDraw : m_keys) {
+		const lpglDrawElementsCommand& draw = commandBuffer.commands[keyedDraw.command].drawElements;
+
+		if (current < m_commands.size() && CanMerge(m_commands[current].drawElements, draw)) {
+			lpglDrawElementsCommand& batch = m_commands[current].drawElements;
+
+			if (batch.transform != draw.transform) {
+				// Fold the batch's own model matrix into the instances it has
+				// so far, once; after that it draws under the identity.
+				if (m_identityTransform == static_cast<GLuint>(-1)) {
+					m_identityTransform = static_cast<GLuint>(commandBuffer.transforms.size());
+
+					XMFLOAT4X4 identity;
+					XMStoreFloat4x4(&identity, XMMatrixIdentity());
+					commandBuffer.transforms.push_back(identity);
+				}
+
+				if (batch.transform != m_identityTransform) {
+					const XMMATRIX model = XMLoadFloat4x4(&commandBuffer.transforms[batch.transform]);
+
+					for (GLuint i = 0; i < batch.instanceTransformCount; ++i) {
+						XMFLOAT4X4& instance = m_instanceTransforms[batch.firstInstanceTransform + i];
+						XMStoreFloat4x4(&instance, XMMatrixMultiply(XMLoadFloat4x4(&instance), model));
+					}
+
+					batch.transform = m_identityTransform;
+				}
+			}
+
+			AppendInstanceTransforms(draw, commandBuffer, batch.transform != draw.transform);
+
+			batch.instanceTransformCount += draw.instanceTransformCount;
+			batch.primcount += draw.primcount;
+
+			merged++;
+			continue;
+		}
+
+		lpglCommand command = commandBuffer.commands[keyedDraw.command];
+		command.drawElements.firstInstanceTransform = static_cast<GLuint>(m_instanceTransforms.size());
+
+		AppendInstanceTransforms(draw, commandBuffer, false);
+
+		current = m_commands.size();
+		m_commands.push_back(command);
+	}
+
+	return merged;
+}
+
+void lpglDrawSorter::AppendInstanceTransforms(const lpglDrawElementsCommand& draw, const lpglCommandBuffer& commandBuffer, bool fold)
+{
+	auto first = commandBuffer.instanceTransforms.begin() + draw.firstInstanceTransform;
+	auto last = first + draw.instanceTransformCount;
+
+	if (!fold) {
+		m_instanceTransforms.insert(m_instanceTransforms.end(), first, last);
+		return;
+	}
+
+	const XMMATRIX model = XMLoadFloat4x4(&commandBuffer.transforms[draw.transform]);
+
+	for (auto it = first; it != last; ++it) {
+		XMFLOAT4X4 instance;
+		XMStoreFloat4x4(&instance, XMMatrixMultiply(XMLoadFloat4x4(&*it), model));
+		m_instanceTransforms.push_back(instance);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "lpglBackend.h"
+#include "lpglSlotMap.h"
+
+#include <mutex>
+
+// Backend that never touches a device. It validates and counts what it is asked
+// to do, so render submission can be tested and benchmarked off-device.
+class lpglNullBackend : public lpglBackend {
+public:
+	struct Counters {
+		unsigned long long executeCount = 0;
+		unsigned long long commandCount = 0;
+		unsigned long long drawCount = 0;
+		unsigned long long invalidDrawCount = 0;
+		unsigned long long indexCount = 0;
+		unsigned long long instanceCount = 0;
+		unsigned long long transformCount = 0;
+		unsigned long long instanceTransformCount = 0;
+
+		unsigned long long bufferDataCount = 0;
+		unsigned long long bufferBytes = 0;
+		unsigned long long deleteBufferCount = 0;
+
+		unsigned long long bufferSubDataCount = 0;
+		unsigned long long bufferSubDataBytes = 0;
+		unsigned long long orphanCount = 0;
+		unsigned long long invalidBufferSubDataCount = 0;
+	};
+
+	void BufferData(GLuint buffer, GLenum target, GLsizei size, const GLvoid* data, GLenum usage) override;
+
+	void DeleteBuffer(GLuint buffer) override;
+
+	void Execute(const lpglCommandBuffer& commandBuffer) override;
+
+	const Counters& GetCounters() const { return m_counters; }
+	void ResetCounters() { m_counters = Counters(); }
+
+private:
+	bool IsValidDraw(const lpglDrawElementsCommand& command, const lpglCommandBuffer& commandBuffer) const;
+	bool IsValidBufferSubData(const lpglBufferSubDataCommand& command, const lpglCommandBuffer& commandBuffer) const;
+
+	Counters m_counters;
+
+	std::mutex m_buffersMutex;
+	lpglSlotArray<GLsizei> m_bufferSizes;
+};
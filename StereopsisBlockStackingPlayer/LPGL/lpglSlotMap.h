@@ -0,0 +1,146 @@
+#pragma once
+
+#include "lpgl.h"
+
+#include <vector>
+
+// Object names handed out by LPGL pack a dense slot index with a generation:
+// name = (generation << LPGL_SLOT_INDEX_BITS) | (index + 1). Name 0 is never
+// valid, and a deleted name stops matching its slot as soon as the slot is
+// reused, so stale names are detected instead of aliasing new objects.
+const unsigned LPGL_SLOT_INDEX_BITS = 20;
+const GLuint LPGL_SLOT_INDEX_MASK = (1u << LPGL_SLOT_INDEX_BITS) - 1;
+const GLuint LPGL_SLOT_GENERATION_COUNT = 1u << (32 - LPGL_SLOT_INDEX_BITS);
+
+inline GLuint lpglSlotIndex(GLuint name)
+{
+	return (name & LPGL_SLOT_INDEX_MASK) - 1;
+}
+
+// Allocates names and owns a value per live name. Freed slots are reused from a
+// free list with their generation advanced.
+template <typename T>
+class lpglSlotMap {
+public:
+	GLuint Allocate()
+	{
+		GLuint index;
+
+		if (!m_freeList.empty()) {
+			index = m_freeList.back();
+			m_freeList.pop_back();
+		}
+		else {
+			index = static_cast<GLuint>(m_slots.size());
+			m_slots.emplace_back();
+		}
+
+		Slot& slot = m_slots[index];
+		slot.live = true;
+		slot.value = T();
+
+		return (slot.generation << LPGL_SLOT_INDEX_BITS) | (index + 1);
+	}
+
+	bool Free(GLuint name)
+	{
+		if (!IsValid(name))
+			return false;
+
+		GLuint index = lpglSlotIndex(name);
+		Slot& slot = m_slots[index];
+
+		slot.live = false;
+		slot.generation = (slot.generation + 1) % LPGL_SLOT_GENERATION_COUNT;
+		m_freeList.push_back(index);
+
+		return true;
+	}
+
+	bool IsValid(GLuint name) const
+	{
+		GLuint index = lpglSlotIndex(name);
+
+		return name != 0 && index < m_slots.size() && m_slots[index].live &&
+			(name >> LPGL_SLOT_INDEX_BITS) == m_slots[index].generation;
+	}
+
+	T* Get(GLuint name)
+	{
+		return IsValid(name) ? &m_slots[lpglSlotIndex(name)].value : nullptr;
+	}
+
+	size_t GetLiveCount() const { return m_slots.size() - m_freeList.size(); }
+
+private:
+	struct Slot {
+		T value = T();
+		GLuint generation = 0;
+		bool live = false;
+	};
+
+	std::vector<Slot> m_slots;
+	std::vector<GLuint> m_freeList;
+};
+
+// Backend-side storage keyed by names allocated elsewhere, indexed by their
+// dense slot. A lookup with a stale name misses.
+template <typename T>
+class lpglSlotArray {
+public:
+	const T* Find(GLuint name) const
+	{
+		GLuint index = lpglSlotIndex(name);
+
+		if (name == 0 || index >= m_slots.size() || m_slots[index].name != name)
+			return nullptr;
+
+		return &m_slots[index].value;
+	}
+
+	T* Find(GLuint name)
+	{
+		return const_cast<T*>(static_cast<const lpglSlotArray*>(this)->Find(name));
+	}
+
+	T& Insert(GLuint name)
+	{
+		GLuint index = lpglSlotIndex(name);
+
+		if (index >= m_slots.size())
+			m_slots.resize(index + 1);
+
+		m_slots[index].name = name;
+		m_slots[index].value = T();
+
+		return m_slots[index].value;
+	}
+
+	void Erase(GLuint name)
+	{
+		if (!Find(name))
+			return;
+
+		Slot& slot = m_slots[lpglSlotIndex(name)];
+		slot.name = 0;
+		slot.value = T();
+	}
+
+	// Calls f(name, value) for every entry.
+	template <typename F>
+	void ForEach(F f)
+	{
+		for (Slot& slot : m_slots) {
+			if (slot.name != 0)
+				f(slot.name, slot.value);
+		}
+	}
+
+private:
+	struct Slot {
+		GLuint name = 0;
+		T value = T();
+	};
+
+	std::vector<Slot> m_slots;
+};
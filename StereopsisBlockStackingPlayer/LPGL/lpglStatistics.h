@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// What LPGL submitted in a frame. Counters can be bumped from any thread;
+// loader threads creating buffers count towards the frame they finish in.
+enum lpglCounter {
+	LPGL_COUNTER_DRAWS,
+	LPGL_COUNTER_MERGED_DRAWS,
+	LPGL_COUNTER_CULLED_DRAWS,	// draws with bounds no view sees, dropped at glFlush
+	LPGL_COUNTER_PASSED_DRAWS,	// draws with bounds that passed culling
+	LPGL_COUNTER_INSTANCES,
+	LPGL_COUNTER_TRIANGLES,
+	LPGL_COUNTER_STATE_CHANGES,
+	LPGL_COUNTER_REDUNDANT_STATE_CHANGES,
+	LPGL_COUNTER_CONSTANT_BUFFER_UPDATES,
+	LPGL_COUNTER_BUFFER_CREATIONS,
+	LPGL_COUNTER_BYTES_UPLOADED,
+	LPGL_COUNTER_COUNT
+};
+
+// Entry points whose CPU time is measured.
+enum lpglTimer {
+	LPGL_TIMER_DRAW,	// recording draws
+	LPGL_TIMER_BUFFER,	// specifying, updating and mapping buffers
+	LPGL_TIMER_FLUSH,	// glFlush, including the backend replaying the frame
+	LPGL_TIMER_COUNT
+};
+
+struct lpglStatistics {
+	unsigned long long frameCount = 0;
+	unsigned long long counters[LPGL_COUNTER_COUNT] = {};
+	unsigned long long calls[LPGL_TIMER_COUNT] = {};
+	double seconds[LPGL_TIMER_COUNT] = {};
+};
+
+// Cumulative statistics are kept per tier, so submission cost can be read
+// against the framerate tier the frame ran at.
+const int LPGL_STATISTICS_MAX_TIERS = 4;
+
+void lpglCount(lpglCounter counter, unsigned long long amount = 1);
+
+// Adds the lifetime of the scope to a timer, as one call.
+class lpglTimerScope {
+public:
+	explicit lpglTimerScope(lpglTimer timer);
+	~lpglTimerScope();
+
+private:
+	lpglTimer m_timer;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+// Closes the current frame: its statistics become the last frame's and are
+// added to the cumulative statistics of tier.
+void lpglEndFrame(int tier = 0);
+
+const lpglStatistics& lpglGetFrameStatistics();
+const lpglStatistics& lpglGetCumulativeStatistics(int tier);
+
+// Writes every frame's statistics to the debug output from lpglEndFrame.
+void lpglSetPerFrameDump(bool enable);
+
+std::string lpglFormatStatistics(const lpglStatistics& statistics);
+
+// Writes per-frame averages of every tier that has frames.
+void lpglDumpStatistics();
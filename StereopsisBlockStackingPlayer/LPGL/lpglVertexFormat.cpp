@@ -0,0 +1,243 @@
+#include "pch.h"
+#include "lpglVertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+GLsizei lpglPositionSize(GLenum positionType)
+{
+	switch (positionType) {
+	case GL_FLOAT:
+		return 3 * sizeof(float);
+	case GL_HALF_FLOAT:
+	case GL_UNSIGNED_SHORT:
+		// Padded to four components; D3D has no three-component 16-bit formats.
+		return 4 * sizeof(uint16_t);
+	default:
+		return 0;
+	}
+}
+
+GLsizei lpglColorSize(GLenum colorType)
+{
+	switch (colorType) {
+	case GL_FLOAT:
+		return 3 * sizeof(float);
+	case GL_UNSIGNED_BYTE:
+		return 4 * sizeof(uint8_t);
+	default:
+		return 0;
+	}
+}
+
+uint16_t lpglFloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	const int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	// NaN stays NaN, anything too large becomes infinity.
+	if (((bits >> 23) & 0xFF) == 0xFF)
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+	if (exponent >= 0x1F)
+		return sign | 0x7C00;
+
+	if (exponent <= 0) {
+		// Denormal or zero.
+		if (exponent < -10)
+			return sign;
+
+		mantissa |= 0x800000;
+		const int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+
+		// Round to nearest even.
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	const uint32_t rest = mantissa & 0x1FFF;
+
+	// A carry out of the mantissa correctly bumps the exponent.
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+
+	return sign | static_cast<uint16_t>(half);
+}
+
+float lpglHalfToFloat(uint16_t value)
+{
+	const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+	int exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	uint32_t bits;
+
+	if (exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent == 0) {
+		if (mantissa == 0) {
+			bits = sign;
+		}
+		else {
+			// Renormalize the denormal.
+			exponent = 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				exponent--;
+			}
+
+			bits = sign | (static_cast<uint32_t>(exponent - 15 + 127) << 23) | ((mantissa & 0x3FF) << 13);
+		}
+	}
+	else {
+		bits = sign | (static_cast<uint32_t>(exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+XMFLOAT3 lpglReadPosition(GLenum positionType, const unsigned char* vertex)
+{
+	switch (positionType) {
+	case GL_HALF_FLOAT: {
+		uint16_t half[3];
+		memcpy(half, vertex, sizeof(half));
+		return XMFLOAT3(lpglHalfToFloat(half[0]), lpglHalfToFloat(half[1]), lpglHalfToFloat(half[2]));
+	}
+	case GL_UNSIGNED_SHORT: {
+		uint16_t normalized[3];
+		memcpy(normalized, vertex, sizeof(normalized));
+		return XMFLOAT3(normalized[0] / 65535.0f, normalized[1] / 65535.0f, normalized[2] / 65535.0f);
+	}
+	default: {
+		XMFLOAT3 position;
+		memcpy(&position, vertex, sizeof(position));
+		return position;
+	}
+	}
+}
+
+XMFLOAT3 lpglReadColor(GLenum positionType, GLenum colorType, GLuint color, const unsigned char* vertex)
+{
+	vertex += lpglPositionSize(positionType);
+
+	switch (colorType) {
+	case GL_FLOAT: {
+		XMFLOAT3 result;
+		memcpy(&result, vertex, sizeof(result));
+		return result;
+	}
+	case GL_UNSIGNED_BYTE:
+		return XMFLOAT3(vertex[0] / 255.0f, vertex[1] / 255.0f, vertex[2] / 255.0f);
+	default:
+		return XMFLOAT3((color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f, ((color >> 16) & 0xFF) / 255.0f);
+	}
+}
+
+void lpglVertexLayout::Bind() const
+{
+	glVertexFormat(positionType, colorType);
+
+	if (positionType == GL_UNSIGNED_SHORT)
+		glVertexPositionBounds(&boundsMin.x, &boundsMax.x);
+
+	if (colorType == GL_NONE)
+		glColor3f(color.x, color.y, color.z);
+}
+
+void lpglVertexLayout::Write(void* vertices, size_t i, const XMFLOAT3& position, const XMFLOAT3& vertexColor) const
+{
+	unsigned char* vertex = static_cast<unsigned char*>(vertices) + i * Stride();
+
+	switch (positionType) {
+	case GL_HALF_FLOAT: {
+		const uint16_t half[4] = {
+			lpglFloatToHalf(position.x), lpglFloatToHalf(position.y), lpglFloatToHalf(position.z), 0
+		};
+		memcpy(vertex, half, sizeof(half));
+		break;
+	}
+	case GL_UNSIGNED_SHORT: {
+		auto quantize = [](float value, float min, float max) {
+			const float t = max > min ? (value - min) / (max - min) : 0.0f;
+			return static_cast<uint16_t>(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f + 0.5f);
+		};
+
+		const uint16_t normalized[4] = {
+			quantize(position.x, boundsMin.x, boundsMax.x),
+			quantize(position.y, boundsMin.y, boundsMax.y),
+			quantize(position.z, boundsMin.z, boundsMax.z),
+			0
+		};
+		memcpy(vertex, normalized, sizeof(normalized));
+		break;
+	}
+	default:
+		memcpy(vertex, &position, sizeof(position));
+		break;
+	}
+
+	vertex += lpglPositionSize(positionType);
+
+	switch (colorType) {
+	case GL_FLOAT:
+		memcpy(vertex, &vertexColor, sizeof(vertexColor));
+		break;
+	case GL_UNSIGNED_BYTE: {
+		auto channel = [](float value) {
+			return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+		};
+
+		vertex[0] = channel(vertexColor.x);
+		vertex[1] = channel(vertexColor.y);
+		vertex[2] = channel(vertexColor.z);
+		vertex[3] = 0xFF;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+lpglVertexLayout lpglChooseVertexLayout(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax,
+	float tolerance, bool singleColor, const XMFLOAT3& color)
+{
+	lpglVertexLayout layout;
+	layout.boundsMin = boundsMin;
+	layout.boundsMax = boundsMax;
+	layout.color = color;
+	layout.colorType = singleColor ? GL_NONE : GL_UNSIGNED_BYTE;
+
+	const float largest = std::max({ std::fabs(boundsMin.x), std::fabs(boundsMin.y), std::fabs(boundsMin.z),
+		std::fabs(boundsMax.x), std::fabs(boundsMax.y), std::fabs(boundsMax.z) });
+	const float extent = std::max({ boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z });
+
+	// Worst-case rounding error: half an ulp of the largest coordinate for half
+	// floats (11 significant bits), half a step for 16-bit normalized values.
+	const float halfError = largest * std::ldexp(1.0f, -11);
+	const float normalizedError = extent / 65535.0f * 0.5f;
+
+	// Half floats need no decoding, so they win when both are precise enough.
+	if (largest < 65504.0f && halfError <= tolerance)
+		layout.positionType = GL_HALF_FLOAT;
+	else if (normalizedError <= tolerance)
+		layout.positionType = GL_UNSIGNED_SHORT;
+	else
+		layout.positionType = GL_FLOAT;
+
+	return layout;
+}
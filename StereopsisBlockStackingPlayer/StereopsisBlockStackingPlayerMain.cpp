@@ -2,6 +2,7 @@
 #include "StereopsisBlockStackingPlayerMain.h"
 #include "Common\DirectXHelper.h"
 #include "LPGL\lpgl.h"
+#include "Common\AllocationTracker.h"
 #include "Common\FramerateController.h"
 
 #include <windows.graphics.directx.direct3d11.interop.h>
@@ -131,82 +132,61 @@ struct QuadTree
 
     Node* rootNode = nullptr;
 
-    static QuadTree* Create(const std::vector<const BoundingBox2D*>& geometries, const int kMaxDepth);
-
-    ~QuadTree()
-    {
-        DeleteSubtree(rootNode);
-
-        if (rootNode) {
-            delete rootNode;
-            rootNode = nullptr;
-        }
-    }
+    // The tree and its nodes are allocated from the given frame arena and are
+    // released when it is reset.
+    static QuadTree* Create(FrameArena& arena, const FrameVector<const BoundingBox2D*>& geometries, const int kMaxDepth);
+};
 
-    void DeleteSubtree(Node* node)
-    {
-        if (!node)
-            return;
+static void AddQuadTreeDepth(FrameArena& arena, const BoundingBox2D& area, const FrameVector<const BoundingBox2D*>& geometries,
+    int depth, const int kMaxDepth, QuadTree::Node* parent)
+{
+    auto& Min = area.Min;
+    auto& Max = area.Max;
+    float halfWidth = area.Width() * 0.5f;
+    float halfHeight = area.Height() * 0.5f;
+    const BoundingBox2D subareas[4] = {
+        BoundingBox2D(XMFLOAT2(Min.x, Min.y), XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight)),
+        BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y), XMFLOAT2(Max.x, Min.y + halfHeight)),
+        BoundingBox2D(XMFLOAT2(Min.x, Min.y + halfHeight), XMFLOAT2(Min.x + halfWidth, Max.y)),
+        BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight), XMFLOAT2(Max.x, Max.y))
+    };
 
-        for (auto* child : node->children) {
-            DeleteSubtree(child);
+    for (int i = 0; i < 4; ++i) {
+        auto& subarea = subareas[i];
+
+        for (auto* geometry : geometries) {
+            if (subarea.Intersect(*geometry)) {
+                QuadTree::Node* pNode = arena.Create<QuadTree::Node>();
+                parent->children[i] = pNode;
+                pNode->parent = parent;
+                pNode->isFull = false;
+                pNode->depth = depth;
+
+                if (depth + 1 < kMaxDepth) {
+                    AddQuadTreeDepth(arena, subarea, geometries, depth + 1, kMaxDepth, pNode);
+                }
 
-            if (child) {
-                delete child;
-                child = nullptr;
+                break;
             }
         }
     }
-};
 
-QuadTree* QuadTree::Create(const std::vector<const BoundingBox2D*>& geometries, const int kMaxDepth)
-{
-    QuadTree* res = new QuadTree();
-
-    std::function<void(const BoundingBox2D&, const std::vector<const BoundingBox2D*>&, int, QuadTree::Node*)> addDepth
-        = [&](const BoundingBox2D& area, const std::vector<const BoundingBox2D*>& geometries, int depth, QuadTree::Node* parent) {
-        auto& Min = area.Min;
-        auto& Max = area.Max;
-        float halfWidth = area.Width() * 0.5f;
-        float halfHeight = area.Height() * 0.5f;
-        std::vector<BoundingBox2D> subareas;
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x, Min.y), XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y), XMFLOAT2(Max.x, Min.y + halfHeight)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x, Min.y + halfHeight), XMFLOAT2(Min.x + halfWidth, Max.y)));
-        subareas.push_back(BoundingBox2D(XMFLOAT2(Min.x + halfWidth, Min.y + halfHeight), XMFLOAT2(Max.x, Max.y)));
-
-        for (int i = 0; i < subareas.size(); ++i) {
-            auto& subarea = subareas[i];
-
-            for (auto* geometry : geometries) {
-                if (subarea.Intersect(*geometry)) {
-                    QuadTree::Node* pNode = new QuadTree::Node();
-                    parent->children[i] = pNode;
-                    pNode->parent = parent;
-                    pNode->isFull = false;
-                    pNode->depth = depth;
-
-                    if (depth + 1 < kMaxDepth) {
-                        addDepth(subarea, geometries, depth + 1, pNode);
-                    }
-
-                    break;
-                }
-            }
-        }
+    parent->isFull = parent->children[0] && parent->children[1] && parent->children[2] && parent->children[3];
+}
 
-        parent->isFull = parent->children[0] && parent->children[1] && parent->children[2] && parent->children[3];
-    };
+QuadTree* QuadTree::Create(FrameArena& arena, const FrameVector<const BoundingBox2D*>& geometries, const int kMaxDepth)
+{
+    QuadTree* res = arena.Create<QuadTree>();
 
     BoundingBox2D viewArea(XMFLOAT2(-1, -1), XMFLOAT2(1, 1));
-    QuadTree::Node* pRootNode = new QuadTree::Node();
+    QuadTree::Node* pRootNode = arena.Create<QuadTree::Node>();
     pRootNode->parent = nullptr;
     pRootNode->isFull = true;
     pRootNode->depth = 0;
 
     res->rootNode = pRootNode;
 
-    addDepth(viewArea, geometries, 1, res->rootNode);
+    AddQuadTreeDepth(arena, viewArea, geometries, 1, kMaxDepth, res->rootNode);
 
     return res;
 }
@@ -244,10 +224,16 @@ StereopsisBlockStackingPlayerMain::StereopsisBlockStackingPlayerMain(const std::
     m_deviceResources(deviceResources)
 {
     m_deviceResources->RegisterDeviceNotify(this);
+
+    m_timer.SetFixedTimeStep(true);
+    m_timer.SetTargetElapsedSeconds(1.0 / 60.0);
+    m_timer.SetMaxStepsPerTick(kMaxSimulationStepsPerFrame);
 }
 
 void StereopsisBlockStackingPlayerMain::SetHolographicSpace(HolographicSpace^ holographicSpace)
 {
+    AllocationPhaseScope loadPhase(eAPLoad);
+
     UnregisterHolographicEventHandlers();
 
     m_holographicSpace = holographicSpace;
@@ -282,8 +268,21 @@ void StereopsisBlockStackingPlayerMain::SetHolographicSpace(HolographicSpace^ ho
 
     int N = 5;
 
+    // The renderers share one load of the mesh through the cache, which keeps
+    // the processed mesh in the app's local folder for the next launch.
+    {
+        String^ localFolder = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+
+        const int length = WideCharToMultiByte(CP_UTF8, 0, localFolder->Data(), -1, nullptr, 0, nullptr, nullptr);
+        std::string meshFileDirectory(length > 0 ? length - 1 : 0, '\0');
+        if (length > 1)
+            WideCharToMultiByte(CP_UTF8, 0, localFolder->Data(), -1, &meshFileDirectory[0], length, nullptr, nullptr);
+
+        m_meshAssets = std::make_shared<MeshAssetCache>(meshFileDirectory);
+    }
+
     for (int i = 0; i < N; ++i) {
-        m_meshRenderers.push_back(std::make_unique<SpinningCubeRenderer>());
+        m_meshRenderers.push_back(std::make_unique<SpinningCubeRenderer>(m_meshAssets));
     }
 
     m_spatialInputHandler = std::make_unique<SpatialInputHandler>();
@@ -354,14 +353,66 @@ HolographicFrame^ StereopsisBlockStackingPlayerMain::Update()
 
     SpatialCoordinateSystem^ currentCoordinateSystem = m_referenceFrame->CoordinateSystem;
 
+    // Update-loop temporaries come from a frame arena. The two arenas alternate so
+    // the previous frame's quadtree stays valid while it is compared against.
+    m_frameArenaIndex ^= 1;
+    FrameArena& frameArena = m_frameArenas[m_frameArenaIndex];
+
+    if (lastQuadTree && frameArena.Owns(lastQuadTree))
+        lastQuadTree = nullptr;
+
+    frameArena.Reset();
+
+    // Recorded frames are played back one per fixed simulation step, so the
+    // playback speed does not depend on the rate the FramerateController picks.
     m_timer.Tick([&] ()
     {
+        // Play back recorded data
+        XMVECTOR headPosition = XMLoadFloat3(&records[currentRecordIndex].headPosition),
+        headDirection = XMLoadFloat3(&records[currentRecordIndex].headDirection),
+        upVector = XMVectorSet(0, 1, 0, 1),
+        mesh0 = XMLoadFloat3(&records[currentRecordIndex].mesh0),
+        mesh1 = XMLoadFloat3(&records[currentRecordIndex].mesh1),
+        mesh2 = XMLoadFloat3(&records[currentRecordIndex].mesh2),
+        mesh3 = XMLoadFloat3(&records[currentRecordIndex].mesh3),
+        mesh4 = XMLoadFloat3(&records[currentRecordIndex].mesh4);
+
+        XMMATRIX invCameraMatrix = XMMatrixLookAtRH(headPosition, headPosition + headDirection, upVector);
+
+        Windows::Foundation::Numerics::float3 vmesh0, vmesh1, vmesh2, vmesh3, vmesh4;
+
+        XMStoreFloat3(&vmesh0, XMVector3Transform(mesh0, invCameraMatrix));
+        XMStoreFloat3(&vmesh1, XMVector3Transform(mesh1, invCameraMatrix));
+        XMStoreFloat3(&vmesh2, XMVector3Transform(mesh2, invCameraMatrix));
+        XMStoreFloat3(&vmesh3, XMVector3Transform(mesh3, invCameraMatrix));
+        XMStoreFloat3(&vmesh4, XMVector3Transform(mesh4, invCameraMatrix));
+
+        m_meshRenderers[0]->SetPosition(vmesh0);
+        m_meshRenderers[1]->SetPosition(vmesh1);
+        m_meshRenderers[2]->SetPosition(vmesh2);
+        m_meshRenderers[3]->SetPosition(vmesh3);
+        m_meshRenderers[4]->SetPosition(vmesh4);
+
+        // The first record, at startup and on every loop, is a jump rather than
+        // motion, so it is not interpolated from where the meshes were.
+        const bool restarted = currentRecordIndex == 0;
+
+        if (currentRecordIndex + 1 < records.size())
+            currentRecordIndex++;
+        else
+            currentRecordIndex = 0;
+
         for (auto& meshRenderer : m_meshRenderers) {
             meshRenderer->Update(m_timer);
+
+            if (restarted)
+                meshRenderer->SkipInterpolation();
         }
     });
 
     for (auto cameraPose : prediction->CameraPoses) {
+        AllocationPhaseScope scorePhase(eAPScore);
+
         auto coordinateSystem = m_referenceFrame->CoordinateSystem;
 
         Platform::IBox<HolographicStereoTransform>^ viewTransformContainer = cameraPose->TryGetViewTransform(coordinateSystem);
@@ -373,14 +424,15 @@ HolographicFrame^ StereopsisBlockStackingPlayerMain::Update()
 
         auto VP = XMMatrixMultiply(viewMatrix, projectionMatrix);
 
-        std::vector<const BoundingBox2D*> bbs;
+        FrameVector<const BoundingBox2D*> bbs(frameArena);
+        bbs.reserve(m_meshRenderers.size());
         BoundingBox2D screen(XMFLOAT2(-1, -1), XMFLOAT2(1, 1));
         BoundingBox2D focusArea(XMFLOAT2(-0.25f, -0.25f), XMFLOAT2(0.25f, 0.25f));
 
         for (int i = 0; i < m_meshRenderers.size(); ++i) {
             BoundingBox bb = m_meshRenderers[i]->GetBoundingBox();
             XMFLOAT3 corners[8];
-            auto* boundingBox2D = new BoundingBox2D();
+            auto* boundingBox2D = frameArena.Create<BoundingBox2D>();
 
             bb.GetCorners(corners);
 
@@ -405,7 +457,7 @@ HolographicFrame^ StereopsisBlockStackingPlayerMain::Update()
             }
         }
 
-        auto* quadTree = QuadTree::Create(bbs, 16);
+        auto* quadTree = QuadTree::Create(frameArena, bbs, 16);
 
         if (lastQuadTree) {
             float dynamicScore = GetDynamicScoreBasedOnQuadtree(lastQuadTree->rootNode, quadTree->rootNode);
@@ -414,34 +466,22 @@ HolographicFrame^ StereopsisBlockStackingPlayerMain::Update()
 
             if (framerateController->GetFPS() > 60 - 1) {
                 if (dynamicScore < threshold.level1) {
-                    framerateController->SetFramerate(30);
+                    framerateController->RequestFramerate(30);
                 }
             }
             else if (framerateController->GetFPS() > 30 - 1) {
                 if (dynamicScore > threshold.level1) {
-                    framerateController->SetFramerate(60);
+                    framerateController->RequestFramerate(60);
                 }
                 else if (dynamicScore < threshold.level2) {
-                    framerateController->SetFramerate(15);
+                    framerateController->RequestFramerate(15);
                 }
             }
             else if (framerateController->GetFPS() > 15 - 1) {
                 if (dynamicScore > threshold.level2) {
-                    framerateController->SetFramerate(30);
+                    framerateController->RequestFramerate(30);
                 }
             }
-
-            if (lastQuadTree) {
-                delete lastQuadTree;
-                lastQuadTree = nullptr;
-            }
-        }
-
-        for (int i = 0; i < bbs.size(); ++i) {
-            if (bbs[i]) {
-                delete bbs[i];
-                bbs[i] = nullptr;
-            }
         }
 
         lastQuadTree = quadTree;
@@ -449,36 +489,26 @@ HolographicFrame^ StereopsisBlockStackingPlayerMain::Update()
         break;
     }
 
-    // Play back recorded data
-    XMVECTOR headPosition = XMLoadFloat3(&records[currentRecordIndex].headPosition),
-    headDirection = XMLoadFloat3(&records[currentRecordIndex].headDirection),
-    upVector = XMVectorSet(0, 1, 0, 1),
-    mesh0 = XMLoadFloat3(&records[currentRecordIndex].mesh0),
-    mesh1 = XMLoadFloat3(&records[currentRecordIndex].mesh1),
-    mesh2 = XMLoadFloat3(&records[currentRecordIndex].mesh2),
-    mesh3 = XMLoadFloat3(&records[currentRecordIndex].mesh3),
-    mesh4 = XMLoadFloat3(&records[currentRecordIndex].mesh4);
-
-    XMMATRIX invCameraMatrix = XMMatrixLookAtRH(headPosition, headPosition + headDirection, upVector);
-
-    Windows::Foundation::Numerics::float3 vmesh0, vmesh1, vmesh2, vmesh3, vmesh4;
-
-    XMStoreFloat3(&vmesh0, XMVector3Transform(mesh0, invCameraMatrix));
-    XMStoreFloat3(&vmesh1, XMVector3Transform(mesh1, invCameraMatrix));
-    XMStoreFloat3(&vmesh2, XMVector3Transform(mesh2, invCameraMatrix));
-    XMStoreFloat3(&vmesh3, XMVector3Transform(mesh3, invCameraMatrix));
-    XMStoreFloat3(&vmesh4, XMVector3Transform(mesh4, invCameraMatrix));
-
-    m_meshRenderers[0]->SetPosition(vmesh0);
-    m_meshRenderers[1]->SetPosition(vmesh1);
-    m_meshRenderers[2]->SetPosition(vmesh2);
-    m_meshRenderers[3]->SetPosition(vmesh3);
-    m_meshRenderers[4]->SetPosition(vmesh4);
-
-    if (currentRecordIndex + 1 < records.size())
-        currentRecordIndex++;
-    else
-        currentRecordIndex = 0;
+#ifdef _DEBUG
+    // Once warmed up, Update should not reach the global heap at all. The tracker
+    // closes frames after Render, so it reports the previous Update; without
+    // TRACK_ALLOCATIONS only the frame arena's own growth is visible.
+    if (m_timer.GetFrameCount() > kFrameArenaWarmupSteps) {
+        const unsigned long long allocations = AllocationTracker::IsEnabled()
+            ? AllocationTracker::GetLastFrameCounters(eAPUpdate).allocations + AllocationTracker::GetLastFrameCounters(eAPScore).allocations
+            : frameArena.GetHeapAllocationsThisFrame();
+
+        if (allocations != 0) {
+            m_steadyStateHeapAllocations += allocations;
+
+            // Formatted on the stack, so the report does not count against the next frame.
+            char message[128];
+            sprintf_s(message, "Update: %llu heap allocations after warm-up, %llu in total.\n",
+                allocations, m_steadyStateHeapAllocations);
+            OutputDebugStringA(message);
+        }
+    }
+#endif
 
     return holographicFrame;
 }
@@ -516,9 +546,18 @@ bool StereopsisBlockStackingPlayerMain::Render(Windows::Graphics::Holographic::H
 
             if (cameraActive)
             {
-                for (auto& meshRenderer : m_meshRenderers) {
-                    meshRenderer->Render();
-                }
+                float interpolation = static_cast<float>(m_timer.GetInterpolationFactor());
+
+                // Draws are sorted front to back from the left eye at glFlush.
+                lpglSetViewProjection(&pCameraResources->GetViewProjection(0).m[0][0]);
+
+                // Draws no eye sees are dropped there too; both eyes' matrices are adjacent.
+                lpglSetCullingViewProjections(&pCameraResources->GetViewProjection(0).m[0][0]);
+
+                SpinningCubeRenderer::RenderBatch(m_meshRenderers, interpolation);
+
+                // Submit this camera's draws while its render target is bound.
+                glFlush();
             }
             atLeastOneCameraRendered = true;
         }
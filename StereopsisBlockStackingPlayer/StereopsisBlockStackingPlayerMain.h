@@ -12,6 +12,7 @@
 
 #include "Common\DeviceResources.h"
 #include "Common\StepTimer.h"
+#include "Common\FrameArena.h"
 
 #ifdef DRAW_SAMPLE_CONTENT
 #include "Content\SpinningCubeRenderer.h"
@@ -68,6 +69,7 @@ namespace StereopsisBlockStackingPlayer
 
         void UnregisterHolographicEventHandlers();
 
+        std::shared_ptr<MeshAssetCache>                                 m_meshAssets;
         std::vector<std::unique_ptr<SpinningCubeRenderer>>              m_meshRenderers;
 
         std::vector<Record> records;
@@ -79,6 +81,19 @@ namespace StereopsisBlockStackingPlayer
 
         DX::StepTimer                                                   m_timer;
 
+        static const uint32 kMaxSimulationStepsPerFrame = 5;
+
+        // Double-buffered arenas for per-frame temporaries in Update.
+        FrameArena                                                      m_frameArenas[2];
+        int                                                             m_frameArenaIndex = 0;
+
+#ifdef _DEBUG
+        static const uint32 kFrameArenaWarmupSteps = 60;
+
+        // Heap allocations made by Update after warm-up. Should stay zero.
+        unsigned long long                                              m_steadyStateHeapAllocations = 0;
+#endif
+
         Windows::Graphics::Holographic::HolographicSpace^               m_holographicSpace;
 
         Windows::Perception::Spatial::SpatialLocator^                   m_locator;
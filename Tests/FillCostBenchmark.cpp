@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "Content/MeshAssetCache.h"
+#include "LPGL/lpglSoftwareBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+using namespace DirectX;
+using namespace StereopsisBlockStackingPlayer;
+
+// Renders a grid of copies of a mesh asset with the software backend at the
+// device's per-eye resolution, once with the full mesh and once with its voxel
+// proxy, and prints what each costs to fill.
+//
+//     FillCostBenchmark [file.obj [octreeDepth]]
+
+namespace {
+
+const int kWidth = 1268;
+const int kHeight = 720;
+const int kColumns = 6;
+const int kRows = 4;
+const int kRuns = 5;
+
+// Largest extent of each copy, the distance between their centers and the
+// distance of the grid, in meters; the grid fits in the view.
+const float kCopySize = 0.15f;
+const float kSpacing = 0.18f;
+const float kDistance = 2.5f;
+
+struct FillCost {
+	lpglSoftwareBackend::Counters counters;
+	unsigned long long pixelsCovered = 0;
+	double milliseconds = 0;
+};
+
+FillCost Measure(lpglSoftwareBackend& backend, const MeshGeometry& geometry, const std::vector<XMFLOAT4X4>& transforms)
+{
+	FillCost cost;
+
+	for (int run = 0; run < kRuns; ++run) {
+		backend.Clear();
+		backend.ResetCounters();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		glBindVertexArray(geometry.vertexArray);
+		glLoadIdentity();
+		glInstanceTransforms(static_cast<GLsizei>(transforms.size()), &transforms[0].m[0][0]);
+		glDrawElementsInstanced(GL_TRIANGLES, geometry.indexCount, geometry.indexType, nullptr,
+			LPGL_VIEW_COUNT * static_cast<GLsizei>(transforms.size()));
+		glBindVertexArray(0);
+		glFlush();
+
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (run == 0 || elapsed.count() < cost.milliseconds)
+			cost.milliseconds = elapsed.count();
+	}
+
+	cost.counters = backend.GetCounters();
+
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		const float* depth = backend.GetDepth(view);
+		cost.pixelsCovered += std::count_if(depth, depth + kWidth * kHeight, [](float d) { return d < 1.0f; });
+	}
+
+	return cost;
+}
+
+void Print(const char* name, const FillCost& cost)
+{
+	const lpglSoftwareBackend::Counters& counters = cost.counters;
+
+	printf("%-6s %10llu %10llu %12llu %12llu %12llu %8.2f %9.2f ms\n", name,
+		counters.triangleCount, counters.rasterizedTriangleCount, counters.pixelsTested, counters.pixelsWritten,
+		cost.pixelsCovered, cost.pixelsCovered ? static_cast<double>(counters.pixelsTested) / cost.pixelsCovered : 0.0,
+		cost.milliseconds);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	MeshAssetDesc desc;
+	desc.path = argc > 1 ? argv[1] : STEREOPSIS_PLAYER_ASSETS_DIR "/cylinder.obj";
+	if (argc > 2)
+		desc.octreeDepth = atoi(argv[2]);
+
+	std::unique_ptr<lpglSoftwareBackend> backendOwner(new lpglSoftwareBackend(kWidth, kHeight));
+	lpglSoftwareBackend& backend = *backendOwner;
+	lpglInit(std::move(backendOwner));
+	lpglSetDrawSorting(false);
+
+	// Eyes 64 mm apart, with the device's 30 by 17.5 degree field of view.
+	for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+		const float eyeX = view == 0 ? -0.032f : 0.032f;
+
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection,
+			XMMatrixLookToRH(XMVectorSet(eyeX, 0, 0, 1), XMVectorSet(0, 0, -1, 0), XMVectorSet(0, 1, 0, 0)) *
+			XMMatrixPerspectiveFovRH(XMConvertToRadians(17.5f), static_cast<float>(kWidth) / kHeight, 0.1f, 20.0f));
+		backend.SetViewProjection(view, viewProjection);
+	}
+
+	MeshAssetCache cache;
+	const std::shared_ptr<const MeshAsset> asset = cache.Acquire(desc);
+
+	if (!asset->mesh.indexCount) {
+		fprintf(stderr, "No triangles in %s\n", desc.path.c_str());
+		return 1;
+	}
+
+	// Copies scaled to kCopySize, centered on the cells of the grid and turned
+	// a little so their sides show.
+	const BoundingBox& bounds = asset->mesh.bounds;
+	const float scale = kCopySize / (2 * std::max({ bounds.Extents.x, bounds.Extents.y, bounds.Extents.z }));
+
+	std::vector<XMFLOAT4X4> transforms;
+
+	for (int row = 0; row < kRows; ++row) {
+		for (int column = 0; column < kColumns; ++column) {
+			const float x = (column - (kColumns - 1) * 0.5f) * kSpacing;
+			const float y = (row - (kRows - 1) * 0.5f) * kSpacing;
+
+			XMFLOAT4X4 transform;
+			XMStoreFloat4x4(&transform,
+				XMMatrixTranslation(-bounds.Center.x, -bounds.Center.y, -bounds.Center.z) *
+				XMMatrixScaling(scale, scale, scale) *
+				XMMatrixRotationY(XMConvertToRadians(20.0f * (row * kColumns + column))) *
+				XMMatrixTranslation(x, y, -kDistance));
+			transforms.push_back(transform);
+		}
+	}
+
+	printf("%s, octree depth %d, %d copies at %dx%d per eye\n", desc.path.c_str(), desc.octreeDepth,
+		kColumns * kRows, kWidth, kHeight);
+	printf("%-6s %10s %10s %12s %12s %12s %8s %12s\n", "", "triangles", "rasterized", "tested", "written",
+		"covered", "overdraw", "time");
+
+	Print("mesh", Measure(backend, asset->mesh, transforms));
+	Print("proxy", Measure(backend, asset->proxy, transforms));
+
+	return 0;
+}
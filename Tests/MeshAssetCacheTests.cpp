@@ -0,0 +1,255 @@
+#include "pch.h"
+#include "Content/MeshAssetCache.h"
+#include "Content/MeshFile.h"
+#include "LPGL/lpglNullBackend.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <unistd.h>
+
+using namespace StereopsisBlockStackingPlayer;
+
+class MeshAssetCacheTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		std::unique_ptr<lpglNullBackend> backend(new lpglNullBackend());
+		m_backend = backend.get();
+		lpglInit(std::move(backend));
+
+		// ctest runs every test in its own process, possibly at the same time.
+		m_directory = std::filesystem::path(::testing::TempDir()) /
+			("MeshAssetCacheTest." + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()) +
+			"." + std::to_string(getpid()));
+		std::filesystem::remove_all(m_directory);
+		std::filesystem::create_directories(m_directory / "meshes");
+
+		m_desc.path = (m_directory / "sphere.obj").string();
+		WriteSphere(12);
+	}
+
+	void TearDown() override
+	{
+		std::filesystem::remove_all(m_directory);
+	}
+
+	// A UV sphere with segments segments around and segments / 2 rings, so
+	// the voxel proxy has boxes at every depth.
+	void WriteSphere(int segments)
+	{
+		const float pi = 3.14159265f;
+		const int rings = segments / 2;
+
+		std::ofstream obj(m_desc.path, std::ios::binary | std::ios::trunc);
+
+		for (int ring = 0; ring <= rings; ++ring) {
+			const float theta = pi * ring / rings;
+
+			for (int segment = 0; segment < segments; ++segment) {
+				const float phi = 2 * pi * segment / segments;
+				obj << "v " << sin(theta) * cos(phi) << " " << cos(theta) << " " << sin(theta) * sin(phi) << "\n";
+			}
+		}
+
+		for (int ring = 0; ring < rings; ++ring) {
+			for (int segment = 0; segment < segments; ++segment) {
+				const int a = ring * segments + segment + 1;
+				const int b = ring * segments + (segment + 1) % segments + 1;
+				obj << "f " << a << " " << b << " " << b + segments << " " << a + segments << "\n";
+			}
+		}
+	}
+
+	std::string MeshDirectory() const { return (m_directory / "meshes").string(); }
+
+	// The one mesh file in the directory; stale files are replaced, never left behind.
+	std::filesystem::path MeshFilePath() const
+	{
+		std::vector<std::filesystem::path> files;
+		for (const auto& entry : std::filesystem::directory_iterator(m_directory / "meshes"))
+			files.push_back(entry.path());
+
+		EXPECT_EQ(1u, files.size());
+		return files.empty() ? std::filesystem::path() : files[0];
+	}
+
+	std::vector<char> ReadMeshFile() const
+	{
+		std::ifstream file(MeshFilePath(), std::ios::binary);
+		return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void WriteMeshFile(const std::vector<char>& contents) const
+	{
+		std::ofstream file(MeshFilePath(), std::ios::binary | std::ios::trunc);
+		file.write(contents.data(), contents.size());
+	}
+
+	// Loads the asset with a new cache, as a new launch would.
+	std::shared_ptr<const MeshAsset> Load() const
+	{
+		MeshAssetCache cache(MeshDirectory());
+		return cache.Acquire(m_desc);
+	}
+
+	// Moves the mesh bounds recorded in the mesh file's header, which the
+	// payload hash does not cover; a load that shows the moved bounds was
+	// served from the file rather than rebuilt.
+	void MarkMeshFile() const
+	{
+		std::vector<char> contents = ReadMeshFile();
+		ASSERT_GE(contents.size(), sizeof(MeshFileHeader));
+
+		MeshFileHeader header;
+		memcpy(&header, contents.data(), sizeof(header));
+		header.mesh.boundsCenter.x += kMark;
+		memcpy(contents.data(), &header, sizeof(header));
+
+		WriteMeshFile(contents);
+	}
+
+	static bool IsMarked(const MeshAsset& asset, const MeshAsset& built)
+	{
+		return asset.mesh.bounds.Center.x == built.mesh.bounds.Center.x + kMark;
+	}
+
+	static void ExpectSameGeometry(const MeshGeometry& expected, const MeshGeometry& actual)
+	{
+		EXPECT_EQ(expected.indexCount, actual.indexCount);
+		EXPECT_EQ(expected.indexType, actual.indexType);
+		EXPECT_EQ(expected.bounds.Center.x, actual.bounds.Center.x);
+		EXPECT_EQ(expected.bounds.Extents.y, actual.bounds.Extents.y);
+	}
+
+	static constexpr float kMark = 100.0f;
+
+	lpglNullBackend* m_backend = nullptr;
+	std::filesystem::path m_directory;
+	MeshAssetDesc m_desc;
+};
+
+TEST_F(MeshAssetCacheTest, BuildsWritesAndMapsTheMeshFile)
+{
+	const std::shared_ptr<const MeshAsset> built = Load();
+
+	// Two triangles per quad of the sphere, and 12 per proxy box.
+	EXPECT_EQ(12u * 6 * 6, built->mesh.indexCount);
+	EXPECT_GT(built->proxy.indexCount, 0u);
+	EXPECT_EQ(0u, built->proxy.indexCount % 36);
+
+	const std::vector<char> written = ReadMeshFile();
+	ASSERT_GE(written.size(), sizeof(MeshFileHeader));
+
+	MeshFileHeader header;
+	memcpy(&header, written.data(), sizeof(header));
+	EXPECT_EQ(kMeshFileMagic, header.magic);
+	EXPECT_EQ(kMeshFileVersion, header.version);
+	EXPECT_EQ(built->mesh.indexCount, header.mesh.indexCount);
+	EXPECT_EQ(built->proxy.indexCount, header.proxy.indexCount);
+
+	const unsigned long long builtBytes = m_backend->GetCounters().bufferBytes;
+	EXPECT_EQ(header.mesh.vertexSize + header.mesh.indexSize + header.proxy.vertexSize + header.proxy.indexSize, builtBytes);
+
+	MarkMeshFile();
+	const std::shared_ptr<const MeshAsset> mapped = Load();
+
+	EXPECT_TRUE(IsMarked(*mapped, *built));
+	EXPECT_EQ(2 * builtBytes, m_backend->GetCounters().bufferBytes);
+	ExpectSameGeometry(built->proxy, mapped->proxy);
+	EXPECT_EQ(built->mesh.indexCount, mapped->mesh.indexCount);
+}
+
+TEST_F(MeshAssetCacheTest, RebuildsCorruptedMeshFile)
+{
+	const std::shared_ptr<const MeshAsset> built = Load();
+	MarkMeshFile();
+
+	std::vector<char> corrupted = ReadMeshFile();
+	corrupted[sizeof(MeshFileHeader) + 1] ^= 1;
+	WriteMeshFile(corrupted);
+
+	const std::shared_ptr<const MeshAsset> rebuilt = Load();
+
+	EXPECT_FALSE(IsMarked(*rebuilt, *built));
+	ExpectSameGeometry(built->mesh, rebuilt->mesh);
+	ExpectSameGeometry(built->proxy, rebuilt->proxy);
+
+	// The rewritten file is good again.
+	MarkMeshFile();
+	EXPECT_TRUE(IsMarked(*Load(), *built));
+}
+
+TEST_F(MeshAssetCacheTest, RebuildsTornMeshFile)
+{
+	const std::shared_ptr<const MeshAsset> built = Load();
+	const size_t size = ReadMeshFile().size();
+
+	// Cut inside the payload and inside the header.
+	for (size_t tornSize : { size - 1, size / 2, sizeof(MeshFileHeader) / 2, size_t(0) }) {
+		SCOPED_TRACE(tornSize);
+
+		MarkMeshFile();
+		std::vector<char> torn = ReadMeshFile();
+		torn.resize(tornSize);
+		WriteMeshFile(torn);
+
+		const std::shared_ptr<const MeshAsset> rebuilt = Load();
+
+		EXPECT_FALSE(IsMarked(*rebuilt, *built));
+		ExpectSameGeometry(built->mesh, rebuilt->mesh);
+		EXPECT_EQ(size, ReadMeshFile().size());
+	}
+}
+
+TEST_F(MeshAssetCacheTest, RebuildsWhenTheSourceChanges)
+{
+	const std::shared_ptr<const MeshAsset> built = Load();
+	const std::filesystem::path builtPath = MeshFilePath();
+
+	MeshFileHeader builtHeader;
+	memcpy(&builtHeader, ReadMeshFile().data(), sizeof(builtHeader));
+
+	MarkMeshFile();
+	WriteSphere(16);
+
+	const std::shared_ptr<const MeshAsset> rebuilt = Load();
+
+	EXPECT_EQ(16u * 8 * 6, rebuilt->mesh.indexCount);
+
+	// Same file, rewritten for the new source.
+	EXPECT_EQ(builtPath, MeshFilePath());
+
+	MeshFileHeader rebuiltHeader;
+	memcpy(&rebuiltHeader, ReadMeshFile().data(), sizeof(rebuiltHeader));
+	EXPECT_NE(builtHeader.key, rebuiltHeader.key);
+	EXPECT_EQ(rebuilt->mesh.indexCount, rebuiltHeader.mesh.indexCount);
+}
+
+TEST_F(MeshAssetCacheTest, BuildParametersAreKeptApart)
+{
+	const std::shared_ptr<const MeshAsset> shallow = Load();
+
+	m_desc.octreeDepth++;
+	MeshAssetCache cache(MeshDirectory());
+	const std::shared_ptr<const MeshAsset> deep = cache.Acquire(m_desc);
+
+	EXPECT_NE(deep->proxy.indexCount, shallow->proxy.indexCount);
+	EXPECT_EQ(2, std::distance(std::filesystem::directory_iterator(m_directory / "meshes"), std::filesystem::directory_iterator()));
+}
+
+TEST_F(MeshAssetCacheTest, AcquireSharesTheLoadedAsset)
+{
+	MeshAssetCache cache(MeshDirectory());
+
+	const std::shared_ptr<const MeshAsset> first = cache.Acquire(m_desc);
+	const unsigned long long bufferCount = m_backend->GetCounters().bufferDataCount;
+
+	EXPECT_EQ(first, cache.Acquire(m_desc));
+	EXPECT_EQ(bufferCount, m_backend->GetCounters().bufferDataCount);
+}
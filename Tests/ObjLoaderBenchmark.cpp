@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "Content/ObjLoader.h"
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+using namespace StereopsisBlockStackingPlayer;
+
+// Times LoadObjMesh at every thread count from 1 to the hardware's, against
+// tinyobj::LoadObj, on the OBJ file given or on a generated grid of about two
+// million triangles.
+//
+//     ObjLoaderBenchmark [file.obj]
+
+namespace {
+
+const int kRuns = 3;
+
+std::string WriteGrid(int size)
+{
+	const std::string path = "ObjLoaderBenchmark.obj";
+	std::ofstream file(path, std::ios::binary);
+
+	for (int y = 0; y <= size; ++y) {
+		for (int x = 0; x <= size; ++x)
+			file << "v " << x * 0.01 << " " << y * 0.01 << " " << (x * y % 17) * 0.001 << "\n";
+	}
+
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			const int corner = y * (size + 1) + x + 1;
+			file << "f " << corner << " " << corner + 1 << " " << corner + size + 2 << " " << corner + size + 1 << "\n";
+		}
+	}
+
+	return path;
+}
+
+// Fastest of kRuns calls, in milliseconds.
+template <typename Load>
+double Time(const Load& load)
+{
+	double best = 0;
+
+	for (int run = 0; run < kRuns; ++run) {
+		const auto start = std::chrono::steady_clock::now();
+		load();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (run == 0 || elapsed.count() < best)
+			best = elapsed.count();
+	}
+
+	return best;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : WriteGrid(1000);
+
+	const double tinyObj = Time([&] {
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string err;
+		tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str());
+	});
+
+	printf("%s\n", path.c_str());
+	printf("tinyobj::LoadObj  %9.1f ms\n", tinyObj);
+
+	const unsigned maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	double singleThread = 0;
+
+	for (unsigned threadCount = 1; threadCount <= maxThreadCount; ++threadCount) {
+		size_t triangleCount = 0;
+
+		const double loadObjMesh = Time([&] {
+			ObjMesh mesh;
+			LoadObjMesh(path, mesh, nullptr, threadCount);
+			triangleCount = mesh.indices.size() / 3;
+		});
+
+		if (threadCount == 1)
+			singleThread = loadObjMesh;
+
+		printf("LoadObjMesh %3u   %9.1f ms  %5.2fx tinyobj  %5.2fx one thread  (%zu triangles)\n",
+			threadCount, loadObjMesh, tinyObj / loadObjMesh, singleThread / loadObjMesh, triangleCount);
+	}
+
+	if (argc <= 1)
+		remove(path.c_str());
+
+	return 0;
+}
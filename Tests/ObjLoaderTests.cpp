@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "Content/ObjLoader.h"
+#include "tiny_obj_loader.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+using namespace StereopsisBlockStackingPlayer;
+
+namespace {
+
+// tinyobj's result in LoadObjMesh's layout: every shape's indices in file order.
+ObjMesh LoadWithTinyObj(const std::string& path)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string err;
+
+	EXPECT_TRUE(tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str()));
+
+	ObjMesh mesh;
+	mesh.positions = attrib.vertices;
+	mesh.normals = attrib.normals;
+	mesh.texcoords = attrib.texcoords;
+
+	for (const tinyobj::shape_t& shape : shapes) {
+		for (const tinyobj::index_t& index : shape.mesh.indices)
+			mesh.indices.push_back({ index.vertex_index, index.texcoord_index, index.normal_index });
+	}
+
+	return mesh;
+}
+
+// Floats are compared bit for bit, so -0 and 0 differ and NaNs match themselves.
+void ExpectSameFloats(const std::vector<float>& expected, const std::vector<float>& actual, const char* what)
+{
+	ASSERT_EQ(expected.size(), actual.size()) << what;
+
+	for (size_t i = 0; i < expected.size(); ++i) {
+		uint32_t expectedBits, actualBits;
+		memcpy(&expectedBits, &expected[i], sizeof(expectedBits));
+		memcpy(&actualBits, &actual[i], sizeof(actualBits));
+
+		ASSERT_EQ(expectedBits, actualBits) << what << " " << i << ": " << expected[i] << " and " << actual[i];
+	}
+}
+
+void ExpectSameMesh(const ObjMesh& expected, const ObjMesh& actual)
+{
+	ExpectSameFloats(expected.positions, actual.positions, "position");
+	ExpectSameFloats(expected.normals, actual.normals, "normal");
+	ExpectSameFloats(expected.texcoords, actual.texcoords, "texcoord");
+
+	ASSERT_EQ(expected.indices.size(), actual.indices.size());
+
+	for (size_t i = 0; i < expected.indices.size(); ++i) {
+		ASSERT_EQ(expected.indices[i].vertex, actual.indices[i].vertex) << "index " << i;
+		ASSERT_EQ(expected.indices[i].texcoord, actual.indices[i].texcoord) << "index " << i;
+		ASSERT_EQ(expected.indices[i].normal, actual.indices[i].normal) << "index " << i;
+	}
+}
+
+// Numbers in every form both parsers accept, including ones the fast path
+// cannot convert exactly.
+std::string RandomNumber(std::mt19937& random)
+{
+	std::uniform_real_distribution<double> value(-100.0, 100.0);
+	std::ostringstream number;
+
+	switch (random() % 8) {
+	case 0:
+		number << static_cast<int>(value(random));
+		break;
+	case 1:
+		number.precision(3);
+		number << std::fixed << value(random);
+		break;
+	case 2:
+		number.precision(9);
+		number << std::scientific << value(random);
+		break;
+	case 3:
+		number.precision(17);
+		number << value(random);
+		break;
+	case 4:
+		// More significant digits than the fast path keeps.
+		number << "0.1234567890123456789012" << random() % 10;
+		break;
+	case 5:
+		number << "+" << random() % 1000 << "E-" << random() % 40;
+		break;
+	case 6:
+		number << "-" << random() % 10 << "e" << 20 + random() % 20;
+		break;
+	default:
+		number << "-0.0";
+		break;
+	}
+
+	return number.str();
+}
+
+// An OBJ file with several thousand lines per 64 KB chunk, mixing CRLF line
+// ends, blank padding, comments, groups, every corner form, polygons and
+// relative indices reaching back across chunk boundaries.
+std::string WriteGeneratedObj(const std::string& name, unsigned seed, int faceCount)
+{
+	std::mt19937 random(seed);
+	std::ostringstream obj;
+
+	int positionCount = 0;
+	int normalCount = 0;
+	int texcoordCount = 0;
+
+	for (int face = 0; face < faceCount; ++face) {
+		const char* lineEnd = random() % 2 ? "\r\n" : "\n";
+
+		if (face % 500 == 0)
+			obj << "g group" << face << lineEnd << "# comment " << face << lineEnd;
+
+		for (int i = random() % 3; i < 3; ++i) {
+			obj << (random() % 4 ? "v " : " \tv\t") << RandomNumber(random) << " " << RandomNumber(random) << "  "
+				<< RandomNumber(random) << lineEnd;
+			positionCount++;
+		}
+
+		obj << "vn " << RandomNumber(random) << " " << RandomNumber(random) << " " << RandomNumber(random) << lineEnd;
+		normalCount++;
+
+		obj << "vt " << RandomNumber(random) << " " << RandomNumber(random) << lineEnd;
+		texcoordCount++;
+
+		const int corners = 3 + random() % 4;
+		const unsigned form = random() % 4;
+
+		obj << "f";
+
+		for (int corner = 0; corner < corners; ++corner) {
+			const bool relative = random() % 3 == 0;
+			const int position = 1 + random() % positionCount;
+			const int normal = 1 + random() % normalCount;
+			const int texcoord = 1 + random() % texcoordCount;
+
+			const int v = relative ? position - positionCount - 1 : position;
+			const int vn = relative ? normal - normalCount - 1 : normal;
+			const int vt = relative ? texcoord - texcoordCount - 1 : texcoord;
+
+			obj << " " << v;
+
+			switch (form) {
+			case 1:
+				obj << "/" << vt;
+				break;
+			case 2:
+				obj << "//" << vn;
+				break;
+			case 3:
+				obj << "/" << vt << "/" << vn;
+				break;
+			}
+		}
+
+		obj << (random() % 4 ? "" : " ") << lineEnd;
+	}
+
+	// The last line has no line end.
+	obj << "v 1 2 3";
+
+	const std::string path = ::testing::TempDir() + name;
+	std::ofstream file(path, std::ios::binary);
+	file << obj.str();
+
+	return path;
+}
+
+}
+
+TEST(ObjLoaderTest, MatchesTinyObjOnShippedAssets)
+{
+	const std::string path = std::string(STEREOPSIS_PLAYER_ASSETS_DIR) + "/cylinder.obj";
+
+	ObjMesh mesh;
+	std::string err;
+	ASSERT_TRUE(LoadObjMesh(path, mesh, &err)) << err;
+
+	EXPECT_FALSE(mesh.indices.empty());
+	ExpectSameMesh(LoadWithTinyObj(path), mesh);
+}
+
+TEST(ObjLoaderTest, MatchesTinyObjAtEveryThreadCount)
+{
+	const std::string path = WriteGeneratedObj("ObjLoaderTest.obj", 1, 40000);
+	const ObjMesh expected = LoadWithTinyObj(path);
+
+	for (unsigned threadCount : { 1u, 2u, 3u, 8u, 0u }) {
+		SCOPED_TRACE(threadCount);
+
+		ObjMesh mesh;
+		ASSERT_TRUE(LoadObjMesh(path, mesh, nullptr, threadCount));
+		ExpectSameMesh(expected, mesh);
+	}
+
+	remove(path.c_str());
+}
+
+TEST(ObjLoaderTest, LoadsEmptyFile)
+{
+	const std::string path = ::testing::TempDir() + "ObjLoaderTestEmpty.obj";
+	std::ofstream(path, std::ios::binary).close();
+
+	ObjMesh mesh;
+	EXPECT_TRUE(LoadObjMesh(path, mesh));
+	EXPECT_TRUE(mesh.positions.empty());
+	EXPECT_TRUE(mesh.indices.empty());
+
+	remove(path.c_str());
+}
+
+TEST(ObjLoaderTest, FailsOnMissingFile)
+{
+	ObjMesh mesh;
+	std::string err;
+	EXPECT_FALSE(LoadObjMesh(::testing::TempDir() + "ObjLoaderTestMissing.obj", mesh, &err));
+	EXPECT_FALSE(err.empty());
+}
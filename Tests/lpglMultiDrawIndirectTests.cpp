@@ -0,0 +1,264 @@
+#include "pch.h"
+#include "lpgl.h"
+#include "lpglCommand.h"
+#include "lpglNullBackend.h"
+
+#include <gtest/gtest.h>
+
+using namespace DirectX;
+
+namespace {
+
+// Keeps the draws of every command buffer it executes, so tests can check
+// what each indirect record expanded into.
+class RecordingBackend : public lpglNullBackend {
+public:
+	struct Draw {
+		lpglDrawElementsCommand command;
+
+		// x translation of the instance transform of every instance transform
+		// the draw uses.
+		std::vector<float> instanceOffsets;
+	};
+
+	void Execute(const lpglCommandBuffer& commandBuffer) override
+	{
+		for (const lpglCommand& command : commandBuffer.commands) {
+			if (command.type != LPGL_COMMAND_DRAW_ELEMENTS_INSTANCED)
+				continue;
+
+			Draw draw;
+			draw.command = command.drawElements;
+			for (GLuint i = 0; i < command.drawElements.instanceTransformCount; ++i)
+				draw.instanceOffsets.push_back(commandBuffer.instanceTransforms[command.drawElements.firstInstanceTransform + i].m[3][0]);
+			draws.push_back(draw);
+		}
+
+		lpglNullBackend::Execute(commandBuffer);
+	}
+
+	std::vector<Draw> draws;
+};
+
+}
+
+class lpglMultiDrawIndirectTest : public ::testing::Test {
+protected:
+	// 4 quads of 6 indices each, sharing 16 vertices.
+	static const GLsizei kVertexCount = 16;
+	static const GLsizei kIndexCount = 24;
+
+	// Instance transform i is a translation by i along x.
+	static const GLsizei kInstanceTransformCount = 4;
+
+	void SetUp() override
+	{
+		std::unique_ptr<RecordingBackend> backend(new RecordingBackend());
+		m_backend = backend.get();
+		lpglInit(std::move(backend));
+
+		lpglSetDrawSorting(false);
+		lpglSetCullingViewProjections(nullptr);
+		glLoadIdentity();
+
+		float positions[kVertexCount * 3] = {};
+		unsigned short indices[kIndexCount];
+		for (GLsizei i = 0; i < kIndexCount; ++i)
+			indices[i] = static_cast<unsigned short>(i % 4);
+
+		glGenBuffers(2, m_buffers);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		glVertexFormat(GL_FLOAT, GL_NONE);
+
+		XMFLOAT4X4 transforms[kInstanceTransformCount];
+		for (GLsizei i = 0; i < kInstanceTransformCount; ++i)
+			XMStoreFloat4x4(&transforms[i], XMMatrixTranslation(static_cast<float>(i), 0, 0));
+		glInstanceTransforms(kInstanceTransformCount, &transforms[0].m[0][0]);
+
+		glGetError();
+	}
+
+	void TearDown() override
+	{
+		glInstanceTransforms(0, nullptr);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glDeleteBuffers(2, m_buffers);
+	}
+
+	const std::vector<RecordingBackend::Draw>& Draws() const { return m_backend->draws; }
+
+	RecordingBackend* m_backend = nullptr;
+	GLuint m_buffers[2] = {};
+};
+
+TEST_F(lpglMultiDrawIndirectTest, EachRecordBecomesADraw)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+		{ 12, 2 * LPGL_VIEW_COUNT, 6, 4, 1 },
+		{ 6, LPGL_VIEW_COUNT, 18, 8, 3 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 3, 0);
+	glFlush();
+
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+	ASSERT_EQ(3u, Draws().size());
+	EXPECT_EQ(3u, m_backend->GetCounters().drawCount);
+	EXPECT_EQ(0u, m_backend->GetCounters().invalidDrawCount);
+
+	for (size_t i = 0; i < Draws().size(); ++i) {
+		const lpglDrawElementsCommand& command = Draws()[i].command;
+		EXPECT_EQ(static_cast<GLsizei>(records[i].count), command.count);
+		EXPECT_EQ(static_cast<GLsizei>(records[i].instanceCount), command.primcount);
+		EXPECT_EQ(records[i].firstIndex, command.firstIndex);
+		EXPECT_EQ(records[i].baseVertex, command.baseVertex);
+		EXPECT_EQ(m_buffers[0], command.arrayBuffer);
+		EXPECT_EQ(m_buffers[1], command.elementArrayBuffer);
+	}
+}
+
+TEST_F(lpglMultiDrawIndirectTest, BaseInstanceOffsetsTheInstanceTransforms)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+		{ 6, 2 * LPGL_VIEW_COUNT, 0, 0, 1 },
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 3 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 3, 0);
+	glFlush();
+
+	ASSERT_EQ(3u, Draws().size());
+	EXPECT_EQ(std::vector<float>({ 0 }), Draws()[0].instanceOffsets);
+	EXPECT_EQ(std::vector<float>({ 1, 2 }), Draws()[1].instanceOffsets);
+	EXPECT_EQ(std::vector<float>({ 3 }), Draws()[2].instanceOffsets);
+}
+
+TEST_F(lpglMultiDrawIndirectTest, StrideSkipsInterleavedData)
+{
+	// Records interleaved with per-draw data the caller keeps alongside them.
+	struct Record {
+		lpglDrawElementsIndirectCommand command;
+		GLuint padding[3];
+	};
+
+	Record records[2] = {};
+	records[0].command = { 6, LPGL_VIEW_COUNT, 0, 0, 0 };
+	records[1].command = { 12, LPGL_VIEW_COUNT, 12, 0, 2 };
+	records[0].padding[0] = 0xffffffff;
+	records[1].padding[0] = 0xffffffff;
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 2, sizeof(Record));
+	glFlush();
+
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+	ASSERT_EQ(2u, Draws().size());
+	EXPECT_EQ(6, Draws()[0].command.count);
+	EXPECT_EQ(12, Draws()[1].command.count);
+	EXPECT_EQ(12u, Draws()[1].command.firstIndex);
+	EXPECT_EQ(std::vector<float>({ 2 }), Draws()[1].instanceOffsets);
+}
+
+TEST_F(lpglMultiDrawIndirectTest, ZeroStrideMatchesTightlyPackedStride)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+		{ 6, LPGL_VIEW_COUNT, 6, 4, 1 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 2, 0);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 2, sizeof(lpglDrawElementsIndirectCommand));
+	glFlush();
+
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+	ASSERT_EQ(4u, Draws().size());
+
+	for (size_t i = 0; i < 2; ++i) {
+		EXPECT_EQ(Draws()[i].command.firstIndex, Draws()[i + 2].command.firstIndex);
+		EXPECT_EQ(Draws()[i].command.baseVertex, Draws()[i + 2].command.baseVertex);
+		EXPECT_EQ(Draws()[i].instanceOffsets, Draws()[i + 2].instanceOffsets);
+	}
+}
+
+TEST_F(lpglMultiDrawIndirectTest, InvalidStrideOrCountDrawsNothing)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 1, 2);
+	EXPECT_EQ(GL_INVALID_VALUE, glGetError());
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 1, -4);
+	EXPECT_EQ(GL_INVALID_VALUE, glGetError());
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, -1, 0);
+	EXPECT_EQ(GL_INVALID_VALUE, glGetError());
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_FLOAT, records, 1, 0);
+	EXPECT_EQ(GL_INVALID_ENUM, glGetError());
+
+	glFlush();
+
+	EXPECT_TRUE(Draws().empty());
+}
+
+TEST_F(lpglMultiDrawIndirectTest, RecordsPastTheIndicesAreSkipped)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+		{ 6, LPGL_VIEW_COUNT, kIndexCount - 3, 0, 0 },
+		{ 6, LPGL_VIEW_COUNT, 18, 0, 1 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 3, 0);
+	EXPECT_EQ(GL_INVALID_VALUE, glGetError());
+
+	glFlush();
+
+	// The records around the invalid one are still drawn.
+	ASSERT_EQ(2u, Draws().size());
+	EXPECT_EQ(0u, Draws()[0].command.firstIndex);
+	EXPECT_EQ(18u, Draws()[1].command.firstIndex);
+	EXPECT_EQ(0u, m_backend->GetCounters().invalidDrawCount);
+}
+
+TEST_F(lpglMultiDrawIndirectTest, RecordsPastTheInstanceTransformsAreSkipped)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 6, LPGL_VIEW_COUNT, 0, 0, kInstanceTransformCount },
+		{ 6, 2 * LPGL_VIEW_COUNT, 0, 0, kInstanceTransformCount - 1 },
+		{ 6, LPGL_VIEW_COUNT, 0, 0, kInstanceTransformCount - 1 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 3, 0);
+	EXPECT_EQ(GL_INVALID_VALUE, glGetError());
+
+	glFlush();
+
+	ASSERT_EQ(1u, Draws().size());
+	EXPECT_EQ(std::vector<float>({ kInstanceTransformCount - 1 }), Draws()[0].instanceOffsets);
+}
+
+TEST_F(lpglMultiDrawIndirectTest, EmptyRecordsAreSkippedWithoutAnError)
+{
+	const lpglDrawElementsIndirectCommand records[] = {
+		{ 0, LPGL_VIEW_COUNT, 0, 0, 0 },
+		{ 6, 0, 0, 0, 0 },
+		{ 6, LPGL_VIEW_COUNT, 0, 0, 0 },
+	};
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, records, 3, 0);
+	glFlush();
+
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+	EXPECT_EQ(1u, Draws().size());
+}
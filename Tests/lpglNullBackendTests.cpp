@@ -0,0 +1,335 @@
+#include "pch.h"
+#include "lpgl.h"
+#include "lpglNullBackend.h"
+#include "lpglStatistics.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace DirectX;
+
+// Records through the GL entry points and checks what reached the backend.
+class lpglNullBackendTest : public ::testing::Test {
+protected:
+	// A cube: 8 float positions and 36 16-bit indices.
+	static const GLsizei kVertexCount = 8;
+	static const GLsizei kIndexCount = 36;
+
+	void SetUp() override
+	{
+		std::unique_ptr<lpglNullBackend> backend(new lpglNullBackend());
+		m_backend = backend.get();
+		lpglInit(std::move(backend));
+
+		lpglSetDrawSorting(false);
+		lpglSetCullingViewProjections(nullptr);
+		lpglEndFrame();
+
+		glLoadIdentity();
+		glInstanceTransforms(0, nullptr);
+		glGetError();
+	}
+
+	void TearDown() override
+	{
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		if (m_buffers[0])
+			glDeleteBuffers(2, m_buffers);
+	}
+
+	// Creates and binds the cube's vertex and index buffers.
+	void CreateCube()
+	{
+		const float positions[kVertexCount * 3] = {
+			-1, -1, -1,  -1, -1, 1,  -1, 1, -1,  -1, 1, 1,
+			 1, -1, -1,   1, -1, 1,   1, 1, -1,   1, 1, 1,
+		};
+
+		unsigned short indices[kIndexCount];
+		for (GLsizei i = 0; i < kIndexCount; ++i)
+			indices[i] = static_cast<unsigned short>(i % kVertexCount);
+
+		glGenBuffers(2, m_buffers);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		glVertexFormat(GL_FLOAT, GL_NONE);
+	}
+
+	const lpglNullBackend::Counters& Counters() const { return m_backend->GetCounters(); }
+
+	lpglNullBackend* m_backend = nullptr;
+	GLuint m_buffers[2] = {};
+};
+
+TEST_F(lpglNullBackendTest, BufferDataWithContentsCreatesStorage)
+{
+	CreateCube();
+
+	EXPECT_EQ(2u, Counters().bufferDataCount);
+	EXPECT_EQ(kVertexCount * 3 * sizeof(float) + kIndexCount * sizeof(unsigned short), Counters().bufferBytes);
+}
+
+TEST_F(lpglNullBackendTest, MappedBufferIsCreatedAtUnmap)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, 64, nullptr, GL_STATIC_DRAW);
+
+	EXPECT_EQ(0u, Counters().bufferDataCount);
+
+	void* contents = glMapBufferRange(GL_ARRAY_BUFFER, 0, 64, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	ASSERT_NE(nullptr, contents);
+	memset(contents, 0, 64);
+	EXPECT_TRUE(glUnmapBuffer(GL_ARRAY_BUFFER));
+
+	EXPECT_EQ(1u, Counters().bufferDataCount);
+	EXPECT_EQ(64u, Counters().bufferBytes);
+
+	glDeleteBuffers(1, &buffer);
+	EXPECT_EQ(1u, Counters().deleteBufferCount);
+}
+
+TEST_F(lpglNullBackendTest, DrawsReachTheBackendAtFlush)
+{
+	CreateCube();
+
+	for (int i = 0; i < 3; ++i) {
+		glTranslatef(1, 0, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	}
+
+	EXPECT_EQ(0u, Counters().executeCount);
+
+	glFlush();
+
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+	EXPECT_EQ(1u, Counters().executeCount);
+	EXPECT_EQ(3u, Counters().drawCount);
+	EXPECT_EQ(0u, Counters().invalidDrawCount);
+	EXPECT_EQ(3u * kIndexCount * LPGL_VIEW_COUNT, Counters().indexCount);
+	EXPECT_EQ(3u * LPGL_VIEW_COUNT, Counters().instanceCount);
+	EXPECT_EQ(3u, Counters().transformCount);
+
+	lpglEndFrame();
+	EXPECT_EQ(3u, lpglGetFrameStatistics().counters[LPGL_COUNTER_DRAWS]);
+	EXPECT_EQ(3u * kIndexCount / 3 * LPGL_VIEW_COUNT, lpglGetFrameStatistics().counters[LPGL_COUNTER_TRIANGLES]);
+}
+
+TEST_F(lpglNullBackendTest, FlushWithoutCommandsDoesNotExecute)
+{
+	glFlush();
+
+	EXPECT_EQ(0u, Counters().executeCount);
+}
+
+TEST_F(lpglNullBackendTest, DrawsPastTheIndexBufferAreInvalid)
+{
+	CreateCube();
+
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount + 3, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	glDrawElementsInstanced(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT,
+		reinterpret_cast<const void*>(kIndexCount * sizeof(unsigned short)), LPGL_VIEW_COUNT);
+	glFlush();
+
+	EXPECT_EQ(0u, Counters().drawCount);
+	EXPECT_EQ(2u, Counters().invalidDrawCount);
+}
+
+TEST_F(lpglNullBackendTest, BaseVertexPastTheVertexBufferIsInvalid)
+{
+	CreateCube();
+
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT, kVertexCount - 1);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT, kVertexCount);
+	glFlush();
+
+	EXPECT_EQ(1u, Counters().drawCount);
+	EXPECT_EQ(1u, Counters().invalidDrawCount);
+}
+
+TEST_F(lpglNullBackendTest, UnknownIndexTypesAreNotDrawn)
+{
+	CreateCube();
+
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_BYTE, nullptr, LPGL_VIEW_COUNT);
+	EXPECT_EQ(GL_INVALID_ENUM, glGetError());
+
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, kIndexCount, GL_FLOAT, nullptr, LPGL_VIEW_COUNT, 1);
+	EXPECT_EQ(GL_INVALID_ENUM, glGetError());
+
+	glFlush();
+
+	EXPECT_EQ(0u, Counters().executeCount);
+	EXPECT_EQ(0u, Counters().drawCount);
+	EXPECT_EQ(0u, Counters().invalidDrawCount);
+}
+
+TEST_F(lpglNullBackendTest, InstancesNeedTransforms)
+{
+	CreateCube();
+
+	XMFLOAT4X4 transforms[2];
+	XMStoreFloat4x4(&transforms[0], XMMatrixIdentity());
+	XMStoreFloat4x4(&transforms[1], XMMatrixTranslation(2, 0, 0));
+	glInstanceTransforms(2, &transforms[0].m[0][0]);
+
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, 2 * LPGL_VIEW_COUNT);
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, 3 * LPGL_VIEW_COUNT);
+	glFlush();
+
+	EXPECT_EQ(1u, Counters().drawCount);
+	EXPECT_EQ(1u, Counters().invalidDrawCount);
+	EXPECT_EQ(2u * LPGL_VIEW_COUNT, Counters().instanceCount);
+	EXPECT_EQ(2u, Counters().instanceTransformCount);
+}
+
+TEST_F(lpglNullBackendTest, BufferUpdatesAreRecordedWithTheDraws)
+{
+	CreateCube();
+
+	const float position[3] = { 0, 0, 0 };
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, 12, sizeof(position), position);
+
+	EXPECT_EQ(0u, Counters().bufferSubDataCount);
+
+	// Respecifying with the same size, target and usage orphans the storage.
+	float positions[kVertexCount * 3] = {};
+	glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	glFlush();
+
+	EXPECT_EQ(2u, Counters().bufferDataCount);
+	EXPECT_EQ(2u, Counters().bufferSubDataCount);
+	EXPECT_EQ(sizeof(position) + sizeof(positions), Counters().bufferSubDataBytes);
+	EXPECT_EQ(1u, Counters().orphanCount);
+	EXPECT_EQ(0u, Counters().invalidBufferSubDataCount);
+	EXPECT_EQ(1u, Counters().drawCount);
+}
+
+TEST_F(lpglNullBackendTest, SortingMergesDrawsOfTheSameMesh)
+{
+	CreateCube();
+	lpglSetDrawSorting(true);
+
+	for (int i = 0; i < 4; ++i) {
+		glPushMatrix();
+		glTranslatef(static_cast<float>(i), 0, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+		glPopMatrix();
+	}
+
+	glFlush();
+
+	EXPECT_EQ(1u, Counters().drawCount);
+	EXPECT_EQ(4u * LPGL_VIEW_COUNT, Counters().instanceCount);
+
+	lpglEndFrame();
+	EXPECT_EQ(3u, lpglGetFrameStatistics().counters[LPGL_COUNTER_MERGED_DRAWS]);
+}
+
+TEST_F(lpglNullBackendTest, CullingDropsDrawsNoViewSees)
+{
+	CreateCube();
+
+	// Identity view-projections: visible boxes reach into [-1, 1] in x and y,
+	// in front of z = 0.
+	XMFLOAT4X4 viewProjections[LPGL_VIEW_COUNT];
+	for (XMFLOAT4X4& viewProjection : viewProjections)
+		XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+	lpglSetCullingViewProjections(&viewProjections[0].m[0][0]);
+
+	const float insideMin[3] = { -0.5f, -0.5f, 0.5f };
+	const float insideMax[3] = { 0.5f, 0.5f, 1.0f };
+	const float outsideMin[3] = { 4.0f, -0.5f, 0.5f };
+	const float outsideMax[3] = { 5.0f, 0.5f, 1.0f };
+
+	glDrawBounds(insideMin, insideMax);
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	glDrawBounds(outsideMin, outsideMax);
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+
+	// Without bounds a draw is never culled.
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	glFlush();
+
+	EXPECT_EQ(2u, Counters().drawCount);
+
+	lpglEndFrame();
+	EXPECT_EQ(1u, lpglGetFrameStatistics().counters[LPGL_COUNTER_CULLED_DRAWS]);
+	EXPECT_EQ(1u, lpglGetFrameStatistics().counters[LPGL_COUNTER_PASSED_DRAWS]);
+}
+
+TEST_F(lpglNullBackendTest, ContextsAreSubmittedWithTheDefaultContext)
+{
+	CreateCube();
+
+	lpglContext* contexts[2] = { lpglCreateContext(), lpglCreateContext() };
+	std::thread workers[2];
+
+	for (int i = 0; i < 2; ++i) {
+		workers[i] = std::thread([this, &contexts, i]
+		{
+			lpglMakeCurrent(contexts[i]);
+
+			// Bindings are per context.
+			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+			glVertexFormat(GL_FLOAT, GL_NONE);
+
+			for (int draw = 0; draw <= i; ++draw)
+				glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+
+			glFlush();
+			lpglMakeCurrent(nullptr);
+		});
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	EXPECT_EQ(0u, Counters().executeCount);
+
+	glDrawElementsInstanced(GL_TRIANGLES, kIndexCount, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	glFlush();
+
+	// The null backend takes one concatenated command buffer.
+	EXPECT_EQ(1u, Counters().executeCount);
+	EXPECT_EQ(4u, Counters().drawCount);
+	EXPECT_EQ(0u, Counters().invalidDrawCount);
+
+	// Closed lists are submitted once.
+	glFlush();
+	EXPECT_EQ(1u, Counters().executeCount);
+
+	lpglDestroyContext(contexts[0]);
+	lpglDestroyContext(contexts[1]);
+}
+
+TEST_F(lpglNullBackendTest, MatrixStackErrors)
+{
+	glPopMatrix();
+	EXPECT_EQ(GL_STACK_UNDERFLOW, glGetError());
+
+	for (int i = 1; i < LPGL_MAX_MATRIX_STACK_DEPTH; ++i)
+		glPushMatrix();
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+	glPushMatrix();
+	EXPECT_EQ(GL_STACK_OVERFLOW, glGetError());
+
+	for (int i = 1; i < LPGL_MAX_MATRIX_STACK_DEPTH; ++i)
+		glPopMatrix();
+	EXPECT_EQ(GL_NO_ERROR, glGetError());
+}
@@ -0,0 +1,300 @@
+#include "pch.h"
+#include "lpgl.h"
+#include "lpglSoftwareBackend.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+
+using namespace DirectX;
+
+// Renders through the software backend and checks the color and depth it
+// writes for each eye.
+class lpglSoftwareBackendTest : public ::testing::Test {
+protected:
+	static constexpr int kSize = 64;
+	static constexpr uint32_t kClearColor = 0xff202020;
+
+	// Eyes kEyeOffset to either side of the origin, looking down -z.
+	static constexpr float kEyeOffset = 0.1f;
+	static constexpr float kNear = 0.5f;
+	static constexpr float kFar = 20.0f;
+
+	void SetUp() override
+	{
+		std::unique_ptr<lpglSoftwareBackend> backend(new lpglSoftwareBackend(kSize, kSize, 2));
+		m_backend = backend.get();
+		lpglInit(std::move(backend));
+
+		lpglSetDrawSorting(false);
+		lpglSetCullingViewProjections(nullptr);
+		glLoadIdentity();
+		glInstanceTransforms(0, nullptr);
+
+		for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+			XMFLOAT4X4 viewProjection;
+			XMStoreFloat4x4(&viewProjection, ViewProjection(view));
+			m_backend->SetViewProjection(view, viewProjection);
+		}
+
+		m_backend->Clear(kClearColor);
+		CreateCube();
+	}
+
+	void TearDown() override
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glDeleteBuffers(2, m_buffers);
+	}
+
+	static XMMATRIX ViewProjection(int view)
+	{
+		const float eyeX = view == 0 ? -kEyeOffset : kEyeOffset;
+
+		return XMMatrixLookToRH(XMVectorSet(eyeX, 0, 0, 1), XMVectorSet(0, 0, -1, 0), XMVectorSet(0, 1, 0, 0)) *
+			XMMatrixPerspectiveFovRH(XM_PI / 3, 1.0f, kNear, kFar);
+	}
+
+	// Depth a view writes for a point in world space.
+	static float ProjectedDepth(int view, float x, float y, float z)
+	{
+		return XMVectorGetZ(XMVector3TransformCoord(XMVectorSet(x, y, z, 1), ViewProjection(view)));
+	}
+
+	// A unit cube around the origin with one flat color per face, wound
+	// clockwise seen from outside.
+	void CreateCube()
+	{
+		struct Vertex {
+			XMFLOAT3 position;
+			XMFLOAT3 color;
+		};
+
+		const XMFLOAT3 faceColors[6] = {
+			{ 0, 1, 1 }, { 1, 0, 0 },	// -x, +x
+			{ 1, 0, 1 }, { 0, 1, 0 },	// -y, +y
+			{ 1, 1, 0 }, { 0, 0, 1 },	// -z, +z
+		};
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned short> indices;
+
+		for (int face = 0; face < 6; ++face) {
+			const int axis = face / 2;
+			const float sign = face % 2 ? 0.5f : -0.5f;
+
+			// u x v points out of the face.
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			if (sign < 0)
+				std::swap(u, v);
+
+			const float corners[4][2] = { { -0.5f, -0.5f }, { -0.5f, 0.5f }, { 0.5f, 0.5f }, { 0.5f, -0.5f } };
+			const unsigned short base = static_cast<unsigned short>(vertices.size());
+
+			for (const auto& corner : corners) {
+				float position[3];
+				position[axis] = sign;
+				position[u] = corner[0];
+				position[v] = corner[1];
+
+				vertices.push_back({ XMFLOAT3(position[0], position[1], position[2]), faceColors[face] });
+			}
+
+			for (unsigned short index : { 0, 1, 2, 0, 2, 3 })
+				indices.push_back(base + index);
+		}
+
+		glGenBuffers(2, m_buffers);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizei>(vertices.size() * sizeof(Vertex)), vertices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizei>(indices.size() * sizeof(unsigned short)), indices.data(), GL_STATIC_DRAW);
+
+		glVertexFormat(GL_FLOAT, GL_FLOAT);
+	}
+
+	void DrawCube()
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr, LPGL_VIEW_COUNT);
+	}
+
+	uint32_t Color(int view, int x, int y) const { return m_backend->GetColor(view)[y * kSize + x]; }
+	float Depth(int view, int x, int y) const { return m_backend->GetDepth(view)[y * kSize + x]; }
+
+	lpglSoftwareBackend* m_backend = nullptr;
+	GLuint m_buffers[2] = {};
+};
+
+namespace {
+
+// Both eyes side by side as a binary PPM.
+std::vector<unsigned char> EyesToRgb(const lpglSoftwareBackend& backend)
+{
+	const int width = backend.GetWidth();
+	const int height = backend.GetHeight();
+	std::vector<unsigned char> rgb;
+
+	for (int y = 0; y < height; ++y) {
+		for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+			for (int x = 0; x < width; ++x) {
+				const uint32_t color = backend.GetColor(view)[y * width + x];
+				rgb.push_back(color & 0xff);
+				rgb.push_back((color >> 8) & 0xff);
+				rgb.push_back((color >> 16) & 0xff);
+			}
+		}
+	}
+
+	return rgb;
+}
+
+void WritePpm(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb)
+{
+	std::ofstream file(path, std::ios::binary);
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+}
+
+bool ReadPpm(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgb)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	int maxValue;
+
+	if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255)
+		return false;
+
+	file.get();
+	rgb.resize(static_cast<size_t>(width) * height * 3);
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(rgb.data()), rgb.size()));
+}
+
+}
+
+TEST_F(lpglSoftwareBackendTest, CubeMatchesGoldenImage)
+{
+	glTranslatef(0, 0, -3);
+	glRotatef(20, 1, 0, 0);
+	glRotatef(35, 0, 1, 0);
+	DrawCube();
+	glFlush();
+
+	// Three faces of the cube face each eye.
+	EXPECT_EQ(12u * LPGL_VIEW_COUNT, m_backend->GetCounters().triangleCount);
+	EXPECT_EQ(6u * LPGL_VIEW_COUNT, m_backend->GetCounters().culledTriangleCount);
+	EXPECT_EQ(6u * LPGL_VIEW_COUNT, m_backend->GetCounters().rasterizedTriangleCount);
+
+	const std::string goldenPath = std::string(LPGL_TESTS_GOLDEN_DIR) + "/lpglSoftwareBackendCube.ppm";
+	const std::vector<unsigned char> rgb = EyesToRgb(*m_backend);
+
+	// Set LPGL_UPDATE_GOLDEN to rewrite the image after an intended change.
+	if (getenv("LPGL_UPDATE_GOLDEN")) {
+		WritePpm(goldenPath, kSize * LPGL_VIEW_COUNT, kSize, rgb);
+		GTEST_SKIP() << "Wrote " << goldenPath;
+	}
+
+	int width, height;
+	std::vector<unsigned char> golden;
+	ASSERT_TRUE(ReadPpm(goldenPath, width, height, golden)) << goldenPath;
+	ASSERT_EQ(kSize * LPGL_VIEW_COUNT, width);
+	ASSERT_EQ(kSize, height);
+
+	// Pixel centers lying on an edge may fall either way with another
+	// DirectXMath implementation, so a few edge pixels may differ.
+	int mismatches = 0;
+
+	for (size_t pixel = 0; pixel < golden.size() / 3; ++pixel) {
+		for (int channel = 0; channel < 3; ++channel) {
+			if (abs(golden[pixel * 3 + channel] - rgb[pixel * 3 + channel]) > 2) {
+				mismatches++;
+				break;
+			}
+		}
+	}
+
+	EXPECT_LE(mismatches, 16);
+
+	// The eyes see the cube from different places.
+	EXPECT_NE(std::vector<unsigned int>(m_backend->GetColor(0), m_backend->GetColor(0) + kSize * kSize),
+		std::vector<unsigned int>(m_backend->GetColor(1), m_backend->GetColor(1) + kSize * kSize));
+}
+
+TEST_F(lpglSoftwareBackendTest, NearerSurfacesWinTheDepthTest)
+{
+	// A cube with its front face at z = -2.5, and a larger one behind it with
+	// its front face at z = -4.5, drawn in both orders.
+	for (bool nearFirst : { true, false }) {
+		SCOPED_TRACE(nearFirst);
+		m_backend->Clear(kClearColor);
+
+		for (int draw = 0; draw < 2; ++draw) {
+			glLoadIdentity();
+
+			if ((draw == 0) == nearFirst) {
+				glTranslatef(0, 0, -3);
+			}
+			else {
+				glTranslatef(0, 0, -6);
+				glScalef(3, 3, 3);
+			}
+
+			DrawCube();
+		}
+
+		glFlush();
+
+		for (int view = 0; view < LPGL_VIEW_COUNT; ++view) {
+			SCOPED_TRACE(view);
+
+			// Both cubes show their blue +z face.
+			const int center = kSize / 2;
+			EXPECT_EQ(0xffff0000u, Color(view, center, center));
+			EXPECT_NEAR(ProjectedDepth(view, 0, 0, -2.5f), Depth(view, center, center), 1e-5f);
+
+			// Past the near cube's edge, about 11 pixels from the center.
+			EXPECT_EQ(0xffff0000u, Color(view, center, center - 14));
+			EXPECT_NEAR(ProjectedDepth(view, 0, 0, -4.5f), Depth(view, center, center - 14), 1e-5f);
+
+			// Nothing is drawn in the corners.
+			EXPECT_EQ(kClearColor, Color(view, 0, 0));
+			EXPECT_EQ(1.0f, Depth(view, 0, 0));
+		}
+	}
+}
+
+TEST_F(lpglSoftwareBackendTest, CountsFillCost)
+{
+	glTranslatef(0, 0, -3);
+	DrawCube();
+	glFlush();
+
+	const lpglSoftwareBackend::Counters first = m_backend->GetCounters();
+	EXPECT_GT(first.pixelsTested, 0u);
+	EXPECT_EQ(first.pixelsTested, first.pixelsWritten);
+
+	// The same cube again fails the LESS test everywhere.
+	m_backend->ResetCounters();
+	DrawCube();
+	glFlush();
+
+	EXPECT_EQ(first.pixelsTested, m_backend->GetCounters().pixelsTested);
+	EXPECT_EQ(0u, m_backend->GetCounters().pixelsWritten);
+}
+
+TEST_F(lpglSoftwareBackendTest, ClipsAtTheNearPlane)
+{
+	// The eyes sit inside the cube, so every face crosses the near plane or lies behind it.
+	glScalef(4, 4, 4);
+	DrawCube();
+	glFlush();
+
+	EXPECT_GT(m_backend->GetCounters().clippedTriangleCount, 0u);
+
+	// Inside, the faces wind the other way, so the -z face is seen from behind and culled.
+	EXPECT_EQ(kClearColor, Color(0, kSize / 2, kSize / 2));
+}
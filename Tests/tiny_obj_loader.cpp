@@ -0,0 +1,4 @@
+// The player's tiny_obj_loader.cpp includes the UWP precompiled header next to
+// it, so the portable build compiles the implementation from here.
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"